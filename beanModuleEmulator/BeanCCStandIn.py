@@ -0,0 +1,1167 @@
+#!/usr/bin/env python
+"""Headless stand-in for the Bean's CC2540, for benchmarking the core.
+
+Wire the ATmega's UART (or any board running the Bean core) to a USB serial
+adapter and point this script at it, or give it --pty or --tcp and connect
+the host build of the core (or anything else) to that. It speaks the framing
+the core uses, including the CRC, and models the CC's side of the
+AppMessages.h message set:
+
+  radio config          MSG_ID_BT_GET_CONFIG and _SET_CONFIG(_NOSAVE), and
+                        the name, pin, TX power, interval and advertising
+                        messages, held in one BT_RADIOCONFIG_T
+  scratch banks         MSG_ID_BT_SET_SCRATCH / _GET_SCRATCH, banks 1-5
+  LED                   MSG_ID_CC_LED_WRITE / _WRITE_ALL / _READ_ALL
+  sensors               accelerometer reading, range and registers,
+                        temperature and battery, from --accel,
+                        --temperature and --battery
+  BT states             MSG_ID_BT_GET_STATES; --disconnect-every drops and
+                        restores the connection, pushing the new state
+  observer              MSG_ID_OBSERVER_START / _STOP; made-up adverts are
+                        sent every --advert-interval while scanning
+  ANCS                  a notification every --ancs-interval, and the
+                        attribute replies to MSG_ID_ANCS_GET_NOTI
+  MIDI and HID          counted; --midi-echo sends MIDI packets back
+  sleep                 MSG_ID_AR_SLEEP is logged; nothing wakes the AVR
+  debug                 MSG_ID_DB_LOOPBACK and _E2E_LOOPBACK echoed,
+                        MSG_ID_DB_COUNTER counts, and the core's
+                        MSG_ID_DB_LOOPBACK_BENCH results are printed, as
+                        is MSG_ID_DB_POWER_STATS in hex (for EnergyBench
+                        --stats in host/), MSG_ID_DB_MEMORY_STATS, the
+                        MSG_ID_DB_PROFILE table and MSG_ID_DB_LATENCY
+                        histograms;
+                        --trace-every asks for MSG_ID_DB_TRACE dumps and
+                        prints them as a timeline, see BeanTrace.py
+
+Message IDs come from applicationMessageHeaders/AppMessages.h when the
+submodule is checked out, and from the table below otherwise.
+
+--latency delays every reply, --loss drops frames both ways, and
+--wake-delay makes the stand-in deaf for that long after the link has been
+quiet for --idle-sleep, as a sleeping CC is; the core's own wake delay is
+what should cover it. On a PTY or socket, each frame is held back until it
+would have finished crossing the link at the negotiated rate, unless the
+other end models the wire itself (--no-pace), as the host build does.
+
+It also answers the transport extensions that have no implementation in the
+CC firmware yet:
+
+  MSG_ID_BULK_START / MSG_ID_BULK_DATA  acked with MSG_ID_BULK_ACK
+  MSG_ID_SERIAL_DATA_LZ                 decompressed, see BeanCompression.py
+  MSG_ID_TELEMETRY                      decoded with --schema, BeanTelemetry.py
+  MSG_ID_RELIABLE_DATA / _RESET         unwrapped in order, acked with
+                                        MSG_ID_RELIABLE_ACK
+  MSG_ID_CONTAINER                      unpacked, each message dispatched
+  MSG_ID_LINK_RATE / _CONFIRM           the fastest offered rate up to
+                                        --max-link-rate is picked; falls
+                                        back to --baud without a confirm
+
+--corrupt flips bits in both directions, to exercise the CRC and reliable
+mode on a clean wire.
+
+Virtual serial data is printed, and throughput is reported for serial data
+and for each bulk transfer. Frame counts per message ID are logged on exit.
+
+    ./BeanCCStandIn.py /dev/ttyUSB0 --baud 38400 --drop-every 10
+    ./BeanCCStandIn.py --pty /tmp/bean-cc --latency 0.004 --loss 0.01
+"""
+from __future__ import print_function
+
+import argparse
+import binascii
+import collections
+import heapq
+import logging
+import os
+import random
+import re
+import select
+import signal
+import socket
+import struct
+import sys
+import time
+import zlib
+
+from BeanCompression import LZDecoder
+from BeanTelemetry import Schema, TelemetryDecoder
+from BeanTrace import MSG_ID_DB_TRACE, TraceDecoder, render as render_trace
+
+SOF_BYTE = 0x7E
+EOF_BYTE = 0x7F
+ESC_BYTE = 0x7D
+ESC_XOR = 0x20
+
+MSG_ID_SERIAL_DATA = 0x0000
+MSG_ID_BULK_START = 0x0A00
+MSG_ID_BULK_DATA = 0x0A01
+MSG_ID_BULK_ACK = 0x0A02
+MSG_ID_SERIAL_DATA_LZ = 0x0A10
+MSG_ID_TELEMETRY = 0x0A20
+MSG_ID_RELIABLE_DATA = 0x0A30
+MSG_ID_RELIABLE_ACK = 0x0A31
+MSG_ID_RELIABLE_RESET = 0x0A32
+MSG_ID_CONTAINER = 0x0A40
+MSG_ID_LINK_RATE = 0x0A50
+MSG_ID_LINK_RATE_CONFIRM = 0x0A51
+MSG_ID_DB_LOOPBACK_BENCH = 0xFE11
+MSG_ID_DB_POWER_STATS = 0xFE12
+MSG_ID_DB_PROFILE = 0xFE13
+MSG_ID_DB_MEMORY_STATS = 0xFE15
+MSG_ID_DB_LATENCY = 0xFE16
+
+LINK_RATE_CONFIRM_WINDOW = 0.1
+MAX_BODY_LENGTH = 64
+
+# AppMessages.h, for when the submodule isn't checked out
+APP_MESSAGE_IDS = {
+    'MSG_ID_BT_SET_ADV': 0x0500,
+    'MSG_ID_BT_SET_CONN': 0x0502,
+    'MSG_ID_BT_SET_LOCAL_NAME': 0x0504,
+    'MSG_ID_BT_SET_PIN': 0x0506,
+    'MSG_ID_BT_SET_TX_PWR': 0x0508,
+    'MSG_ID_BT_GET_CONFIG': 0x0510,
+    'MSG_ID_BT_ADV_ONOFF': 0x0512,
+    'MSG_ID_BT_SET_SCRATCH': 0x0514,
+    'MSG_ID_BT_GET_SCRATCH': 0x0515,
+    'MSG_ID_BT_RESTART': 0x0520,
+    'MSG_ID_BT_GET_STATES': 0x0530,
+    'MSG_ID_BT_DISCONNECT': 0x0540,
+    'MSG_ID_BT_SET_CONFIG': 0x0550,
+    'MSG_ID_BT_SET_CONFIG_NOSAVE': 0x0551,
+    'MSG_ID_BT_ENABLE_PAIRING_PIN': 0x0560,
+    'MSG_ID_CC_LED_WRITE': 0x2000,
+    'MSG_ID_CC_LED_WRITE_ALL': 0x2001,
+    'MSG_ID_CC_LED_READ_ALL': 0x2002,
+    'MSG_ID_CC_ACCEL_READ': 0x2010,
+    'MSG_ID_CC_TEMP_READ': 0x2011,
+    'MSG_ID_CC_BATT_READ': 0x2015,
+    'MSG_ID_CC_ACCEL_GET_RANGE': 0x2030,
+    'MSG_ID_CC_ACCEL_SET_RANGE': 0x2035,
+    'MSG_ID_CC_ACCEL_READ_REG': 0x2040,
+    'MSG_ID_CC_ACCEL_WRITE_REG': 0x2045,
+    'MSG_ID_CC_WAKE_ON_ACCEL': 0x2050,
+    'MSG_ID_AR_SLEEP': 0x3000,
+    'MSG_ID_AR_WAKE_ON_CONNECT': 0x3010,
+    'MSG_ID_GATT_SET_GATT': 0x5000,
+    'MSG_ID_GATT_GET_GATT': 0x5001,
+    'MSG_ID_GATT_SET_CUSTOM': 0x5002,
+    'MSG_ID_HID_SEND_REPORT': 0x6000,
+    'MSG_ID_MIDI_WRITE': 0x7000,
+    'MSG_ID_MIDI_READ': 0x7001,
+    'MSG_ID_ANCS_READ': 0x8000,
+    'MSG_ID_ANCS_GET_NOTI': 0x8001,
+    'MSG_ID_OBSERVER_START': 0x9000,
+    'MSG_ID_OBSERVER_STOP': 0x9001,
+    'MSG_ID_OBSERVER_READ': 0x9002,
+    'MSG_ID_DB_LOOPBACK': 0xFE00,
+    'MSG_ID_DB_COUNTER': 0xFE01,
+    'MSG_ID_DB_E2E_LOOPBACK': 0xFE02,
+    'MSG_ID_DB_PTM': 0xFE03,
+}
+APP_MESSAGES_H = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), '..', 'hardware', 'bean',
+    'avr', 'cores', 'bean', 'applicationMessageHeaders', 'AppMessages.h')
+
+# The CC's structures as the AVR lays them out: packed, little endian
+BT_RADIOCONFIG = struct.Struct('<HHBBHHH20sB')
+BT_STATES = struct.Struct('<BB')
+ACC_READING = struct.Struct('<hhhB')
+LOOPBACK_BENCH = struct.Struct('<IIIIIIHHHH')
+PROFILE_SECTION = struct.Struct('<BIIHH')
+MEMORY_STATS = struct.Struct('<9H')
+PROFILE_SECTIONS = ['write_frame', 'hid_key', 'print_float']
+LATENCY_HISTOGRAM = struct.Struct('<BIHH12I')
+LATENCY_SITE = struct.Struct('<BBIHH')
+LATENCY_REPORTS = ['ISR entry', 'interrupts off']
+LATENCY_SITES = ['millis', 'request', 'sleep', 'SoftwareSerial', 'USART RX']
+ANCS_SOURCE = struct.Struct('<BBBBI')
+OBSERVER_INFO = struct.Struct('<BB6sbB')
+SCRATCH_BANKS = 5
+SCRATCH_LENGTH = 20
+ANCS_ATTRIBUTES = {0: b'com.apple.MobileSMS', 1: b'Benchmark'}
+
+
+def load_message_ids(path=APP_MESSAGES_H):
+    """Fills in module level MSG_ID_ names, preferring AppMessages.h."""
+    ids = dict(APP_MESSAGE_IDS)
+    try:
+        with open(path) as f:
+            text = f.read()
+        for name, value in re.findall(r'(MSG_ID_\w+)\s*=\s*(0x[0-9A-Fa-f]+)',
+                                      text):
+            ids[name] = int(value, 16)
+    except IOError:
+        pass
+    globals().update(ids)
+
+
+load_message_ids()
+
+
+def crc32(data):
+    return zlib.crc32(bytes(bytearray(data))) & 0xFFFFFFFF
+
+
+def build_frame(message_id, body):
+    """SOF, escaped (length, ID, body, CRC32 big endian), EOF."""
+    raw = bytearray([len(body) + 2, message_id >> 8, message_id & 0xFF])
+    raw.extend(bytearray(body))
+    raw.extend(struct.pack('>I', crc32(raw)))
+    frame = bytearray([SOF_BYTE])
+    for byte in raw:
+        if byte in (SOF_BYTE, EOF_BYTE, ESC_BYTE):
+            frame.extend([ESC_BYTE, byte ^ ESC_XOR])
+        else:
+            frame.append(byte)
+    frame.append(EOF_BYTE)
+    return bytes(frame)
+
+
+class FrameParser(object):
+    """Feed bytes in, get (message_id, body) out for frames with a good CRC."""
+
+    def __init__(self):
+        self.frame = None
+        self.escaping = False
+        self.crc_failures = 0
+
+    def feed(self, data):
+        frames = []
+        for byte in bytearray(data):
+            if byte == SOF_BYTE:
+                self.frame = bytearray()
+                self.escaping = False
+            elif self.frame is None:
+                continue
+            elif byte == EOF_BYTE:
+                frame = self._finish()
+                if frame:
+                    frames.append(frame)
+            elif byte == ESC_BYTE:
+                self.escaping = True
+            else:
+                if self.escaping:
+                    byte ^= ESC_XOR
+                    self.escaping = False
+                self.frame.append(byte)
+        return frames
+
+    def _finish(self):
+        raw, self.frame = self.frame, None
+        if len(raw) < 7 or raw[0] != len(raw) - 5:
+            self.crc_failures += 1
+            return None
+        if struct.unpack('>I', bytes(raw[-4:]))[0] != crc32(raw[:-4]):
+            self.crc_failures += 1
+            return None
+        return (raw[1] << 8) | raw[2], bytes(raw[3:-4])
+
+
+class Throughput(object):
+    def __init__(self, name):
+        self.name = name
+        self.bytes = 0
+        self.first = None
+        self.last = None
+
+    def add(self, count):
+        now = time.time()
+        if self.first is None:
+            self.first = now
+        self.last = now
+        self.bytes += count
+
+    def report(self):
+        if self.first is None:
+            return '%s: nothing received' % self.name
+        elapsed = max(self.last - self.first, 1e-6)
+        return '%s: %d bytes in %.3f s = %.0f bytes/s' % (
+            self.name, self.bytes, elapsed, self.bytes / elapsed)
+
+
+def corrupt(data, rate):
+    """Flips each bit of data with probability rate."""
+    if not rate:
+        return data
+    data = bytearray(data)
+    for i in range(len(data)):
+        for bit in range(8):
+            if random.random() < rate:
+                data[i] ^= 1 << bit
+    return bytes(data)
+
+
+class PtyPort(object):
+    """The master side of a pseudo-terminal, read and written like a serial
+    port. The slave's name is what the other end opens."""
+
+    paced = True
+    timeout = 0.01
+
+    def __init__(self, baudrate, link=None):
+        import tty
+        self.baudrate = baudrate
+        self.fd, self.slave = os.openpty()
+        tty.setraw(self.slave)
+        self.name = os.ttyname(self.slave)
+        if link:
+            if os.path.lexists(link):
+                os.remove(link)
+            os.symlink(self.name, link)
+            self.name = link
+
+    def read(self, size):
+        if not select.select([self.fd], [], [], self.timeout)[0]:
+            return b''
+        return os.read(self.fd, size)
+
+    def write(self, data):
+        os.write(self.fd, data)
+
+    def flush(self):
+        pass
+
+
+class SocketPort(object):
+    """A TCP port taking one connection at a time; a new connection is a new
+    Bean, so the link rate goes back to the default."""
+
+    paced = True
+    timeout = 0.01
+
+    def __init__(self, baudrate, port):
+        self.default_baudrate = self.baudrate = baudrate
+        self.server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.server.bind(('127.0.0.1', port))
+        self.server.listen(1)
+        self.name = 'tcp:127.0.0.1:%d' % port
+        self.client = None
+
+    def read(self, size):
+        ready = select.select([self.client or self.server], [], [],
+                              self.timeout)[0]
+        if not ready:
+            return b''
+        if self.client is None:
+            self.client = self.server.accept()[0]
+            self.client.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            self.baudrate = self.default_baudrate
+            logging.info('connected')
+            return b''
+        try:
+            data = self.client.recv(size)
+        except socket.error:
+            data = b''
+        if not data:
+            self.disconnect()
+        return data
+
+    def write(self, data):
+        if self.client is not None:
+            try:
+                self.client.sendall(data)
+            except socket.error:
+                self.disconnect()
+
+    def disconnect(self):
+        logging.info('disconnected')
+        self.client.close()
+        self.client = None
+
+    def flush(self):
+        pass
+
+
+class CCState(object):
+    """What the CC remembers: radio config, scratch banks, LED, sensors."""
+
+    def __init__(self, accel=(0, 0, 256), temperature=22, battery=90):
+        self.adv_int = 500
+        self.conn_int = 20
+        self.power = 3
+        self.adv_mode = 0
+        self.ibeacon_uuid = 0xA495
+        self.ibeacon_major = 0
+        self.ibeacon_minor = 0
+        self.local_name = b'Bean'
+        self.advertising = 1
+        self.connected = 1
+        self.scratch = [b''] * SCRATCH_BANKS
+        self.led = [0, 0, 0]
+        self.accel = list(accel)
+        self.accel_range = 2
+        self.accel_registers = bytearray(64)
+        self.temperature = temperature
+        self.battery = battery
+        self.services = 0x01  # standard advertising only
+        self.pairing_pin = None
+        self.wake_on_accel = 0
+        self.wake_on_connect = 0
+        self.custom_advert = b''
+
+    def radio_config(self):
+        return BT_RADIOCONFIG.pack(
+            self.adv_int, self.conn_int, self.power, self.adv_mode,
+            self.ibeacon_uuid, self.ibeacon_major, self.ibeacon_minor,
+            self.local_name, len(self.local_name))
+
+    def set_radio_config(self, body):
+        if len(body) < BT_RADIOCONFIG.size:
+            logging.warning('radio config of %d bytes, expected %d',
+                            len(body), BT_RADIOCONFIG.size)
+            return
+        (self.adv_int, self.conn_int, self.power, self.adv_mode,
+         self.ibeacon_uuid, self.ibeacon_major, self.ibeacon_minor, name,
+         length) = BT_RADIOCONFIG.unpack(body[:BT_RADIOCONFIG.size])
+        self.local_name = name[:min(length, SCRATCH_LENGTH)]
+
+    def states(self):
+        return BT_STATES.pack(self.advertising, self.connected)
+
+    def acceleration(self):
+        return ACC_READING.pack(self.accel[0], self.accel[1], self.accel[2],
+                                self.accel_range)
+
+
+class CCStandIn(object):
+    def __init__(self, port, drop_every=0, ack_delay=0.0, bit_error_rate=0.0,
+                 max_link_rate=0, state=None, latency=0.0, jitter=0.0,
+                 loss=0.0, wake_delay=0.0, idle_sleep=0.0):
+        self.port = port
+        self.state = state or CCState()
+        self.latency = latency
+        self.jitter = jitter
+        self.loss = loss
+        self.wake_delay = wake_delay
+        self.idle_sleep = idle_sleep
+        self.last_activity = 0.0
+        self.deaf_until = 0.0
+        self.outbox = []
+        self.timers = []
+        self.sequence = 0
+        self.wire = collections.deque()
+        self.wire_free = 0.0
+        self.frames_in = collections.Counter()
+        self.frames_out = collections.Counter()
+        self.lost_in = 0
+        self.lost_out = 0
+        self.missed_bytes = 0
+        self.wakes = 0
+        self.scanning = False
+        self.midi_echo = False
+        self.debug_counter = 0
+        self.max_link_rate = max_link_rate
+        self.default_link_rate = getattr(port, 'baudrate', 0)
+        self.confirm_deadline = None
+        self.bit_error_rate = bit_error_rate
+        self.parser = FrameParser()
+        self.handlers = {
+            MSG_ID_SERIAL_DATA: self.handle_serial_data,
+            MSG_ID_SERIAL_DATA_LZ: self.handle_serial_data,
+            MSG_ID_TELEMETRY: self.handle_telemetry,
+            MSG_ID_BULK_START: self.handle_bulk,
+            MSG_ID_BULK_DATA: self.handle_bulk,
+            MSG_ID_RELIABLE_DATA: self.handle_reliable,
+            MSG_ID_RELIABLE_RESET: self.handle_reliable_reset,
+            MSG_ID_CONTAINER: self.handle_container,
+            MSG_ID_LINK_RATE: self.handle_link_rate,
+            MSG_ID_LINK_RATE_CONFIRM: self.handle_link_rate_confirm,
+            MSG_ID_BT_GET_CONFIG: self.handle_get_config,
+            MSG_ID_BT_SET_CONFIG: self.handle_set_config,
+            MSG_ID_BT_SET_CONFIG_NOSAVE: self.handle_set_config,
+            MSG_ID_BT_SET_LOCAL_NAME: self.handle_set_local_name,
+            MSG_ID_BT_SET_ADV: self.handle_set_adv,
+            MSG_ID_BT_SET_CONN: self.handle_set_conn,
+            MSG_ID_BT_SET_TX_PWR: self.handle_set_tx_power,
+            MSG_ID_BT_SET_PIN: self.handle_set_pin,
+            MSG_ID_BT_ENABLE_PAIRING_PIN: self.handle_enable_pin,
+            MSG_ID_BT_ADV_ONOFF: self.handle_adv_onoff,
+            MSG_ID_BT_SET_SCRATCH: self.handle_set_scratch,
+            MSG_ID_BT_GET_SCRATCH: self.handle_get_scratch,
+            MSG_ID_BT_RESTART: self.handle_restart,
+            MSG_ID_BT_GET_STATES: self.handle_get_states,
+            MSG_ID_BT_DISCONNECT: self.handle_disconnect,
+            MSG_ID_CC_LED_WRITE: self.handle_led_write,
+            MSG_ID_CC_LED_WRITE_ALL: self.handle_led_write_all,
+            MSG_ID_CC_LED_READ_ALL: self.handle_led_read_all,
+            MSG_ID_CC_ACCEL_READ: self.handle_accel_read,
+            MSG_ID_CC_ACCEL_GET_RANGE: self.handle_accel_get_range,
+            MSG_ID_CC_ACCEL_SET_RANGE: self.handle_accel_set_range,
+            MSG_ID_CC_ACCEL_READ_REG: self.handle_accel_read_reg,
+            MSG_ID_CC_ACCEL_WRITE_REG: self.handle_accel_write_reg,
+            MSG_ID_CC_WAKE_ON_ACCEL: self.handle_wake_on_accel,
+            MSG_ID_CC_TEMP_READ: self.handle_temperature,
+            MSG_ID_CC_BATT_READ: self.handle_battery,
+            MSG_ID_AR_SLEEP: self.handle_sleep,
+            MSG_ID_AR_WAKE_ON_CONNECT: self.handle_wake_on_connect,
+            MSG_ID_GATT_SET_GATT: self.handle_set_gatt,
+            MSG_ID_GATT_GET_GATT: self.handle_get_gatt,
+            MSG_ID_GATT_SET_CUSTOM: self.handle_set_custom,
+            MSG_ID_HID_SEND_REPORT: self.handle_counted,
+            MSG_ID_MIDI_WRITE: self.handle_midi_write,
+            MSG_ID_ANCS_GET_NOTI: self.handle_ancs_get_noti,
+            MSG_ID_OBSERVER_START: self.handle_observer_start,
+            MSG_ID_OBSERVER_STOP: self.handle_observer_stop,
+            MSG_ID_DB_LOOPBACK: self.handle_echo,
+            MSG_ID_DB_E2E_LOOPBACK: self.handle_echo,
+            MSG_ID_DB_COUNTER: self.handle_debug_counter,
+            MSG_ID_DB_PTM: self.handle_counted,
+            MSG_ID_DB_LOOPBACK_BENCH: self.handle_loopback_bench,
+            MSG_ID_DB_POWER_STATS: self.handle_power_stats,
+            MSG_ID_DB_PROFILE: self.handle_profile,
+            MSG_ID_DB_TRACE: self.handle_trace,
+            MSG_ID_DB_MEMORY_STATS: self.handle_memory_stats,
+            MSG_ID_DB_LATENCY: self.handle_latency,
+        }
+        self.drop_every = drop_every
+        self.ack_delay = ack_delay
+        self.received = 0
+        self.serial = Throughput('serial data')
+        self.serial_wire = Throughput('serial frame bodies')
+        self.decoder = LZDecoder()
+        self.telemetry = TelemetryDecoder()
+        self.trace = TraceDecoder()
+        self.telemetry_bytes = Throughput('telemetry frame bodies')
+        self.bulk = None
+        self.bulk_expected = 0
+        self.bulk_length = 0
+        self.reliable_expected = None
+        self.reliable_held = {}
+        self.reliable_duplicates = 0
+
+    def send_message(self, message_id, body=b'', after=None):
+        """Queues a frame for --latency from now; after() runs once it has
+        been written."""
+        delay = self.latency
+        if self.jitter:
+            delay += random.uniform(0, self.jitter)
+        self.schedule_frame(time.time() + delay, message_id, body, after)
+
+    def schedule_frame(self, due, message_id, body, after=None):
+        self.sequence += 1
+        heapq.heappush(self.outbox, (due, self.sequence, message_id,
+                                     bytes(body), after))
+
+    def schedule(self, delay, action):
+        """Runs action() delay seconds from now."""
+        self.sequence += 1
+        heapq.heappush(self.timers, (time.time() + delay, self.sequence,
+                                     action))
+
+    def flush_outbox(self, now):
+        # A virtual port has no wire to take time over frames, so each is
+        # held back until it would have finished arriving
+        paced = getattr(self.port, 'paced', False) and self.port.baudrate
+        while self.outbox and self.outbox[0][0] <= now:
+            _, _, message_id, body, after = heapq.heappop(self.outbox)
+            frame = build_frame(message_id, body)
+            if self.loss and random.random() < self.loss:
+                self.lost_out += 1
+                frame = None
+            elif paced:
+                self.wire_free = (max(now, self.wire_free) +
+                                  len(frame) * 10.0 / self.port.baudrate)
+            self.wire.append((self.wire_free if paced else now, message_id,
+                              frame, after))
+        while self.wire and self.wire[0][0] <= now:
+            _, message_id, frame, after = self.wire.popleft()
+            if frame:
+                self.port.write(corrupt(frame, self.bit_error_rate))
+                self.frames_out[message_id] += 1
+            if after:
+                after()
+
+    def run_timers(self, now):
+        while self.timers and self.timers[0][0] <= now:
+            heapq.heappop(self.timers)[2]()
+
+    def dispatch(self, message_id, body):
+        handler = self.handlers.get(message_id)
+        if handler:
+            handler(message_id, body)
+        else:
+            logging.debug('unhandled frame 0x%04X', message_id)
+
+    def reply(self, message_id, body=b''):
+        """Replies go back under the request's ID; the core takes the first
+        unrouted frame after a request as its reply."""
+        self.send_message(message_id, body)
+
+    def handle_counted(self, message_id, body):
+        pass
+
+    def handle_echo(self, message_id, body):
+        self.reply(message_id, body)
+
+    def handle_loopback_bench(self, message_id, body):
+        if len(body) < LOOPBACK_BENCH.size:
+            return
+        (min_us, median_us, p99_us, max_us, elapsed_us, bytes_per_s,
+         frames_per_s, iterations, failures, size) = LOOPBACK_BENCH.unpack(
+             body[:LOOPBACK_BENCH.size])
+        print('loopback %2d B x %d: %d failed, min %d us, median %d us, '
+              'p99 %d us, max %d us, %d frames/s, %d bytes/s' % (
+                  size, iterations, failures, min_us, median_us, p99_us,
+                  max_us, frames_per_s, bytes_per_s))
+        sys.stdout.flush()
+
+    def handle_power_stats(self, message_id, body):
+        print('power stats %s' % binascii.hexlify(bytes(body)).decode())
+        sys.stdout.flush()
+
+    def handle_memory_stats(self, message_id, body):
+        if len(body) < MEMORY_STATS.size:
+            return
+        (stack_free, stack_headroom, heap_size, heap_peak, heap_in_use,
+         heap_free, free_chunks, largest_free,
+         malloc_failures) = MEMORY_STATS.unpack(body[:MEMORY_STATS.size])
+        print('memory: stack %d B free, %d B at worst; heap %d B (peak %d), '
+              '%d B in use, %d B free in %d chunks (largest %d), '
+              '%d failed allocations' % (
+                  stack_free, stack_headroom, heap_size, heap_peak,
+                  heap_in_use, heap_free, free_chunks, largest_free,
+                  malloc_failures))
+        sys.stdout.flush()
+
+    def trace_every(self, interval):
+        def ask():
+            self.send_message(MSG_ID_DB_TRACE)
+            self.schedule(interval, ask)
+        self.schedule(interval, ask)
+
+    def handle_trace(self, message_id, body):
+        records = self.trace.feed(body)
+        if records is None:
+            return
+        names = dict((value, name) for name, value in globals().items()
+                     if name.startswith('MSG_ID_'))
+        print('trace of %d events' % len(records))
+        for line in render_trace(records, names):
+            print(line)
+        sys.stdout.flush()
+
+    def handle_profile(self, message_id, body):
+        if len(body) < PROFILE_SECTION.size:
+            print('profile: built without BEAN_PROFILE')
+            sys.stdout.flush()
+            return
+        section, total, count, min_cycles, max_cycles = PROFILE_SECTION.unpack(
+            body[:PROFILE_SECTION.size])
+        if section < len(PROFILE_SECTIONS):
+            name = PROFILE_SECTIONS[section]
+        else:
+            name = 'user %d' % (section - len(PROFILE_SECTIONS))
+        print('profile %-12s x %d: min %d, mean %d, max %d cycles' % (
+            name, count, min_cycles, total // count, max_cycles))
+        sys.stdout.flush()
+
+    def handle_latency(self, message_id, body):
+        body = bytes(body)
+        if not body:
+            print('latency: built without BEAN_LATENCY')
+        elif bytearray(body)[0] < len(LATENCY_REPORTS):
+            if len(body) < LATENCY_HISTOGRAM.size:
+                return
+            fields = LATENCY_HISTOGRAM.unpack(body[:LATENCY_HISTOGRAM.size])
+            report, count, min_cycles, max_cycles = fields[:4]
+            bins = fields[4:]
+            if not count:
+                print('latency %-14s nothing yet' % LATENCY_REPORTS[report])
+                sys.stdout.flush()
+                return
+            # Bin n counts under 16 << n cycles; the last, the rest
+            counts = ['<%d:%d' % (16 << n, c)
+                      for n, c in enumerate(bins[:-1]) if c]
+            if bins[-1]:
+                counts.append('>=%d:%d' % (16 << (len(bins) - 2), bins[-1]))
+            print('latency %-14s x %d: min %d, max %d cycles; %s' % (
+                LATENCY_REPORTS[report], count, min_cycles, max_cycles,
+                ' '.join(counts)))
+        else:
+            if len(body) < LATENCY_SITE.size:
+                return
+            _, site, count, min_cycles, max_cycles = LATENCY_SITE.unpack(
+                body[:LATENCY_SITE.size])
+            if site < len(LATENCY_SITES):
+                name = LATENCY_SITES[site]
+            else:
+                name = 'user %d' % (site - len(LATENCY_SITES))
+            print('latency %-14s x %d: min %d, max %d cycles off' % (
+                name, count, min_cycles, max_cycles))
+        sys.stdout.flush()
+
+    def handle_debug_counter(self, message_id, body):
+        self.debug_counter = (self.debug_counter + 1) & 0x7FFF
+        self.reply(message_id, struct.pack('<h', self.debug_counter))
+
+    # Radio
+
+    def handle_get_config(self, message_id, body):
+        self.reply(message_id, self.state.radio_config())
+
+    def handle_set_config(self, message_id, body):
+        self.state.set_radio_config(body)
+
+    def handle_set_local_name(self, message_id, body):
+        self.state.local_name = bytes(body[:SCRATCH_LENGTH])
+
+    def handle_set_adv(self, message_id, body):
+        if len(body) >= 2:
+            self.state.adv_int = struct.unpack('<H', body[:2])[0]
+
+    def handle_set_conn(self, message_id, body):
+        if len(body) >= 2:
+            self.state.conn_int = struct.unpack('<H', body[:2])[0]
+
+    def handle_set_tx_power(self, message_id, body):
+        if body:
+            self.state.power = bytearray(body)[0]
+
+    def handle_set_pin(self, message_id, body):
+        if len(body) >= 5:
+            pin, enable = struct.unpack('<IB', body[:5])
+            self.state.pairing_pin = pin if enable else None
+
+    def handle_enable_pin(self, message_id, body):
+        if body and not bytearray(body)[0]:
+            self.state.pairing_pin = None
+
+    def handle_adv_onoff(self, message_id, body):
+        if len(body) >= 5:
+            timer, on = struct.unpack('<IB', body[:5])
+            self.set_states(advertising=on)
+            if on and timer:
+                self.schedule(timer / 1000.0,
+                              lambda: self.set_states(advertising=0))
+
+    def handle_set_scratch(self, message_id, body):
+        body = bytes(body)
+        bank = bytearray(body)[0] if body else 0
+        if 1 <= bank <= SCRATCH_BANKS:
+            self.state.scratch[bank - 1] = body[1:1 + SCRATCH_LENGTH]
+
+    def handle_get_scratch(self, message_id, body):
+        bank = bytearray(body)[0] if body else 0
+        data = b''
+        if 1 <= bank <= SCRATCH_BANKS:
+            data = self.state.scratch[bank - 1]
+        self.reply(message_id, bytearray([bank]) + bytearray(data))
+
+    def handle_restart(self, message_id, body):
+        logging.info('radio restart')
+        self.scanning = False
+        self.set_states(connected=0)
+        self.schedule(1.0, lambda: self.set_states(advertising=1,
+                                                   connected=1))
+
+    def handle_get_states(self, message_id, body):
+        self.reply(MSG_ID_BT_GET_STATES, self.state.states())
+
+    def handle_disconnect(self, message_id, body):
+        self.set_states(connected=0, advertising=1)
+
+    def set_states(self, advertising=None, connected=None):
+        """Changes the BT states and pushes them, as the CC does."""
+        if advertising is not None:
+            self.state.advertising = advertising
+        if connected is not None:
+            self.state.connected = connected
+        logging.debug('advertising %d, connected %d', self.state.advertising,
+                      self.state.connected)
+        self.send_message(MSG_ID_BT_GET_STATES, self.state.states())
+
+    def disconnect_every(self, interval, downtime=1.0):
+        def drop():
+            self.set_states(connected=0)
+            self.schedule(downtime, lambda: self.set_states(connected=1))
+            self.schedule(interval, drop)
+        self.schedule(interval, drop)
+
+    # LED and sensors
+
+    def handle_led_write(self, message_id, body):
+        # LED_IND_SETTING_T: the colour, then the intensity
+        body = bytearray(body)
+        if len(body) >= 2 and body[0] < 3:
+            self.state.led[body[0]] = body[-1]
+
+    def handle_led_write_all(self, message_id, body):
+        if len(body) >= 3:
+            self.state.led = list(bytearray(body)[:3])
+
+    def handle_led_read_all(self, message_id, body):
+        self.reply(message_id, bytearray(self.state.led))
+
+    def handle_accel_read(self, message_id, body):
+        self.reply(message_id, self.state.acceleration())
+
+    def handle_accel_get_range(self, message_id, body):
+        self.reply(message_id, bytearray([self.state.accel_range]))
+
+    def handle_accel_set_range(self, message_id, body):
+        if body:
+            self.state.accel_range = bytearray(body)[0]
+
+    def handle_accel_read_reg(self, message_id, body):
+        reg, length = bytearray(body[:2]) if len(body) >= 2 else (0, 1)
+        registers = self.state.accel_registers
+        self.reply(message_id, registers[reg:reg + max(length, 1)])
+
+    def handle_accel_write_reg(self, message_id, body):
+        if len(body) >= 2:
+            reg, value = bytearray(body[:2])
+            if reg < len(self.state.accel_registers):
+                self.state.accel_registers[reg] = value
+
+    def handle_wake_on_accel(self, message_id, body):
+        if body:
+            self.state.wake_on_accel = bytearray(body)[0]
+
+    def handle_temperature(self, message_id, body):
+        self.reply(message_id, struct.pack('<b', self.state.temperature))
+
+    def handle_battery(self, message_id, body):
+        self.reply(message_id, bytearray([self.state.battery]))
+
+    # Sleep and services
+
+    def handle_sleep(self, message_id, body):
+        duration = struct.unpack('<I', body[:4])[0] if len(body) >= 4 else 0
+        logging.debug('AVR asleep for %d ms', duration)
+
+    def handle_wake_on_connect(self, message_id, body):
+        if body:
+            self.state.wake_on_connect = bytearray(body)[0]
+
+    def handle_set_gatt(self, message_id, body):
+        if body:
+            self.state.services = bytearray(body)[0]
+
+    def handle_get_gatt(self, message_id, body):
+        self.reply(message_id, bytearray([self.state.services]))
+
+    def handle_set_custom(self, message_id, body):
+        body = bytearray(body)
+        if body:
+            self.state.custom_advert = bytes(body[1:1 + body[0]])
+
+    # MIDI, ANCS and the observer
+
+    def handle_midi_write(self, message_id, body):
+        if self.midi_echo:
+            self.send_message(MSG_ID_MIDI_READ, body)
+
+    def handle_ancs_get_noti(self, message_id, body):
+        body = bytearray(body)
+        if len(body) < 8 or body[0] != 0:
+            return  # a notification action, nothing to answer
+        uid, attribute, length = struct.unpack('<IBH', bytes(body[1:8]))
+        data = ANCS_ATTRIBUTES.get(attribute, b'')[:length]
+        reply = bytes(body[:6]) + struct.pack('<H', len(data)) + data
+        # Long attributes arrive as several frames, as they do from the CC
+        for i in range(0, len(reply), MAX_BODY_LENGTH):
+            self.send_message(MSG_ID_ANCS_GET_NOTI,
+                              reply[i:i + MAX_BODY_LENGTH])
+
+    def ancs_every(self, interval):
+        uids = [0]
+
+        def notify():
+            uids[0] += 1
+            # EventIDNotificationAdded, category Social, one of them
+            self.send_message(MSG_ID_ANCS_READ,
+                              ANCS_SOURCE.pack(0, 0, 4, 1, uids[0]))
+            self.schedule(interval, notify)
+        self.schedule(interval, notify)
+
+    def handle_observer_start(self, message_id, body):
+        self.scanning = True
+
+    def handle_observer_stop(self, message_id, body):
+        self.scanning = False
+
+    def advertise_every(self, interval):
+        def advert():
+            if self.scanning:
+                address = bytes(bytearray(random.randrange(256)
+                                          for _ in range(6)))
+                name = b'Bean%02d' % random.randrange(100)
+                data = (bytearray([2, 0x01, 0x06, len(name) + 1, 0x09]) +
+                        bytearray(name))
+                self.send_message(MSG_ID_OBSERVER_READ, OBSERVER_INFO.pack(
+                    0, 0, address, -random.randrange(40, 90), len(data)) +
+                    bytes(data))
+            self.schedule(interval, advert)
+        self.schedule(interval, advert)
+
+    def handle_container(self, message_id, body):
+        # [ID hi][ID lo][length][body] per message
+        i = 0
+        while i + 3 <= len(body):
+            inner_id, length = struct.unpack('>HB', body[i:i + 3])
+            self.dispatch(inner_id, body[i + 3:i + 3 + length])
+            i += 3 + length
+
+    def handle_link_rate(self, message_id, body):
+        offers = struct.unpack('>%dI' % (len(body) // 4), body[:len(body) & ~3])
+        picked = [rate for rate in offers
+                  if rate <= self.max_link_rate or
+                  rate == self.default_link_rate]
+        if not picked:
+            self.send_message(MSG_ID_LINK_RATE)
+            return
+        self.send_message(MSG_ID_LINK_RATE, struct.pack('>I', picked[0]),
+                          after=lambda: self.set_link_rate(picked[0]))
+
+    def set_link_rate(self, rate):
+        self.port.flush()
+        self.port.baudrate = rate
+        self.confirm_deadline = time.time() + LINK_RATE_CONFIRM_WINDOW
+        logging.info('link rate %d', rate)
+
+    def handle_link_rate_confirm(self, message_id, body):
+        self.confirm_deadline = None
+        self.send_message(MSG_ID_LINK_RATE_CONFIRM, body)
+
+    def handle_reliable_reset(self, message_id, body):
+        self.reliable_expected = 0
+        self.reliable_held = {}
+
+    def handle_reliable(self, message_id, body):
+        seq, base, inner_id = struct.unpack('>BBH', body[:4])
+        if self.reliable_expected is None:
+            self.reliable_expected = base
+        # The sender has given up on anything before base
+        if 0 < (base - self.reliable_expected) & 0xFF < 128:
+            self.reliable_expected = base
+
+        ahead = (seq - self.reliable_expected) & 0xFF
+        if ahead <= 8 and seq not in self.reliable_held:
+            self.reliable_held[seq] = (inner_id, body[4:])
+        else:
+            self.reliable_duplicates += 1
+        while self.reliable_expected in self.reliable_held:
+            self.dispatch(*self.reliable_held.pop(self.reliable_expected))
+            self.reliable_expected = (self.reliable_expected + 1) & 0xFF
+
+        selective = 0
+        for held in self.reliable_held:
+            bit = (held - self.reliable_expected - 1) & 0xFF
+            if bit < 8:
+                selective |= 1 << bit
+        self.send_message(MSG_ID_RELIABLE_ACK,
+                          bytearray([self.reliable_expected, selective]))
+
+    def handle_serial_data(self, message_id, body):
+        self.serial_wire.add(len(body))
+        if message_id == MSG_ID_SERIAL_DATA_LZ:
+            body = self.decoder.feed_lz(body)
+        else:
+            body = self.decoder.feed_raw(body)
+        self.serial.add(len(body))
+        sys.stdout.write(body.decode('latin-1'))
+        sys.stdout.flush()
+
+    def handle_telemetry(self, message_id, body):
+        self.telemetry_bytes.add(len(body))
+        decoded = self.telemetry.feed(body)
+        if decoded:
+            schema_id, record = decoded
+            fields = self.telemetry.schemas[schema_id].fields
+            print('%d: %s' % (schema_id, ', '.join(
+                '%s=%s' % (name, record[name]) for name, _, _ in fields)))
+        else:
+            logging.debug('telemetry record not decoded: %r', body)
+
+    def handle_bulk(self, message_id, body):
+        seq = bytearray(body)[0]
+        if seq == self.bulk_expected:
+            if message_id == MSG_ID_BULK_START:
+                self.bulk_length = struct.unpack('<I', body[1:5])[0]
+                self.bulk = Throughput('bulk')
+            elif self.bulk is not None:
+                self.bulk.add(len(body) - 1)
+            self.bulk_expected = (self.bulk_expected + 1) & 0xFF
+        if self.ack_delay:
+            time.sleep(self.ack_delay)
+        self.send_message(MSG_ID_BULK_ACK, bytearray([self.bulk_expected]))
+        if self.bulk is not None and self.bulk.bytes == self.bulk_length:
+            logging.info(self.bulk.report())
+            self.bulk = None
+            self.bulk_expected = 0
+
+    def receive(self, data, now):
+        """Drops what a CC still waking up would miss."""
+        if not data or not self.wake_delay:
+            return data
+        if self.idle_sleep and now - self.last_activity > self.idle_sleep:
+            self.wakes += 1
+            self.deaf_until = now + self.wake_delay
+        self.last_activity = now
+        if now < self.deaf_until:
+            self.missed_bytes += len(data)
+            return b''
+        return data
+
+    def run(self):
+        while True:
+            now = time.time()
+            if self.confirm_deadline and now > self.confirm_deadline:
+                logging.info('link rate not confirmed, back to %d',
+                             self.default_link_rate)
+                self.port.baudrate = self.default_link_rate
+                self.confirm_deadline = None
+            self.run_timers(now)
+            self.flush_outbox(now)
+
+            wait = 0.01
+            if self.outbox:
+                wait = min(wait, self.outbox[0][0] - now)
+            if self.wire:
+                wait = min(wait, self.wire[0][0] - now)
+            if self.timers:
+                wait = min(wait, self.timers[0][0] - now)
+            self.port.timeout = max(wait, 0)
+            data = corrupt(self.port.read(256), self.bit_error_rate)
+            data = self.receive(data, time.time())
+
+            for message_id, body in self.parser.feed(data):
+                self.received += 1
+                self.frames_in[message_id] += 1
+                if self.drop_every and self.received % self.drop_every == 0:
+                    logging.debug('dropping frame 0x%04X', message_id)
+                    continue
+                if self.loss and random.random() < self.loss:
+                    self.lost_in += 1
+                    continue
+                self.dispatch(message_id, body)
+
+    def report(self):
+        logging.info(self.serial.report())
+        if self.serial_wire.bytes:
+            logging.info('compression ratio %.2f', float(
+                self.serial.bytes) / self.serial_wire.bytes)
+        if self.telemetry_bytes.bytes:
+            logging.info(self.telemetry_bytes.report())
+            logging.info('telemetry records lost: %d', self.telemetry.lost)
+        logging.info('CRC failures: %d', self.parser.crc_failures)
+        if self.reliable_expected is not None:
+            logging.info('reliable duplicates: %d', self.reliable_duplicates)
+        if self.loss:
+            logging.info('frames lost: %d in, %d out', self.lost_in,
+                         self.lost_out)
+        if self.wake_delay:
+            logging.info('wakes: %d, bytes missed waking: %d', self.wakes,
+                         self.missed_bytes)
+        names = dict((value, name) for name, value in globals().items()
+                     if name.startswith('MSG_ID_'))
+        for message_id in sorted(set(self.frames_in) | set(self.frames_out)):
+            logging.info('%-30s %6d in %6d out',
+                         names.get(message_id, '0x%04X' % message_id),
+                         self.frames_in[message_id],
+                         self.frames_out[message_id])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('port', nargs='?',
+                        help='serial port wired to the ATmega UART')
+    parser.add_argument('--pty', nargs='?', const='', metavar='LINK',
+                        help='open a pseudo-terminal instead, and symlink '
+                             'LINK to it')
+    parser.add_argument('--tcp', type=int, metavar='PORT',
+                        help='listen on 127.0.0.1:PORT instead')
+    parser.add_argument('--baud', type=int, default=38400)
+    parser.add_argument('--drop-every', type=int, default=0,
+                        help='ignore every Nth received frame')
+    parser.add_argument('--ack-delay', type=float, default=0.0,
+                        help='seconds to wait before each bulk ack')
+    parser.add_argument('--corrupt', type=float, default=0.0, metavar='RATE',
+                        help='bit error rate applied both ways, e.g. 1e-4')
+    parser.add_argument('--schema', action='append', default=[],
+                        metavar='ID=FIELDS', type=Schema.parse,
+                        help='telemetry schema, e.g. 1=time:delta:u32,'
+                             'moving:flag')
+    parser.add_argument('--max-link-rate', type=int, default=0,
+                        help='fastest rate to accept in a link rate '
+                             'negotiation, e.g. 250000')
+    parser.add_argument('--latency', type=float, default=0.0,
+                        help='seconds before each frame the CC sends')
+    parser.add_argument('--jitter', type=float, default=0.0,
+                        help='up to this many seconds more, at random')
+    parser.add_argument('--loss', type=float, default=0.0, metavar='P',
+                        help='drop each frame, either way, with probability P')
+    parser.add_argument('--wake-delay', type=float, default=0.0,
+                        help='seconds the CC takes to wake, missing what '
+                             'arrives meanwhile')
+    parser.add_argument('--no-pace', action='store_true',
+                        help="don't hold frames back for the link rate on "
+                             'a PTY or socket')
+    parser.add_argument('--idle-sleep', type=float, default=0.05,
+                        help='seconds of quiet after which the CC sleeps')
+    parser.add_argument('--accel', default='0,0,256', metavar='X,Y,Z',
+                        help='accelerometer reading, in counts')
+    parser.add_argument('--temperature', type=int, default=22)
+    parser.add_argument('--battery', type=int, default=90)
+    parser.add_argument('--disconnect-every', type=float, default=0.0,
+                        metavar='SECONDS')
+    parser.add_argument('--advert-interval', type=float, default=0.1,
+                        metavar='SECONDS')
+    parser.add_argument('--ancs-interval', type=float, default=0.0,
+                        metavar='SECONDS')
+    parser.add_argument('--midi-echo', action='store_true')
+    parser.add_argument('--trace-every', type=float, default=0.0,
+                        metavar='SECONDS',
+                        help='ask a BEAN_TRACE build for its event trace')
+    parser.add_argument('--seed', type=int,
+                        help='seed for loss, corruption and adverts')
+    parser.add_argument('-v', '--verbose', action='store_true')
+    args = parser.parse_args()
+    if (args.port is None) == (args.pty is None and args.tcp is None):
+        parser.error('give one of a serial port, --pty or --tcp')
+
+    logging.basicConfig(stream=sys.stderr,
+                        level=logging.DEBUG if args.verbose else logging.INFO)
+    random.seed(args.seed)
+
+    if args.pty is not None:
+        port = PtyPort(args.baud, args.pty)
+    elif args.tcp is not None:
+        port = SocketPort(args.baud, args.tcp)
+    else:
+        import serial  # requires pip install pyserial
+        port = serial.Serial(args.port, args.baud, timeout=0.01)
+    if args.no_pace:
+        port.paced = False
+    logging.info('listening on %s', getattr(port, 'name', args.port))
+
+    state = CCState([int(v) for v in args.accel.split(',')],
+                    args.temperature, args.battery)
+    stand_in = CCStandIn(port, args.drop_every, args.ack_delay, args.corrupt,
+                         args.max_link_rate, state, args.latency, args.jitter,
+                         args.loss, args.wake_delay, args.idle_sleep)
+    stand_in.midi_echo = args.midi_echo
+    for schema in args.schema:
+        stand_in.telemetry.add_schema(schema)
+    if args.disconnect_every:
+        stand_in.disconnect_every(args.disconnect_every)
+    if args.advert_interval:
+        stand_in.advertise_every(args.advert_interval)
+    if args.ancs_interval:
+        stand_in.ancs_every(args.ancs_interval)
+    if args.trace_every:
+        stand_in.trace_every(args.trace_every)
+    # Scripts running benchmarks stop the stand-in with SIGTERM
+    signal.signal(signal.SIGTERM, lambda signum, frame: sys.exit(0))
+    try:
+        stand_in.run()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stand_in.report()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,225 @@
+#!/usr/bin/env python
+"""Host side of the core's compressed virtual serial data.
+
+LZDecoder turns MSG_ID_SERIAL_DATA and MSG_ID_SERIAL_DATA_LZ frame bodies back
+into the serial stream; both kinds of frame have to be fed to it in order,
+since raw frames extend the window too. LZEncoder mirrors BeanCompression.cpp
+byte for byte, so compression ratios can be measured without a board:
+
+    ./BeanCompression.py sensor_log.csv
+    ./BeanCompression.py            # synthetic sensor log
+"""
+from __future__ import print_function
+
+import argparse
+import random
+
+WINDOW_SIZE = 128
+MIN_MATCH = 3
+MAX_MATCH = 255
+FLAG_RESET = 0x01
+MAX_BODY_LENGTH = 64
+HASH_SIZE = 16
+HASH_WAYS = 4
+RESET_FRAMES = 16
+
+# Bytes a frame costs on the wire besides its body: SOF, length, ID, CRC, EOF.
+# Escapes are not counted.
+FRAME_OVERHEAD = 9
+
+
+class LZDecoder(object):
+    def __init__(self):
+        self.window = bytearray()
+
+    def _extend(self, data):
+        self.window.extend(data)
+        del self.window[:-WINDOW_SIZE]
+
+    def feed_raw(self, body):
+        self._extend(bytearray(body))
+        return bytes(body)
+
+    def feed_lz(self, body):
+        body = bytearray(body)
+        if body[0] & FLAG_RESET:
+            self.window = bytearray()
+        out = bytearray()
+        history = self.window
+        i = 1
+        while i < len(body):
+            control = body[i]
+            i += 1
+            for bit in range(8):
+                if i >= len(body):
+                    break
+                if control & (1 << bit):
+                    distance = body[i] + 1
+                    length = body[i + 1] + MIN_MATCH
+                    i += 2
+                    for _ in range(length):
+                        seen = history + out
+                        out.append(seen[len(seen) - distance])
+                else:
+                    out.append(body[i])
+                    i += 1
+        self._extend(out)
+        return bytes(out)
+
+
+def lz_hash(a, b, c):
+    return (a + (a >> 2) + (b << 3) + (c << 1) + (c >> 4)) & (HASH_SIZE - 1)
+
+
+class LZEncoder(object):
+    """Produces the same frames as BeanSerialTransport::writeCompressed().
+
+    reliable is whether the core is in reliable mode, where the window is
+    only reset once.
+    """
+
+    def __init__(self, reliable=False):
+        self.window = bytearray()
+        self.reset = True
+        self.reliable = reliable
+        self.frames = 0
+        self.count = 0
+        self.hash = [[0] * HASH_WAYS for _ in range(HASH_SIZE)]
+
+    def _append(self, c):
+        self.window.append(c)
+        del self.window[:-WINDOW_SIZE]
+        self.count = (self.count + 1) & 0xFF
+        if len(self.window) >= MIN_MATCH:
+            bucket = self.hash[lz_hash(*self.window[-3:])]
+            bucket.insert(0, (self.count - MIN_MATCH) & 0xFF)
+            bucket.pop()
+
+    def _compress(self, data):
+        out = bytearray([FLAG_RESET if self.reset else 0])
+        i = 0
+        control = 0
+        bit = 8
+        while i < len(data):
+            if bit == 8:
+                if len(out) + 3 > MAX_BODY_LENGTH:
+                    break
+                control = len(out)
+                out.append(0)
+                bit = 0
+            elif len(out) + 2 > MAX_BODY_LENGTH:
+                break
+
+            max_length = min(len(data) - i, MAX_MATCH)
+            best_length = best_distance = 0
+            if max_length >= MIN_MATCH:
+                for start in self.hash[lz_hash(*data[i:i + 3])]:
+                    distance = (self.count - start) & 0xFF
+                    if not 1 <= distance <= len(self.window):
+                        continue
+                    n = 0
+                    while n < max_length:
+                        if n < distance:
+                            c = self.window[len(self.window) - distance + n]
+                        else:
+                            c = data[i + n - distance]
+                        if c != data[i + n]:
+                            break
+                        n += 1
+                    if n > best_length:
+                        best_length, best_distance = n, distance
+                        if n == max_length:
+                            break
+
+            if best_length >= MIN_MATCH:
+                out[control] |= 1 << bit
+                out.extend([best_distance - 1, best_length - MIN_MATCH])
+            else:
+                best_length = 1
+                out.append(data[i])
+            for c in data[i:i + best_length]:
+                self._append(c)
+            i += best_length
+            bit += 1
+        return i, bytes(out)
+
+    def write(self, data):
+        """Returns [(compressed, body)] for one Serial.write() call."""
+        data = bytearray(data)
+        frames = []
+        while data:
+            if self.frames >= RESET_FRAMES and not self.reliable:
+                self.window = bytearray()
+                self.reset = True
+            if self.reset:
+                self.frames = 0
+            consumed, body = self._compress(data)
+            if len(body) < consumed or self.reset:
+                frames.append((True, body))
+                self.reset = False
+            else:
+                frames.append((False, bytes(data[:consumed])))
+            self.frames = min(self.frames + 1, RESET_FRAMES)
+            data = data[consumed:]
+        return frames
+
+
+def sensor_log(lines, seed=1):
+    """CSV lines like a logging sketch prints: time, temperature, x, y, z."""
+    rng = random.Random(seed)
+    temperature = 23
+    axes = [0, 0, 256]
+    for n in range(lines):
+        temperature += rng.choice((-1, 0, 0, 0, 0, 1))
+        axes = [a + rng.randint(-3, 3) for a in axes]
+        yield '%d,%d,%d,%d,%d\r\n' % (
+            n * 250, temperature, axes[0], axes[1], axes[2])
+
+
+def report(writes):
+    encoder = LZEncoder()
+    decoder = LZDecoder()
+    plain = body_lz = wire_raw = wire_lz = frames_lz = 0
+    for data in writes:
+        plain += len(data)
+        wire_raw += len(data) + FRAME_OVERHEAD * (
+            (len(data) + MAX_BODY_LENGTH - 1) // MAX_BODY_LENGTH)
+        decoded = bytearray()
+        for compressed, body in encoder.write(data):
+            body_lz += len(body)
+            wire_lz += len(body) + FRAME_OVERHEAD
+            if compressed:
+                frames_lz += 1
+                decoded.extend(decoder.feed_lz(body))
+            else:
+                decoded.extend(decoder.feed_raw(body))
+        assert bytes(decoded) == bytes(data), 'round trip failed'
+    print('%d bytes of serial data, %d LZ frames' % (plain, frames_lz))
+    print('wire bytes raw: %d, compressed: %d' % (wire_raw, wire_lz))
+    print('compression ratio %.2f, throughput gain %.2fx' % (
+        float(plain) / max(body_lz, 1),
+        float(wire_raw) / max(wire_lz, 1)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('log', nargs='?', help='text file, one write per line')
+    parser.add_argument('--lines', type=int, default=200)
+    parser.add_argument('--dump', type=int, default=0, metavar='BYTES',
+                        help='regroup the log into writes of this size, '
+                             'as a sketch dumping stored records would')
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, 'rb') as f:
+            writes = f.readlines()
+    else:
+        writes = [line.encode('ascii') for line in sensor_log(args.lines)]
+    if args.dump:
+        log = b''.join(writes)
+        writes = [log[i:i + args.dump] for i in range(0, len(log), args.dump)]
+    report(writes)
+
+
+if __name__ == '__main__':
+    main()
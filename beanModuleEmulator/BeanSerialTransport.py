@@ -3,6 +3,7 @@ import serial # requires pip install
 from serial.tools import list_ports 
 import logging
 import sys
+import zlib
 from enum import Enum  # requires pip install
 
 
@@ -13,6 +14,8 @@ class Bean_Serial_Transport:
     ESC_SOF_BYTE = 0x5E
     ESC_EOF_BYTE = 0x5F
     ESC_ESC_BYTE = 0x5D
+    ESC_XOR = 0x20
+    CRC_LENGTH = 4
 
     MSG_ID_SERIAL_DATA        = 0x00, 0x00
     MSG_ID_BT_SET_ADV         = 0x05, 0x00
@@ -43,6 +46,7 @@ class Bean_Serial_Transport:
                         "GETTING_MAJOR_TYPE",
                         "GETTING_MINOR_TYPE",
                         "GETTING_MESSAGE_BODY",
+                        "GETTING_CRC",
                         "GETTING_EOF")
 
 
@@ -59,6 +63,8 @@ class Bean_Serial_Transport:
         self.parser_message_buffer = []
         self.parser_message_type = []
         self.parser_escaping = False
+        self.parser_crc = 0
+        self.parser_frame = []
 
 
     def parser(self):        
@@ -70,11 +76,13 @@ class Bean_Serial_Transport:
             #logging.error(byte)
 
 
+            # Framing as in BeanFrameCodec.h: everything between SOF and EOF
+            # may be escaped, and the frame ends in a CRC-32 of length, ID
+            # and body
             if(self.parser_escaping == False and byte == self.ESC_BYTE):
-                # should anything else have escaping?
-                if(self.parser_state == self.ParserStates.GETTING_MESSAGE_BODY):
+                if(self.parser_state != self.ParserStates.WAITING_FOR_SOF):
                     self.parser_escaping = True
-                    continue
+                continue
 
             # reset the parser and handle the new message
             if(self.parser_escaping == False and byte == self.SOF_BYTE):
@@ -82,15 +90,26 @@ class Bean_Serial_Transport:
 
             if(self.parser_escaping == True):
                 self.parser_escaping = False
-                byte = byte | 0x20
+                byte = byte ^ self.ESC_XOR
+            elif(byte == self.EOF_BYTE and
+                 self.parser_state != self.ParserStates.GETTING_EOF and
+                 self.parser_state != self.ParserStates.WAITING_FOR_SOF):
+                logging.error("Frame cut short by EOF")
+                self.reset_parser()
+                continue
 
             if(self.parser_state == self.ParserStates.WAITING_FOR_SOF):
                 if(byte == self.SOF_BYTE):
                     self.parser_state = self.ParserStates.GETTING_LENGTH
 #                    logging.debug("SOF --> LEN")
-            
+
             elif(self.parser_state == self.ParserStates.GETTING_LENGTH):
+                if(byte < 2):
+                    logging.error("Frame length too short: %d" % byte)
+                    self.reset_parser()
+                    continue
                 self.parser_length = byte
+                self.parser_frame = [byte]
                 self.parser_state = self.ParserStates.GETTING_MAJOR_TYPE
 #                logging.debug("LEN --> MAJ")
 
@@ -98,32 +117,49 @@ class Bean_Serial_Transport:
                 self.parser_message_type = []
                 self.parser_length -= 1
                 self.parser_message_type.append(byte)
+                self.parser_frame.append(byte)
                 self.parser_state = self.ParserStates.GETTING_MINOR_TYPE
 #                logging.debug("MAJ --> MIN")
 
             elif(self.parser_state == self.ParserStates.GETTING_MINOR_TYPE):
                 self.parser_length -= 1
                 self.parser_message_type.append(byte)
+                self.parser_frame.append(byte)
 
                 if(self.parser_length > 0):
                     self.parser_state = self.ParserStates.GETTING_MESSAGE_BODY
                 else:
-                    self.parser_state = self.ParserStates.GETTING_EOF
+                    self.parser_length = self.CRC_LENGTH
+                    self.parser_state = self.ParserStates.GETTING_CRC
 #                logging.debug("MIN --> BODY")
 
             elif(self.parser_state == self.ParserStates.GETTING_MESSAGE_BODY):
                 self.parser_message_buffer.append(byte)
+                self.parser_frame.append(byte)
+                self.parser_length -= 1
+                if(self.parser_length == 0):
+                    self.parser_length = self.CRC_LENGTH
+                    self.parser_state = self.ParserStates.GETTING_CRC
+#                    logging.debug("BODY --> CRC")
+
+            elif(self.parser_state == self.ParserStates.GETTING_CRC):
+                self.parser_crc = (self.parser_crc << 8) | byte
                 self.parser_length -= 1
                 if(self.parser_length == 0):
                     self.parser_state = self.ParserStates.GETTING_EOF
-#                    logging.debug("BODY --> EOF")
 
             elif(self.parser_state == self.ParserStates.GETTING_EOF):
                 if(byte != self.EOF_BYTE):
-                    logging.error("Expected EOF but got: %d" % byte)                   
+                    logging.error("Expected EOF but got: %d" % byte)
+                    self.reset_parser()
                     continue
-                
-                self.handle_message(tuple(self.parser_message_type), self.parser_message_buffer)
+
+                if(self.parser_crc != self.crc32(self.parser_frame)):
+                    logging.error("Bad CRC on message %s" %
+                                  str(tuple(self.parser_message_type)))
+                else:
+                    self.handle_message(tuple(self.parser_message_type),
+                                        self.parser_message_buffer)
                 self.reset_parser()
 
 
@@ -186,13 +222,21 @@ class Bean_Serial_Transport:
                 escaped.append(i)
         return escaped
 
+    def crc32(self, buffer):
+        return zlib.crc32(bytearray(buffer)) & 0xFFFFFFFF
+
     def build_message(self, message_type, buffer):
+        if isinstance(buffer, str):
+            buffer = [ord(c) for c in buffer]
+        frame = []
+        frame.extend(message_type)
+        frame.extend(buffer)
+        frame.insert(0, len(frame))
+        crc = self.crc32(frame)
+        frame.extend([(crc >> 24) & 0xFF, (crc >> 16) & 0xFF,
+                      (crc >> 8) & 0xFF, crc & 0xFF])
         message = [self.SOF_BYTE]
-        message_body = []
-        message_body.extend(message_type)
-        message_body.extend(buffer)
-        message.append(len(message_body))
-        message.extend(self.escape_buffer(message_body))
+        message.extend(self.escape_buffer(frame))
         message.append(self.EOF_BYTE)
         return message
 
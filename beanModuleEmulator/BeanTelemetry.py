@@ -0,0 +1,148 @@
+#!/usr/bin/env python
+"""Decoder for MSG_ID_TELEMETRY records from the core's TelemetryEncoder.
+
+A Schema lists the fields in the order the record's telemetry() member visits
+them, as (name, kind, type): kind is value, delta, flag or fixed, and type is
+one of u8 i8 u16 i16 u32 i32 f32. For the Reading example in BeanTelemetry.h:
+
+    Schema(1, 'time:delta:u32,temperature:delta:i16,x:delta:i16,'
+              'y:delta:i16,z:delta:i16,moving:flag')
+
+The same string form is accepted by BeanCCStandIn.py --schema ID=fields.
+"""
+from __future__ import print_function
+
+import struct
+
+TELEMETRY_KEY = 0x80
+TELEMETRY_SEQUENCE_MASK = 0x7F
+
+TYPES = {
+    'u8': (8, False), 'i8': (8, True),
+    'u16': (16, False), 'i16': (16, True),
+    'u32': (32, False), 'i32': (32, True),
+    'f32': (32, None),
+}
+
+
+class Schema(object):
+    def __init__(self, schema_id, fields):
+        self.schema_id = schema_id
+        if isinstance(fields, str):
+            fields = [tuple(field.split(':')) for field in fields.split(',')]
+        self.fields = []
+        for field in fields:
+            name, kind = field[0], field[1]
+            ftype = field[2] if len(field) > 2 else None
+            if kind not in ('value', 'delta', 'flag', 'fixed'):
+                raise ValueError('unknown kind %r for %s' % (kind, name))
+            if kind != 'flag' and ftype not in TYPES:
+                raise ValueError('unknown type %r for %s' % (ftype, name))
+            self.fields.append((name, kind, ftype))
+
+    @classmethod
+    def parse(cls, text):
+        """'ID=name:kind:type,...' as given on a command line."""
+        schema_id, fields = text.split('=', 1)
+        return cls(int(schema_id, 0), fields)
+
+
+def _signed(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+class _Reader(object):
+    def __init__(self, data):
+        self.data = bytearray(data)
+        self.i = 0
+
+    def byte(self):
+        if self.i >= len(self.data):
+            raise ValueError('record truncated')
+        self.i += 1
+        return self.data[self.i - 1]
+
+    def varint(self):
+        value = shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return value
+
+    def zigzag(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+
+class TelemetryDecoder(object):
+    """Turns frame bodies into dicts, one schema per schema ID."""
+
+    def __init__(self, schemas=()):
+        self.schemas = dict((s.schema_id, s) for s in schemas)
+        self.prev = {}
+        self.expected = {}
+        self.lost = 0
+
+    def add_schema(self, schema):
+        self.schemas[schema.schema_id] = schema
+
+    def feed(self, body):
+        """Returns (schema_id, record), or None for a record that can't be
+        decoded: unknown schema, or a delta record after a gap."""
+        reader = _Reader(body)
+        schema_id = reader.byte()
+        header = reader.byte()
+        schema = self.schemas.get(schema_id)
+        if schema is None:
+            return None
+
+        sequence = header & TELEMETRY_SEQUENCE_MASK
+        expected = self.expected.get(schema_id)
+        if expected is not None and sequence != expected:
+            self.lost += (sequence - expected) & TELEMETRY_SEQUENCE_MASK
+        self.expected[schema_id] = (sequence + 1) & TELEMETRY_SEQUENCE_MASK
+
+        if header & TELEMETRY_KEY:
+            prev = dict((name, 0) for name, _, _ in schema.fields)
+        elif expected == sequence and schema_id in self.prev:
+            prev = self.prev[schema_id]
+        else:
+            self.prev.pop(schema_id, None)
+            return None
+
+        record = {}
+        pending = []
+        for name, kind, ftype in schema.fields:
+            if kind == 'flag':
+                pending.append(name)
+                if len(pending) == 8:
+                    self._flags(reader, pending, record)
+                continue
+            bits, signed = TYPES[ftype]
+            if kind == 'fixed':
+                raw = bytes(bytearray(reader.byte() for _ in range(bits // 8)))
+                fmt = {8: 'B', 16: 'H', 32: 'I'}[bits]
+                if signed is None:
+                    fmt = 'f'
+                elif signed:
+                    fmt = fmt.lower()
+                record[name] = struct.unpack('<' + fmt, raw)[0]
+            elif kind == 'value':
+                record[name] = reader.zigzag() if signed else reader.varint()
+            else:
+                value = (prev[name] + reader.zigzag()) & ((1 << bits) - 1)
+                record[name] = _signed(value, bits) if signed else value
+        if pending:
+            self._flags(reader, pending, record)
+
+        self.prev[schema_id] = record
+        return schema_id, record
+
+    @staticmethod
+    def _flags(reader, names, record):
+        flags = reader.byte()
+        for bit, name in enumerate(names):
+            record[name] = bool(flags & (1 << bit))
+        del names[:]
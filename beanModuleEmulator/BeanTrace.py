@@ -0,0 +1,136 @@
+#!/usr/bin/env python
+"""Decoder for the core's event trace (BeanTrace.h), sent as MSG_ID_DB_TRACE.
+
+A dump is one or more messages. Each body starts with the number of records
+still to come after it and the microseconds in a timer0 tick, followed by 5
+byte records: event, arg (uint16 LE) and a stamp in ticks (uint16 LE),
+oldest first. Stamps wrap every 65536 ticks, 524 ms on the Bean and 262 ms
+on the Bean+. An empty body means the sketch was built without BEAN_TRACE.
+
+BeanCCStandIn.py --trace-every asks for dumps and prints them with this. A
+dump captured some other way can be given as the message bodies in hex:
+
+    BeanTrace.py 1b0151a3... 1201...
+"""
+from __future__ import print_function
+
+import binascii
+import struct
+import sys
+
+MSG_ID_DB_TRACE = 0xFE14
+
+HEADER = struct.Struct('<BB')
+RECORD = struct.Struct('<BHH')
+
+EVENTS = [
+    'none', 'tx start', 'tx end', 'rx start', 'rx end', 'crc failure',
+    'timeout', 'sleep', 'wake', 'wake line', 'overrun',
+]
+TRACE_USER = len(EVENTS)
+OVERRUNS = ['uart', 'ring buffer']
+# Events whose arg is a message ID
+MESSAGE_EVENTS = set(['tx start', 'rx start', 'rx end', 'crc failure',
+                      'timeout'])
+
+
+class TraceDecoder(object):
+    """Collects the messages of a dump. feed() returns the records, as
+    (micros, event, arg) tuples, once the last message is in, and None
+    until then; an empty list if the core has no trace. micros counts from
+    the first record, taking each record to be less than one wrap of the
+    stamp after the one before."""
+
+    def __init__(self):
+        self.records = []
+
+    def feed(self, body):
+        body = bytes(body)
+        if len(body) < HEADER.size:
+            self.records = []
+            return []
+        remaining, tick_us = HEADER.unpack_from(body)
+        for offset in range(HEADER.size, len(body) - RECORD.size + 1,
+                            RECORD.size):
+            event, arg, stamp = RECORD.unpack_from(body, offset)
+            self.records.append((stamp, event, arg))
+        if remaining:
+            return None
+        records, self.records = self.records, []
+        return unwrap(records, tick_us)
+
+
+def unwrap(records, tick_us):
+    """(stamp, event, arg) records as (micros, event, arg)."""
+    unwrapped = []
+    ticks = 0
+    previous = records[0][0] if records else 0
+    for stamp, event, arg in records:
+        ticks += (stamp - previous) & 0xFFFF
+        previous = stamp
+        unwrapped.append((ticks * tick_us, event, arg))
+    return unwrapped
+
+
+def event_name(event):
+    if event < TRACE_USER:
+        return EVENTS[event]
+    return 'user %d' % (event - TRACE_USER)
+
+
+def describe(event, arg, message_names=None):
+    name = event_name(event)
+    if name in MESSAGE_EVENTS:
+        message = (message_names or {}).get(arg)
+        if message:
+            return '%-11s 0x%04X %s' % (name, arg, message)
+        return '%-11s 0x%04X' % (name, arg)
+    if name == 'tx end':
+        return name
+    if name == 'sleep':
+        return '%-11s %d ms asked for' % (name, arg)
+    if name == 'wake':
+        return '%-11s after %d ms powered down (not on the clock)' % (name,
+                                                                      arg)
+    if name == 'wake line':
+        return '%-11s %s' % (name, 'high' if arg else 'low')
+    if name == 'overrun':
+        return '%-11s %s' % (name, OVERRUNS[arg] if arg < len(OVERRUNS)
+                             else arg)
+    return '%-11s %d' % (name, arg)
+
+
+def render(records, message_names=None):
+    """The records as timeline lines: milliseconds since the first record,
+    since the one before, and what happened. The clock stands still while
+    the AVR is powered down."""
+    if not records:
+        return ['trace: empty, or built without BEAN_TRACE']
+    lines = []
+    previous = records[0][0]
+    for micros, event, arg in records:
+        lines.append('%10.3f ms %+9.3f  %s' % (
+            micros / 1000.0, (micros - previous) / 1000.0,
+            describe(event, arg, message_names)))
+        previous = micros
+    return lines
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+    decoder = TraceDecoder()
+    records = None
+    for hex_body in sys.argv[1:]:
+        records = decoder.feed(binascii.unhexlify(hex_body))
+    if records is None:
+        print('trace: incomplete dump', file=sys.stderr)
+        return 1
+    for line in render(records):
+        print(line)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,17 @@
+void connectionChanged(bool connected) {
+  // Called between loop() iterations whenever a device connects or disconnects
+  if (connected) {
+    Bean.setLed(0, 255, 0);
+  } else {
+    Bean.setLed(0, 0, 0);
+  }
+}
+
+void setup() {
+  Bean.onConnectionChange(connectionChanged);
+}
+
+void loop() {
+  // Nothing to poll here; the callback keeps the LED up to date
+  delay(100);
+}
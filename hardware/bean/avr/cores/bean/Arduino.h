@@ -192,6 +192,10 @@ extern const uint8_t PROGMEM digital_pin_to_timer_PGM[];
 #include "WString.h"
 #include "HardwareSerial.h"
 #include "BeanSerialTransport.h"
+#include "BeanProfile.h"
+#include "BeanTrace.h"
+#include "BeanMemory.h"
+#include "BeanLatency.h"
 #include "Bean.h"
 
 uint16_t makeWord(uint16_t w);
@@ -8,7 +8,7 @@
 #include <applicationMessageHeaders/AppMessages.h>
 #include "wiring_private.h"
 
-#ifndef sleep_bod_disable()  // not included in Arduino AVR toolset
+#ifndef sleep_bod_disable  // not included in Arduino AVR toolset
 #define sleep_bod_disable()                         \
   do {                                              \
     uint8_t tempreg;                                \
@@ -34,6 +34,13 @@
 
 BeanClass Bean;
 
+// Bean.sleep()'s waits while it can't power down, counted for
+// Serial.getPowerStats()
+static void sleep_delay(uint32_t duration_ms) {
+  delay(duration_ms);
+  Serial.countDelay(duration_ms);
+}
+
 static void wakeUp(void) {
   // Do nothing.
   // This function is called as an interrupt purely to wake
@@ -45,6 +52,9 @@ static void wakeUp(void) {
 #define MAX_DELAY (30000)
 #define MIN_SLEEP_TIME (10)
 
+// When the last MSG_ID_AR_SLEEP went out, for the power accounting
+static unsigned long sleep_requested_millis;
+
 void BeanClass::keepAwake(bool enable) {
   if (enable) {
     Serial.BTConfigUartSleep(UART_SLEEP_NEVER);
@@ -62,11 +72,12 @@ bool BeanClass::attemptSleep(uint32_t duration_ms) {
 
   // Send the sleep message to the TI and wait for it to
   // finish sending.
+  sleep_requested_millis = millis();
   Serial.sleep(duration_ms);
   Serial.flush();
 
   while (sleepLineSet == false && pollCount++ < MAX_SLEEP_POLL) {
-    delay(1);
+    sleep_delay(1);
     if ((PIND & _BV(3)) > 0) {
       sleepLineSet = true;
     }
@@ -89,9 +100,12 @@ void BeanClass::sleep(uint32_t duration_ms) {
 
   Serial.BTConfigUartSleep(UART_SLEEP_NORMAL);
 
+  // Nothing queued for a container waits out the sleep
+  Serial.flush();
+
   // There's no point in sleeping if the duration is <= 10ms
   if (duration_ms < MIN_SLEEP_TIME) {
-    delay(duration_ms);
+    sleep_delay(duration_ms);
     return;
   }
 
@@ -111,7 +125,7 @@ void BeanClass::sleep(uint32_t duration_ms) {
     }
   } else if (!sleeping && duration_ms > MAX_SLEEP_POLL) {
     // take out the time we've already delayed
-    delay(duration_ms - MAX_SLEEP_POLL);
+    sleep_delay(duration_ms - MAX_SLEEP_POLL);
     sleeping = false;
   }
 
@@ -213,19 +227,37 @@ void BeanClass::sleep(uint32_t duration_ms) {
   *
   * In all but the IDLE sleep modes only LOW can be used.
   */
+  // The CC times the sleep from when it got the request, and we have been
+  // awake since
+  uint32_t waited = millis() - sleep_requested_millis;
+  uint32_t powered_down = duration_ms > waited ? duration_ms - waited : 0;
+
+  TRACE(TRACE_SLEEP, min(duration_ms, 0xFFFF));
   attachInterrupt(interruptNum, wakeUp, LOW);
   set_sleep_mode(SLEEP_MODE_PWR_DOWN);
   cli();
+  LATENCY_OFF_BEGIN(LATENCY_SLEEP);
   if (bit_is_set(PIND, 3)) {
     sleep_enable();
+    // before sleep_bod_disable(), which has to be followed by sleep_cpu()
+    // within three cycles
+    LATENCY_OFF_END(LATENCY_SLEEP);
     sleep_bod_disable();
     sei();
     sleep_cpu();
     sleep_disable();
+  } else {
+    LATENCY_OFF_END(LATENCY_SLEEP);
   }
   sei();
 
   detachInterrupt(interruptNum);
+  TRACE(TRACE_WAKE, min(powered_down, 0xFFFF));
+
+  // millis() stood still while we were powered down, so anything cached
+  // from the CC can't be trusted to be fresh.
+  Serial.expireCaches();
+  Serial.countSleep(powered_down);
 
   if (adc_was_set) {
     // re-enable adc
@@ -315,7 +347,7 @@ void BeanClass::setAccelerometerPowerMode(uint8_t mode) {
 }
 
 uint8_t BeanClass::getAccelerometerPowerMode() {
-  uint8_t value;
+  uint8_t value = 0;
   Serial.accelRegisterRead(REG_POWER_MODE_X11, 1, &value);
   return value;
 }
@@ -327,7 +359,7 @@ void BeanClass::enableWakeOnAccelerometer(uint8_t sources) {
 }
 
 uint8_t BeanClass::getAccelerationRange(void) {
-  uint8_t value;
+  uint8_t value = 0;
   Serial.accelRegisterRead(REG_G_SETTING, 1, &value);
   return value;
 }
@@ -337,25 +369,25 @@ void BeanClass::setAccelerationRange(uint8_t range) {
 }
 
 int16_t BeanClass::getAccelerationX(void) {
-  ACC_READING_T reading;
+  ACC_READING_T reading = {0, 0, 0, 0};
   Serial.accelRead(&reading);
   return reading.xAxis;
 }
 
 int16_t BeanClass::getAccelerationY(void) {
-  ACC_READING_T reading;
+  ACC_READING_T reading = {0, 0, 0, 0};
   Serial.accelRead(&reading);
   return reading.yAxis;
 }
 
 int16_t BeanClass::getAccelerationZ(void) {
-  ACC_READING_T reading;
+  ACC_READING_T reading = {0, 0, 0, 0};
   Serial.accelRead(&reading);
   return reading.zAxis;
 }
 
 ACC_READING_T BeanClass::getAcceleration(void) {
-  ACC_READING_T reading;
+  ACC_READING_T reading = {0, 0, 0, 0};
   Serial.accelRead(&reading);
   return reading;
 }
@@ -680,3 +712,23 @@ void BeanClass::enableWakeOnConnect(bool enable) {
 }
 
 void BeanClass::disconnect(void) { Serial.BTDisconnect(); }
+
+void BeanClass::setSensorCacheTtl(CACHED_SENSOR_T sensor, uint32_t ttl_ms) {
+  Serial.setSensorCacheTtl(sensor, ttl_ms);
+}
+
+void BeanClass::setRequestRetries(uint8_t retries) {
+  Serial.setRequestRetries(retries);
+}
+
+RttStats BeanClass::getRttStats(RTT_CLASS_T rttClass) {
+  RttStats stats;
+  Serial.getRttStats(rttClass, &stats);
+  return stats;
+}
+
+bool BeanClass::lastReadFailed(void) { return Serial.lastRequestFailed(); }
+
+void BeanClass::onConnectionChange(void (*callback)(bool connected)) {
+  Serial.BTSetConnectionCallback(callback);
+}
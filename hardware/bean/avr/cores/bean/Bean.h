@@ -4,6 +4,7 @@
 #include "BeanHID.h"
 #include "BeanMidi.h"
 #include "BeanAncs.h"
+#include "BeanTelemetry.h"
 #include "bma250.h"
 
 /*
@@ -16,7 +17,7 @@
  *  HIGH_G_EVENT - triggers when the accelerometer experiences a velocity event higher than it's *  sensitivity
  *  LOW_G_EVENT - triggers when the accelerometer is in free fall or experiences no gravitational *  pull
  */
-typedef enum AccelEventTypes {
+enum AccelEventTypes {
   FLAT_EVENT = 0x80,
   ORIENT_EVENT = 0x40,
   SINGLE_TAP_EVENT = 0x20,
@@ -26,7 +27,7 @@ typedef enum AccelEventTypes {
   LOW_G_EVENT = 0x01
 };
 
-typedef enum AdvertisementDataTypes {
+enum AdvertisementDataTypes {
   GAP_ADTYPE_FLAGS                        =  0x01,  //  Discovery Mode: @ref GAP_ADTYPE_FLAGS_MODES
   GAP_ADTYPE_16BIT_MORE                   =  0x02,  //  Service: More 16-bit UUIDs available
   GAP_ADTYPE_16BIT_COMPLETE               =  0x03,  //  Service: Complete list of 16-bit UUIDs
@@ -63,7 +64,7 @@ typedef enum AdvertisementDataTypes {
                                                     //  manufacturer specific data
 };
 
-typedef enum AdvertisementType {
+enum AdvertisementType {
   GAP_ADTYPE_FLAGS_LIMITED                =  0x01,  //  Discovery Mode: LE Limited Discoverable Mode
   GAP_ADTYPE_FLAGS_GENERAL                =  0x02,  //  Discovery Mode: LE General Discoverable Mode
   GAP_ADTYPE_FLAGS_BREDR_NOT_SUPPORTED    =  0x04,  //  Discovery Mode: BR/EDR Not Supported
@@ -569,6 +570,8 @@ class BeanClass {
   /**
    *  Check whether the Bean is currently advertising.
    *
+   *  The advertising state is cached together with the connection state; see getConnectionState().
+   *
    *  @return true if Bean is advertising, false if Bean is not advertising
    *
    *  # Examples
@@ -672,6 +675,8 @@ class BeanClass {
   /**
    *  Get the current battery level, in percent.
    *
+   *  The level is cached for `BATTERY_CACHE_TTL_MS` (see setSensorCacheTtl()). Only the first call blocks on the radio; afterwards the last known level is returned immediately and refreshed in the background once it expires.
+   *
    *  @return a value in the range 0 to 100: 0 = 1.95 V, 100 = 3.53 V
    */
   uint8_t getBatteryLevel(void);
@@ -681,6 +686,8 @@ class BeanClass {
    *
    *  Accuracy is ±0.01 V.
    *
+   *  The voltage is derived from the cached battery level, so calling this right after getBatteryLevel() costs nothing extra.
+   *
    *  @return a value in the range 195 to 353: 195 = 1.95 V, 353 = 3.53 V
    *
    *  # Examples
@@ -702,6 +709,8 @@ class BeanClass {
   /**
    *  Get the current temperature of the Bean, in degrees Celsius. The Bean uses the BMA250 (<a href="http://ae-bst.resource.bosch.com/media/products/dokumente/bma250/bst-bma250-ds002-05.pdf">datasheet</a>) for temperature readings.
    *
+   *  The temperature is cached for `TEMPERATURE_CACHE_TTL_MS` (see setSensorCacheTtl()). Only the first call blocks on the radio; afterwards the last known temperature is returned immediately and refreshed in the background once it expires.
+   *
    *  @return temperature, between -40 and 88 degrees Celsius
    *
    *  # Examples
@@ -729,6 +738,8 @@ class BeanClass {
   /**
    *  Check if any BLE Central devices are currently connected to Bean.
    *
+   *  The state is cached, so this is cheap enough to call on every `loop()`. A cached value older than `BT_STATES_REFRESH_MS` is still returned, and a refresh is requested from the radio in the background; the request is sent between calls to `loop()` once the radio is ready for it, without waiting. The cache is cleared by `Bean.sleep()`, `Bean.disconnect()` and `Bean.enableAdvertising()`, so the first call after them waits for a fresh reading.
+   *
    *  @return true if a device is connected, false otherwise
    *
    *  # Examples
@@ -738,6 +749,21 @@ class BeanClass {
    *  @include connection/getConnectionState.ino
    */
   bool getConnectionState(void);
+
+  /**
+   *  Register a function to be called when a BLE Central device connects to or disconnects from Bean.
+   *
+   *  The callback runs from the main loop between calls to `loop()`, not from an interrupt, so it may call any other Bean function. While a callback is registered, the connection state is refreshed every `BT_STATES_REFRESH_MS` even if the sketch never asks for it.
+   *
+   *  @param callback called with true on connect and false on disconnect, or NULL to stop being notified
+   *
+   *  # Examples
+   *
+   *  This example turns the LED green while a device is connected:
+   *
+   *  @include connection/onConnectionChange.ino
+   */
+  void onConnectionChange(void (*callback)(bool connected));
   ///@}
 
 
@@ -821,6 +847,45 @@ class BeanClass {
    */
   void enableConfigSave(bool enableSave);
 
+  /**
+   *  Set how long temperature or battery readings are cached before they are refreshed.
+   *
+   *  Within the TTL, getTemperature(), getBatteryLevel() and getBatteryVoltage() return without talking to the radio. After it, they still return the last known value and request a new one in the background.
+   *
+   *  @param sensor `CACHED_TEMPERATURE` or `CACHED_BATTERY`
+   *  @param ttl_ms how long a reading stays fresh, in milliseconds. 0 reads the radio on every call.
+   */
+  void setSensorCacheTtl(CACHED_SENSOR_T sensor, uint32_t ttl_ms);
+
+  /**
+   *  Set how many times a request to the Bluetooth module is sent again when no reply arrives in time.
+   *
+   *  Reads such as getAcceleration(), getLed() or getRadioConfig() wait for a reply from the Bluetooth module. The wait adapts to how quickly replies have arrived recently (see getRttStats()), and a read that times out is retried with a doubled timeout. Requests that change something on the Bluetooth module, such as the debug counter, are sent only once. The default is `REQUEST_DEFAULT_RETRIES`. A read that is still unanswered after the last retry returns 0, or a reading of all zeros; lastReadFailed() tells it from a real 0.
+   *
+   *  @param retries the number of retries after the first attempt. 0 disables retries.
+   */
+  void setRequestRetries(uint8_t retries);
+
+  /**
+   *  Get round trip statistics for requests to the Bluetooth module.
+   *
+   *  Round trips are measured from when the request is queued for the UART to when the reply arrives, and the timeout runs over the same span. A read costs more than the round trip: before the request the Bluetooth module is woken (7 ms while it sleeps between messages) and after it the transport waits out the send delay (13 ms), so a loop that reads the accelerometer every iteration spends about 20 ms per read, or `srtt_ms` more when the reply takes longer than the send delay.
+   *
+   *  @param rttClass `RTT_CLASS_RADIO` (radio settings and state), `RTT_CLASS_PERIPHERAL` (LED, accelerometer, temperature and battery), `RTT_CLASS_REMOTE` (round trips through the connected device), `RTT_CLASS_BULK` (acks of bulk write frames) or `RTT_CLASS_OTHER`
+   *
+   *  @return an `RttStats` struct with the smoothed round trip time, its mean deviation, the current timeout, and counts of samples, timeouts and failed requests
+   */
+  RttStats getRttStats(RTT_CLASS_T rttClass);
+
+  /**
+   *  Check whether the last read from the Bluetooth module went unanswered.
+   *
+   *  Reads such as getAcceleration() or getTemperature() return 0, or a reading of all zeros, when no reply arrives after every retry. A value served from a cache counts as answered.
+   *
+   *  @return true if the last read returned a default instead of a reading
+   */
+  bool lastReadFailed(void);
+
 
   /**
    *  Performs a hard reset on the bluetooth module.
@@ -25,13 +25,13 @@ int BeanAncsClass::notificationsAvailable() { return Serial.ancsAvailable(); }
 
 int BeanAncsClass::getNotificationHeaders(ANCS_SOURCE_MSG_T *buffer, size_t max_length) {
   int numMsgs = Serial.ancsAvailable();
-  int bytes_written = Serial.readAncs((uint8_t *)buffer, min(max_length, numMsgs) * 8);
+  int bytes_written = Serial.readAncs((uint8_t *)buffer, min(max_length, (size_t)numMsgs) * 8);
 
   return bytes_written/8;
 }
 
 ANCS_SOURCE_MSG_T BeanAncsClass::getNotificationHeader() {
-  ANCS_SOURCE_MSG_T msg = {0};
+  ANCS_SOURCE_MSG_T msg = {0, 0, 0, 0, 0};
   Serial.readAncs((uint8_t *)&msg, 8);
   return msg;
 }
@@ -0,0 +1,195 @@
+#include <string.h>
+#include "Arduino.h"
+#include "BeanSerialTransport.h"
+
+extern volatile uint32_t rx_frame_millis;
+
+// Bulk writes live in their own file so sketches that never start one don't
+// pay for the state below; poll() only reaches it through m_bulkPump.
+
+#define BULK_CHUNK_SIZE (MAX_BODY_LENGTH - 1)  // one byte for the sequence
+
+static struct {
+  BULK_STATUS_T status;
+  uint32_t length;
+  uint32_t frames;      // BULK_START plus the data frames
+  uint32_t baseFrame;   // oldest frame not yet acked
+  uint32_t nextFrame;   // next frame to send
+  uint32_t highFrame;   // one past the highest frame ever sent
+  uint32_t timerMillis;
+  uint32_t timedFrame;  // frame being timed for the RTT estimate
+  uint32_t timedMillis;
+  bool timing;
+  uint8_t window;
+  uint8_t timeouts;
+  BulkReader reader;
+  BulkCallback callback;
+} bulk;
+
+static uint8_t bulk_ack;
+static FrameSlot bulk_ack_slot = {&bulk_ack, 1, 0, false, 0, NULL};
+
+static const uint8_t *bulk_data;
+
+static size_t read_bulk_data(uint32_t offset, uint8_t *buffer, size_t length) {
+  memcpy(buffer, bulk_data + offset, length);
+  return length;
+}
+
+bool BeanSerialTransport::beginBulkWrite(uint32_t length, BulkReader reader,
+                                         BulkCallback callback,
+                                         uint8_t window) {
+  if (bulk.status == BULK_SENDING || reader == NULL) {
+    return false;
+  }
+  if (!addRoute(MSG_ID_BULK_ACK, MSG_ID_BULK_ACK, SINK_SLOT, &bulk_ack_slot)) {
+    return false;
+  }
+
+  bulk_ack_slot.updated = false;
+  memset(&bulk, 0, sizeof(bulk));
+  bulk.status = BULK_SENDING;
+  bulk.length = length;
+  bulk.frames = 1 + (length + BULK_CHUNK_SIZE - 1) / BULK_CHUNK_SIZE;
+  bulk.window = constrain(window, 1, BULK_MAX_WINDOW);
+  bulk.reader = reader;
+  bulk.callback = callback;
+
+  // The CC is kept awake for the whole transfer, so it only has to be woken
+  // once, and acks pace the frames instead of the send delay.
+  holdCCAwake(true);
+  if (m_wakeDelay > 0) {
+    set_wake_line(HIGH);
+    delay(m_wakeDelay);
+    countDelay(m_wakeDelay);
+  }
+
+  m_bulkPump = &BeanSerialTransport::bulkPump;
+  bulkPump();
+  return true;
+}
+
+bool BeanSerialTransport::beginBulkWrite(const uint8_t *data, uint32_t length,
+                                         BulkCallback callback) {
+  if (bulk.status == BULK_SENDING) {
+    return false;
+  }
+  bulk_data = data;
+  return beginBulkWrite(length, read_bulk_data, callback);
+}
+
+BULK_STATUS_T BeanSerialTransport::bulkWriteStatus(void) {
+  return bulk.status;
+}
+
+void BeanSerialTransport::cancelBulkWrite(void) {
+  if (bulk.status == BULK_SENDING) {
+    bulkFinish(BULK_CANCELLED);
+  }
+}
+
+void BeanSerialTransport::bulkSend(uint32_t frame) {
+  uint8_t body[MAX_BODY_LENGTH];
+  size_t length;
+
+  body[0] = (uint8_t)frame;
+  if (frame == 0) {
+    memcpy(&body[1], &bulk.length, sizeof(bulk.length));
+    write_frame(MSG_ID_BULK_START, body, 1 + sizeof(bulk.length));
+  } else {
+    uint32_t offset = (frame - 1) * BULK_CHUNK_SIZE;
+    length = min(bulk.length - offset, (uint32_t)BULK_CHUNK_SIZE);
+    length = bulk.reader(offset, &body[1], length);
+    write_frame(MSG_ID_BULK_DATA, body, 1 + length);
+  }
+}
+
+void BeanSerialTransport::bulkFinish(BULK_STATUS_T status) {
+  bulk.status = status;
+  m_bulkPump = NULL;
+  removeRoute(MSG_ID_BULK_ACK);
+  holdCCAwake(false);
+
+  if (bulk.callback) {
+    uint32_t acked = bulk.baseFrame > 1
+                         ? min((bulk.baseFrame - 1) * BULK_CHUNK_SIZE,
+                               bulk.length)
+                         : 0;
+    bulk.callback(status, acked, bulk.length);
+  }
+}
+
+void BeanSerialTransport::bulkPump(void) {
+  RttEstimator *rtt = &m_rtt[RTT_CLASS_BULK];
+
+  if (bulk_ack_slot.updated) {
+    noInterrupts();
+    uint8_t ack = bulk_ack;
+    uint32_t ackMillis = rx_frame_millis;
+    bulk_ack_slot.updated = false;
+    interrupts();
+
+    // Sequence numbers are the low byte of the frame number, and never more
+    // than BULK_MAX_WINDOW frames are in flight. After a timeout nextFrame
+    // goes back to baseFrame, but frames up to highFrame may still have
+    // arrived, and an ack for them is as good as any.
+    uint8_t acked = ack - (uint8_t)bulk.baseFrame;
+    if (acked > 0 && acked <= bulk.highFrame - bulk.baseFrame) {
+      bulk.baseFrame += acked;
+      if (bulk.nextFrame < bulk.baseFrame) {
+        bulk.nextFrame = bulk.baseFrame;
+      }
+      bulk.timeouts = 0;
+      bulk.timerMillis = millis();
+
+      if (bulk.timing && bulk.timedFrame < bulk.baseFrame) {
+        rttSample(rtt, min(ackMillis - bulk.timedMillis, RTT_MAX_TIMEOUT_MS));
+        bulk.timing = false;
+      }
+
+      if (bulk.baseFrame == bulk.frames) {
+        bulkFinish(BULK_DONE);
+        return;
+      }
+      if (bulk.callback) {
+        bulk.callback(BULK_SENDING,
+                      min((bulk.baseFrame - 1) * BULK_CHUNK_SIZE, bulk.length),
+                      bulk.length);
+      }
+    }
+  }
+
+  // Nothing acked in time: start over from the oldest unacked frame.
+  if (bulk.nextFrame != bulk.baseFrame &&
+      millis() - bulk.timerMillis >= rtt->rto_ms) {
+    rtt->timeouts++;
+    TRACE(TRACE_TIMEOUT, MSG_ID_BULK_DATA);
+    if (++bulk.timeouts > m_requestRetries) {
+      rtt->failures++;
+      bulkFinish(BULK_FAILED);
+      return;
+    }
+    rtt->rto_ms = min(rtt->rto_ms * 2, RTT_MAX_TIMEOUT_MS);
+    bulk.nextFrame = bulk.baseFrame;
+    bulk.timing = false;
+  }
+
+  while (bulk.nextFrame < bulk.frames &&
+         bulk.nextFrame - bulk.baseFrame < bulk.window) {
+    if (bulk.nextFrame == bulk.baseFrame) {
+      bulk.timerMillis = millis();
+    }
+    bulkSend(bulk.nextFrame);
+
+    // Only time frames sent for the first time (Karn's algorithm).
+    if (!bulk.timing && bulk.nextFrame >= bulk.highFrame) {
+      bulk.timing = true;
+      bulk.timedFrame = bulk.nextFrame;
+      bulk.timedMillis = m_frameMillis;
+    }
+    bulk.nextFrame++;
+    if (bulk.nextFrame > bulk.highFrame) {
+      bulk.highFrame = bulk.nextFrame;
+    }
+  }
+}
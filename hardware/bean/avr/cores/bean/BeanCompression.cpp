@@ -0,0 +1,182 @@
+#include <string.h>
+#include "Arduino.h"
+#include "BeanSerialTransport.h"
+
+// Streaming LZSS for virtual serial data. Like bulk writes it lives in its own
+// file, so sketches that never call enableCompression() don't carry the
+// window; write() only reaches it through m_serialWriter.
+//
+// MSG_ID_SERIAL_DATA_LZ body:
+//
+//   [flags] then groups of [control][item]...[item], up to 8 items per group
+//
+// Control bit n (LSB first) describes item n: 0 is a literal byte, 1 is a
+// match of two bytes, [distance - 1][length - LZ_MIN_MATCH], copying from
+// `distance` bytes back. Matches may overlap the bytes they produce. The
+// stream ends with the frame; unused control bits are ignored.
+//
+// The window holds the last LZ_WINDOW_SIZE bytes of serial data, raw frames
+// included, and carries over between frames. LZ_FLAG_RESET in the flags byte
+// tells the decoder to empty its window first. A frame lost on the way
+// leaves the decoder's window behind the encoder's, and everything it
+// decodes after that is garbage until the next reset. So the window is reset
+// on the first frame after compression is enabled and then every
+// LZ_RESET_FRAMES frames, bounding the damage one lost frame can do. In
+// reliable mode frames aren't lost, so after the first frame it never is.
+//
+// Matches are only looked for where the next three bytes' hash last
+// appeared, the latest LZ_HASH_WAYS places. That is at most four comparison
+// runs per item instead of one for each of the 128 distances in the window,
+// which took around 7 ms a frame at 8 MHz. On the sensor log in
+// BeanCompression.py it costs a little ratio: 1.61 instead of 1.74 for
+// 512-byte writes.
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 255
+#define LZ_WINDOW_MASK (LZ_WINDOW_SIZE - 1)
+#define LZ_HASH_SIZE (16)
+#define LZ_HASH_WAYS (4)
+
+static uint8_t lz_window[LZ_WINDOW_SIZE];
+static uint8_t lz_head;    // where the next byte goes
+static uint8_t lz_filled;  // bytes of the window in use
+static uint8_t lz_count;   // bytes ever appended, modulo 256
+// lz_count at the start of the latest three bytes with each hash, newest
+// first. Entries may be stale or collide; matches are checked against the
+// window.
+static uint8_t lz_hash[LZ_HASH_SIZE][LZ_HASH_WAYS];
+static uint8_t lz_frames;  // frames since the last reset
+static bool lz_reset;
+
+static inline uint8_t *lz_bucket(uint8_t a, uint8_t b, uint8_t c) {
+  uint8_t h = a + (a >> 2) + (b << 3) + (c << 1) + (c >> 4);
+  return lz_hash[h & (LZ_HASH_SIZE - 1)];
+}
+
+static inline void lz_append(uint8_t c) {
+  lz_window[lz_head] = c;
+  lz_head = (lz_head + 1) & LZ_WINDOW_MASK;
+  lz_count++;
+  if (lz_filled < LZ_WINDOW_SIZE) {
+    lz_filled++;
+  }
+  if (lz_filled >= LZ_MIN_MATCH) {
+    uint8_t *bucket =
+        lz_bucket(lz_window[(uint8_t)(lz_head - 3) & LZ_WINDOW_MASK],
+                  lz_window[(uint8_t)(lz_head - 2) & LZ_WINDOW_MASK], c);
+    memmove(bucket + 1, bucket, LZ_HASH_WAYS - 1);
+    bucket[0] = lz_count - LZ_MIN_MATCH;
+  }
+}
+
+// Compresses as much of `in` as fits in one frame body. Returns the number of
+// input bytes consumed; the window is updated for all of them.
+static size_t lz_compress(const uint8_t *in, size_t length, uint8_t *out,
+                          size_t *outLength) {
+  size_t i = 0;
+  size_t o = 1;
+  size_t control = 0;
+  uint8_t bit = 8;
+
+  out[0] = lz_reset ? LZ_FLAG_RESET : 0;
+
+  while (i < length) {
+    // Room for a control byte if needed, plus the largest item
+    if (bit == 8) {
+      if (o + 3 > MAX_BODY_LENGTH) break;
+      control = o++;
+      out[control] = 0;
+      bit = 0;
+    } else if (o + 2 > MAX_BODY_LENGTH) {
+      break;
+    }
+
+    uint8_t maxLength = min(length - i, (size_t)LZ_MAX_MATCH);
+    uint8_t bestLength = 0;
+    uint8_t bestDistance = 0;
+
+    if (maxLength >= LZ_MIN_MATCH) {
+      const uint8_t *bucket = lz_bucket(in[i], in[i + 1], in[i + 2]);
+      for (uint8_t way = 0; way < LZ_HASH_WAYS; way++) {
+        uint8_t distance = lz_count - bucket[way];
+        if (distance == 0 || distance > lz_filled) {
+          continue;
+        }
+        uint8_t n = 0;
+        while (n < maxLength) {
+          uint8_t c = n < distance
+                          ? lz_window[(uint8_t)(lz_head - distance + n) &
+                                      LZ_WINDOW_MASK]
+                          : in[i + n - distance];
+          if (c != in[i + n]) break;
+          n++;
+        }
+        if (n > bestLength) {
+          bestLength = n;
+          bestDistance = distance;
+          if (n == maxLength) break;
+        }
+      }
+    }
+
+    if (bestLength >= LZ_MIN_MATCH) {
+      out[control] |= 1 << bit;
+      out[o++] = bestDistance - 1;
+      out[o++] = bestLength - LZ_MIN_MATCH;
+    } else {
+      bestLength = 1;
+      out[o++] = in[i];
+    }
+    for (uint8_t n = 0; n < bestLength; n++) {
+      lz_append(in[i++]);
+    }
+    bit++;
+  }
+
+  *outLength = o;
+  return i;
+}
+
+void BeanSerialTransport::enableCompression(bool enable) {
+  if (enable && m_serialWriter == NULL) {
+    lz_head = 0;
+    lz_filled = 0;
+    lz_reset = true;
+    m_serialWriter = &BeanSerialTransport::writeCompressed;
+  } else if (!enable) {
+    m_serialWriter = NULL;
+  }
+}
+
+size_t BeanSerialTransport::writeCompressed(const uint8_t *buffer,
+                                            size_t size) {
+  uint8_t body[MAX_BODY_LENGTH];
+  size_t done = 0;
+
+  while (done < size) {
+    if (lz_frames >= LZ_RESET_FRAMES && m_reliableWriter == NULL) {
+      lz_filled = 0;
+      lz_reset = true;
+    }
+    if (lz_reset) {
+      lz_frames = 0;
+    }
+
+    size_t length;
+    size_t consumed = lz_compress(buffer + done, size - done, body, &length);
+
+    // Data that doesn't shrink goes out raw; the window already has it. The
+    // reset has to reach the decoder though, so that frame goes out as is.
+    if (length < consumed || lz_reset) {
+      write_message(MSG_ID_SERIAL_DATA_LZ, body, length);
+      lz_reset = false;
+    } else {
+      write_message(MSG_ID_SERIAL_DATA, buffer + done, consumed);
+    }
+    if (lz_frames < LZ_RESET_FRAMES) {
+      lz_frames++;
+    }
+    done += consumed;
+  }
+  return size;
+}
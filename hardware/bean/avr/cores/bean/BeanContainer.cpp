@@ -0,0 +1,118 @@
+#include <string.h>
+#include "Arduino.h"
+#include "BeanSerialTransport.h"
+
+// Container frames. Like bulk writes they live in their own file, so sketches
+// that never call enableContainers() don't carry the buffers below;
+// write_message() and the other hooks only reach them through member
+// pointers.
+
+static uint8_t container[MAX_BODY_LENGTH];
+static uint8_t container_length;
+static uint8_t container_count;
+static uint32_t container_millis;  // when the first message was queued
+
+static uint8_t container_rx[MAX_BODY_LENGTH];
+static FrameSlot container_slot = {container_rx, sizeof(container_rx), 0,
+                                   false, 0, NULL};
+
+void BeanSerialTransport::enableContainers(bool enable) {
+  if (enable && m_containerPump == NULL) {
+    if (!addRoute(MSG_ID_CONTAINER, MSG_ID_CONTAINER, SINK_SLOT,
+                  &container_slot)) {
+      return;
+    }
+    container_slot.updated = false;
+    container_length = 0;
+    container_count = 0;
+    m_containerWriter = &BeanSerialTransport::containerWrite;
+    m_containerPump = &BeanSerialTransport::containerPump;
+  } else if (!enable && m_containerPump) {
+    containerPump(true);
+    m_containerWriter = NULL;
+    m_containerPump = NULL;
+    removeRoute(MSG_ID_CONTAINER);
+  }
+}
+
+size_t BeanSerialTransport::containerWrite(uint16_t messageId,
+                                           const uint8_t *body,
+                                           size_t body_length) {
+  size_t length = CONTAINER_HEADER_LENGTH + body_length;
+
+  // Too big to join what's queued. write_message() has already sent it if
+  // the window is over.
+  if (container_count > 0 && container_length + length > MAX_BODY_LENGTH) {
+    containerSend();
+  }
+  if (length > MAX_BODY_LENGTH) {
+    return send_message(messageId, body, body_length);
+  }
+
+  if (container_count == 0) {
+    container_millis = millis();
+  }
+  container[container_length++] = (uint8_t)(messageId >> 8);
+  container[container_length++] = (uint8_t)(messageId & 0xFF);
+  container[container_length++] = body_length;
+  memcpy(&container[container_length], body, body_length);
+  container_length += body_length;
+  container_count++;
+
+  return body_length;
+}
+
+void BeanSerialTransport::containerSend(void) {
+  uint8_t count = container_count;
+  uint8_t length = container_length;
+
+  // Emptied first: sending comes back here through begin_frame()
+  container_count = 0;
+  container_length = 0;
+
+  if (count == 1) {
+    // Alone it is cheaper as the message it is
+    send_message((container[0] << 8) | container[1],
+                 &container[CONTAINER_HEADER_LENGTH], container[2]);
+  } else if (count > 1) {
+    send_message(MSG_ID_CONTAINER, container, length);
+  }
+}
+
+// Sends the queued messages once the window has passed, or right away with
+// flush set, and unpacks received containers. Nothing is sent from here
+// without a call: write_message() checks the window before queueing, poll()
+// after every loop(), and the core's blocking waits flush; delay() doesn't
+// (see enableContainers()).
+void BeanSerialTransport::containerPump(bool flush) {
+  // Sending, or delivering a message, can come back here
+  static bool pumping = false;
+  if (pumping) {
+    return;
+  }
+  pumping = true;
+
+  if (container_count > 0 &&
+      (flush || millis() - container_millis >= CONTAINER_WINDOW_MS)) {
+    containerSend();
+  }
+  if (flush || !container_slot.updated) {
+    pumping = false;
+    return;
+  }
+
+  // The slot isn't written again until updated is cleared
+  uint8_t i = 0;
+  while (i + CONTAINER_HEADER_LENGTH <= container_slot.length) {
+    uint16_t messageId = (container_rx[i] << 8) | container_rx[i + 1];
+    uint8_t length = container_rx[i + 2];
+    i += CONTAINER_HEADER_LENGTH;
+    if (i + length > container_slot.length) {
+      break;
+    }
+    deliver_message(messageId, &container_rx[i], length);
+    i += length;
+  }
+  container_slot.updated = false;
+  pumping = false;
+}
@@ -0,0 +1,306 @@
+#ifndef BEAN_FRAME_CODEC_H
+#define BEAN_FRAME_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The framing spoken between the ATmega and the CC. It has no dependencies,
+// so the core and the host tools in host/ build from this one copy. A frame
+// on the wire is
+//
+//   SOF [length][ID hi][ID lo][body][CRC, MSB first] EOF
+//
+// where length counts the ID and the body, and the CRC is zlib's CRC-32 of
+// length, ID and body. Between SOF and EOF, SOF, EOF and ESC bytes are sent
+// as ESC followed by the byte XOR FRAME_ESCAPE_XOR.
+//
+// FrameEncoder writes a frame a byte at a time, so it never has to be held
+// whole. FrameDecoder parses one a byte at a time and says what each byte
+// was, so the RX interrupt can route the body as it arrives. FrameParser
+// collects whole frames, for code that has the RAM.
+
+#define FRAME_SOF (0x7E)
+#define FRAME_EOF (0x7F)
+#define FRAME_ESCAPE (0x7D)
+#define FRAME_ESCAPE_XOR (0x20)
+#define FRAME_ID_LENGTH (2)
+#define FRAME_CRC_LENGTH (4)
+#define FRAME_MAX_BODY_LENGTH (0xFF - FRAME_ID_LENGTH)
+// Bytes a frame with a body of n bytes takes before escaping
+#define FRAME_ENCODED_LENGTH(n) \
+  (2 + 1 + FRAME_ID_LENGTH + (n) + FRAME_CRC_LENGTH)
+// Most bytes a frame with a body of n bytes can take on the wire
+#define FRAME_MAX_ENCODED_LENGTH(n) \
+  (2 + 2 * (1 + FRAME_ID_LENGTH + (n) + FRAME_CRC_LENGTH))
+
+// CRC-32 as zlib computes it, continued from crc over one more byte. Start
+// from 0.
+inline uint32_t frameCrc32(uint32_t crc, uint8_t c) {
+  crc = ~crc ^ c;
+  for (uint8_t k = 0; k < 8; k++) {
+    crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320UL : crc >> 1;
+  }
+  return ~crc;
+}
+
+inline uint32_t frameCrc32(uint32_t crc, const uint8_t *buf, size_t len) {
+  while (len--) {
+    crc = frameCrc32(crc, *buf++);
+  }
+  return crc;
+}
+
+inline bool frameNeedsEscape(uint8_t c) {
+  return c == FRAME_SOF || c == FRAME_EOF || c == FRAME_ESCAPE;
+}
+
+// Encodes into sink.put(uint8_t), one wire byte at a time. Every ESC the
+// sink is given starts an escape.
+template <typename Sink>
+class FrameEncoder {
+ public:
+  explicit FrameEncoder(Sink &sink) : m_sink(sink), m_crc(0) {}
+
+  void begin(uint16_t messageId, uint8_t bodyLength) {
+    m_crc = 0;
+    m_sink.put(FRAME_SOF);
+    byte(bodyLength + FRAME_ID_LENGTH);
+    byte((uint8_t)(messageId >> 8));
+    byte((uint8_t)(messageId & 0xFF));
+  }
+
+  void byte(uint8_t c) {
+    m_crc = frameCrc32(m_crc, c);
+    put(c);
+  }
+
+  void end(void) {
+    put((uint8_t)(m_crc >> 24));
+    put((uint8_t)(m_crc >> 16));
+    put((uint8_t)(m_crc >> 8));
+    put((uint8_t)m_crc);
+    m_sink.put(FRAME_EOF);
+  }
+
+ private:
+  void put(uint8_t c) {
+    if (frameNeedsEscape(c)) {
+      m_sink.put(FRAME_ESCAPE);
+      m_sink.put(c ^ FRAME_ESCAPE_XOR);
+    } else {
+      m_sink.put(c);
+    }
+  }
+
+  Sink &m_sink;
+  uint32_t m_crc;
+};
+
+// A sink that fills a buffer. length() keeps counting past the end of it.
+class FrameBufferSink {
+ public:
+  FrameBufferSink(uint8_t *buffer, size_t size)
+      : m_buffer(buffer), m_size(size), m_length(0) {}
+  void put(uint8_t c) {
+    if (m_length < m_size) {
+      m_buffer[m_length] = c;
+    }
+    m_length++;
+  }
+  size_t length(void) const { return m_length; }
+
+ private:
+  uint8_t *m_buffer;
+  size_t m_size;
+  size_t m_length;
+};
+
+// Encodes a whole frame into out. Returns its length, which is more than
+// size if it didn't fit.
+inline size_t frameEncode(uint16_t messageId, const uint8_t *body,
+                          uint8_t bodyLength, uint8_t *out, size_t size) {
+  FrameBufferSink sink(out, size);
+  FrameEncoder<FrameBufferSink> encoder(sink);
+  encoder.begin(messageId, bodyLength);
+  for (uint8_t i = 0; i < bodyLength; i++) {
+    encoder.byte(body[i]);
+  }
+  encoder.end();
+  return sink.length();
+}
+
+typedef enum {
+  FRAME_EVENT_NONE,       // nothing for the caller yet
+  FRAME_EVENT_ID,         // messageId() and bodyLength() are known
+  FRAME_EVENT_BODY,       // byte() is the next body byte
+  FRAME_EVENT_FRAME,      // the frame ended, and its CRC checks out
+  FRAME_EVENT_CRC_ERROR,  // the frame ended, but its CRC doesn't
+  FRAME_EVENT_RESET       // the frame was cut short by a byte out of place
+} FRAME_EVENT_T;
+
+class FrameDecoder {
+ public:
+  FrameDecoder() : m_state(WAITING_FOR_SOF), m_escaping(false) {}
+
+  void reset(void) {
+    m_state = WAITING_FOR_SOF;
+    m_escaping = false;
+  }
+
+  FRAME_EVENT_T feed(uint8_t c) {
+    bool escaped = m_escaping;
+
+    if (m_state == WAITING_FOR_SOF) {
+      if (c == FRAME_SOF) {
+        m_state = GETTING_LENGTH;
+      }
+      return FRAME_EVENT_NONE;
+    }
+    if (m_escaping) {
+      c ^= FRAME_ESCAPE_XOR;
+      m_escaping = false;
+    } else if (c == FRAME_ESCAPE) {
+      m_escaping = true;
+      return FRAME_EVENT_NONE;
+    } else if (c == FRAME_SOF || (c == FRAME_EOF && m_state != GETTING_EOF)) {
+      // An SOF where it doesn't belong starts the next frame
+      m_state = (c == FRAME_SOF) ? GETTING_LENGTH : WAITING_FOR_SOF;
+      return FRAME_EVENT_RESET;
+    }
+
+    switch (m_state) {
+      case GETTING_LENGTH:
+        if (c < FRAME_ID_LENGTH) {
+          m_state = WAITING_FOR_SOF;
+          return FRAME_EVENT_RESET;
+        }
+        m_length = c - FRAME_ID_LENGTH;
+        m_crc = frameCrc32(0, c);
+        m_state = GETTING_ID_HI;
+        return FRAME_EVENT_NONE;
+
+      case GETTING_ID_HI:
+        m_messageId = (uint16_t)c << 8;
+        m_crc = frameCrc32(m_crc, c);
+        m_state = GETTING_ID_LO;
+        return FRAME_EVENT_NONE;
+
+      case GETTING_ID_LO:
+        m_messageId |= c;
+        m_crc = frameCrc32(m_crc, c);
+        m_remaining = m_length;
+        if (m_remaining == 0) {
+          startCrc();
+        } else {
+          m_state = GETTING_BODY;
+        }
+        return FRAME_EVENT_ID;
+
+      case GETTING_BODY:
+        m_byte = c;
+        m_crc = frameCrc32(m_crc, c);
+        if (--m_remaining == 0) {
+          startCrc();
+        }
+        return FRAME_EVENT_BODY;
+
+      case GETTING_CRC:
+        m_rxCrc = (m_rxCrc << 8) | c;
+        if (--m_remaining == 0) {
+          m_state = GETTING_EOF;
+        }
+        return FRAME_EVENT_NONE;
+
+      default:  // GETTING_EOF
+        m_state = WAITING_FOR_SOF;
+        if (escaped || c != FRAME_EOF) {
+          return FRAME_EVENT_RESET;
+        }
+        return m_rxCrc == m_crc ? FRAME_EVENT_FRAME : FRAME_EVENT_CRC_ERROR;
+    }
+  }
+
+  uint16_t messageId(void) const { return m_messageId; }
+  uint8_t bodyLength(void) const { return m_length; }
+  uint8_t byte(void) const { return m_byte; }
+
+ private:
+  void startCrc(void) {
+    m_state = GETTING_CRC;
+    m_remaining = FRAME_CRC_LENGTH;
+    m_rxCrc = 0;
+  }
+
+  enum {
+    WAITING_FOR_SOF,
+    GETTING_LENGTH,
+    GETTING_ID_HI,
+    GETTING_ID_LO,
+    GETTING_BODY,
+    GETTING_CRC,
+    GETTING_EOF
+  };
+
+  uint8_t m_state;
+  bool m_escaping;
+  uint8_t m_length;
+  uint8_t m_remaining;
+  uint8_t m_byte;
+  uint16_t m_messageId;
+  uint32_t m_crc;
+  uint32_t m_rxCrc;
+};
+
+// Collects the body of each frame. Frames with bodies longer than Capacity
+// are counted in oversize and dropped.
+template <size_t Capacity = FRAME_MAX_BODY_LENGTH>
+class FrameParser {
+ public:
+  FrameParser() : crcErrors(0), resets(0), oversize(0), m_length(0) {}
+
+  // True once a whole frame with a good CRC has been fed. Its ID and body
+  // stay put until the next call.
+  bool feed(uint8_t c) {
+    switch (m_decoder.feed(c)) {
+      case FRAME_EVENT_ID:
+        m_length = 0;
+        break;
+      case FRAME_EVENT_BODY:
+        if (m_length < Capacity) {
+          m_body[m_length] = m_decoder.byte();
+        }
+        m_length++;
+        break;
+      case FRAME_EVENT_FRAME:
+        if (m_length <= Capacity) {
+          return true;
+        }
+        oversize++;
+        break;
+      case FRAME_EVENT_CRC_ERROR:
+        crcErrors++;
+        break;
+      case FRAME_EVENT_RESET:
+        resets++;
+        break;
+      default:
+        break;
+    }
+    return false;
+  }
+
+  uint16_t messageId(void) const { return m_decoder.messageId(); }
+  const uint8_t *body(void) const { return m_body; }
+  size_t length(void) const { return m_length; }
+
+  uint32_t crcErrors;
+  uint32_t resets;
+  uint32_t oversize;
+
+ private:
+  FrameDecoder m_decoder;
+  uint8_t m_body[Capacity > 0 ? Capacity : 1];
+  size_t m_length;
+};
+
+#endif
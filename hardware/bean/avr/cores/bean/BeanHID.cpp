@@ -474,6 +474,8 @@ void BeanHid_::releaseAllMediaControls() {
 // call release(), releaseAll(), or otherwise clear the report and resend.
 size_t BeanHid_::_holdKey(uint8_t k) {
   uint8_t i;
+  // Keys that aren't sent return before PROFILE_END(), and aren't counted
+  PROFILE_BEGIN(PROFILE_HID_KEY);
   if (k >= 136) {  // it's a non-printing key (not a modifier)
     k = k - 136;
   } else if (k >= 128) {  // it's a modifier key
@@ -509,6 +511,7 @@ size_t BeanHid_::_holdKey(uint8_t k) {
       return 0;
     }
   }
+  PROFILE_END(PROFILE_HID_KEY);
   sendReport(&_keyReport);
   return 1;
 }
@@ -0,0 +1,120 @@
+#include "Arduino.h"
+#include "BeanLatency.h"
+#include "BeanSerialTransport.h"
+
+// The probe's ISR lives in this file, and init() pulls it in only for
+// sketches built with BEAN_LATENCY.
+
+#if defined(BEAN_LATENCY)
+
+static LatencyHistogram entry_latency;
+static LatencyHistogram off_windows;
+static LatencySite latency_sites[BEAN_LATENCY_SITES];
+
+static void count_in(LatencyHistogram *histogram, uint16_t cycles) {
+  uint8_t bin = 0;
+  uint16_t limit = 16;
+  while (bin < LATENCY_BINS - 1 && cycles >= limit) {
+    limit <<= 1;
+    bin++;
+  }
+  histogram->bins[bin]++;
+  histogram->count++;
+  if (cycles < histogram->min_cycles) {
+    histogram->min_cycles = cycles;
+  }
+  if (cycles > histogram->max_cycles) {
+    histogram->max_cycles = cycles;
+  }
+}
+
+static void reset_histogram(LatencyHistogram *histogram) {
+  memset(histogram, 0, sizeof(*histogram));
+  histogram->min_cycles = 0xFFFF;
+}
+
+void latencyReset(void) {
+  uint8_t oldSREG = SREG;
+  cli();
+  reset_histogram(&entry_latency);
+  reset_histogram(&off_windows);
+  memset(latency_sites, 0, sizeof(latency_sites));
+  SREG = oldSREG;
+}
+
+void latencyBegin(void) {
+  latencyReset();
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  OCR1B = TCNT1 + BEAN_LATENCY_PROBE_PERIOD;
+  TIFR1 = _BV(OCF1B);
+  TIMSK1 |= _BV(OCIE1B);
+}
+
+// Called with interrupts off, from ISRs too
+void latencyCount(uint8_t site, uint16_t cycles) {
+  count_in(&off_windows, cycles);
+  if (site < BEAN_LATENCY_SITES) {
+    LatencySite *counted = &latency_sites[site];
+    if (counted->count++ == 0 || cycles < counted->min_cycles) {
+      counted->min_cycles = cycles;
+    }
+    if (cycles > counted->max_cycles) {
+      counted->max_cycles = cycles;
+    }
+  }
+}
+
+ISR(TIMER1_COMPB_vect) {
+  uint16_t late = TCNT1 - OCR1B;
+  OCR1B += BEAN_LATENCY_PROBE_PERIOD;
+  count_in(&entry_latency, late);
+}
+
+void getLatencyHistograms(LatencyHistogram *entry, LatencyHistogram *windows) {
+  uint8_t oldSREG = SREG;
+  cli();
+  *entry = entry_latency;
+  *windows = off_windows;
+  SREG = oldSREG;
+}
+
+void getLatencySites(LatencySite *sites) {
+  uint8_t oldSREG = SREG;
+  cli();
+  memcpy(sites, latency_sites, sizeof(latency_sites));
+  SREG = oldSREG;
+}
+
+void BeanSerialTransport::debugWriteLatency(void) {
+  uint8_t body[1 + sizeof(LatencyHistogram)];
+  LatencyHistogram entry, windows;
+  getLatencyHistograms(&entry, &windows);
+
+  body[0] = LATENCY_REPORT_ENTRY;
+  memcpy(body + 1, &entry, sizeof(entry));
+  write_message(MSG_ID_DB_LATENCY, body, sizeof(body));
+  body[0] = LATENCY_REPORT_WINDOWS;
+  memcpy(body + 1, &windows, sizeof(windows));
+  write_message(MSG_ID_DB_LATENCY, body, sizeof(body));
+
+  LatencySite sites[BEAN_LATENCY_SITES];
+  getLatencySites(sites);
+  body[0] = LATENCY_REPORT_SITE;
+  for (uint8_t i = 0; i < BEAN_LATENCY_SITES; i++) {
+    if (sites[i].count == 0) {
+      continue;
+    }
+    body[1] = i;
+    memcpy(body + 2, &sites[i], sizeof(LatencySite));
+    write_message(MSG_ID_DB_LATENCY, body, 2 + sizeof(LatencySite));
+  }
+}
+
+#else
+
+void BeanSerialTransport::debugWriteLatency(void) {
+  write_message(MSG_ID_DB_LATENCY, NULL, 0);
+}
+
+#endif
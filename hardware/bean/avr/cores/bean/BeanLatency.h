@@ -0,0 +1,138 @@
+#ifndef BEAN_LATENCY_H
+#define BEAN_LATENCY_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+// How long interrupts wait, for sketches with deadlines of their own. Built
+// with BEAN_LATENCY defined (Tools > Latency probe in the IDE), Timer1
+// free-runs at the CPU clock, as it does for the profiler, and keeps two
+// histograms:
+//
+//  - ISR entry latency. Timer1's compare B interrupt fires every
+//    BEAN_LATENCY_PROBE_PERIOD cycles and notes how long after its compare
+//    match it got to read TCNT1. That is its fixed entry cost (the histogram's
+//    least) plus whatever kept it waiting: a window with interrupts off, or
+//    another ISR running. The probe takes 1 or 2% of the CPU.
+//
+//  - Interrupts-off windows. The core's critical sections below are timed
+//    from cli() to just before interrupts come back on, and the RX ISR from
+//    entry to return. Each site also keeps its count, shortest and longest.
+//
+// Serial.debugWriteLatency() sends both, and the sites, as MSG_ID_DB_LATENCY
+// messages, which BeanCCStandIn.py prints. Without BEAN_LATENCY the macros are
+// empty, and it sends a single empty message.
+//
+// Counting a window takes a few dozen cycles, with interrupts still off, so
+// instrumented windows are that much longer than they would be. A window of
+// 65536 cycles or more (SoftwareSerial below 1200 baud) is counted modulo
+// 65536. Timer1's pins lose their PWM.
+
+// The timed windows; sketches number theirs from LATENCY_USER.
+enum {
+  LATENCY_MILLIS,           // millis() reading timer0_millis
+  LATENCY_REQUEST,          // request() resetting the reply buffer
+  LATENCY_SLEEP,            // Bean.sleep() checking the wake line
+  LATENCY_SOFTWARE_SERIAL,  // SoftwareSerial::write(), the whole byte
+  LATENCY_USART_RX,         // the RX ISR, entry to return
+  LATENCY_USER
+};
+
+#ifndef BEAN_LATENCY_SITES
+#define BEAN_LATENCY_SITES (8)
+#endif
+
+// Not a multiple of anything periodic in the core, so the probe lands
+// all over timer0's and the UART's interrupts.
+#ifndef BEAN_LATENCY_PROBE_PERIOD
+#define BEAN_LATENCY_PROBE_PERIOD (4999)
+#endif
+
+// Bin 0 counts latencies under 16 cycles, bin n under 16 << n, and the last
+// everything from 16384 up.
+#define LATENCY_BINS (12)
+
+// What a MSG_ID_DB_LATENCY message holds; its body starts with one of these.
+enum {
+  LATENCY_REPORT_ENTRY,    // then a LatencyHistogram
+  LATENCY_REPORT_WINDOWS,  // then a LatencyHistogram
+  LATENCY_REPORT_SITE      // then the site's id and its LatencySite
+};
+
+// Sent as-is (little endian, no padding).
+struct LatencyHistogram {
+  uint32_t count;
+  uint16_t min_cycles;
+  uint16_t max_cycles;
+  uint32_t bins[LATENCY_BINS];
+};
+
+struct LatencySite {
+  uint32_t count;
+  uint16_t min_cycles;
+  uint16_t max_cycles;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(BEAN_LATENCY)
+
+// Both with interrupts off; BEGIN right after cli(), END right before they
+// come back on. Like the profiler's, site has to be a plain name or number.
+#define LATENCY_OFF_BEGIN(site) uint16_t latency_start_##site = TCNT1
+#define LATENCY_OFF_END(site) \
+  latencyCount((site), TCNT1 - latency_start_##site)
+
+void latencyCount(uint8_t site, uint16_t cycles);
+void latencyReset(void);
+// Starts Timer1 and the probe; called by init()
+void latencyBegin(void);
+// Copies of the histograms, and the sites' table
+void getLatencyHistograms(struct LatencyHistogram *entry,
+                          struct LatencyHistogram *windows);
+void getLatencySites(struct LatencySite *sites);
+
+#else
+
+#define LATENCY_OFF_BEGIN(site) \
+  do {                          \
+  } while (0)
+#define LATENCY_OFF_END(site) \
+  do {                        \
+  } while (0)
+
+static inline void latencyReset(void) {}
+
+#endif
+
+#ifdef __cplusplus
+}  // extern "C"
+
+#if defined(BEAN_LATENCY)
+
+// Times a scope with more than one way out, an ISR's body say.
+class LatencyScope {
+ public:
+  explicit LatencyScope(uint8_t site) : site_(site), start_(TCNT1) {}
+  ~LatencyScope() { latencyCount(site_, TCNT1 - start_); }
+
+ private:
+  uint8_t site_;
+  uint16_t start_;
+};
+
+#define LATENCY_SCOPE(site) LatencyScope latency_scope_##site(site)
+
+#else
+
+#define LATENCY_SCOPE(site) \
+  do {                      \
+  } while (0)
+
+#endif
+
+#endif
+
+#endif
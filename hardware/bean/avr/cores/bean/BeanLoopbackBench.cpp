@@ -0,0 +1,158 @@
+#include <string.h>
+#include "Arduino.h"
+#include "BeanSerialTransport.h"
+
+// The loopback benchmark lives in its own file so sketches that never run it
+// don't carry it.
+
+// Four bins an octave: 0-3 us get a bin each, then bin 4 * (e - 1) + s holds
+// values whose top bit is e and whose next two bits are s. 80 bins reach
+// past the longest timeout.
+#define LOOPBACK_BINS (80)
+
+static uint8_t loopback_bin(uint32_t us) {
+  if (us < 4) {
+    return us;
+  }
+  uint8_t e = 2;
+  while (e < 31 && (us >> (e + 1)) != 0) {
+    e++;
+  }
+  uint8_t bin = 4 * (e - 1) + ((us >> (e - 2)) & 3);
+  return min(bin, LOOPBACK_BINS - 1);
+}
+
+// The middle of a bin
+static uint32_t loopback_bin_value(uint8_t bin) {
+  if (bin < 4) {
+    return bin;
+  }
+  uint8_t e = bin / 4 + 1;
+  uint32_t width = 1UL << (e - 2);
+  return (4 + bin % 4) * width + width / 2;
+}
+
+static uint32_t loopback_percentile(const uint16_t *bins, uint16_t count,
+                                    uint8_t percent,
+                                    const LoopbackBenchResult *result) {
+  // The sample the percentile falls on, counting from 1
+  uint32_t rank = ((uint32_t)count * percent + 99) / 100;
+  uint32_t seen = 0;
+  uint8_t bin = 0;
+  while (bin < LOOPBACK_BINS - 1 && seen + bins[bin] < rank) {
+    seen += bins[bin++];
+  }
+  return constrain(loopback_bin_value(bin), result->min_us, result->max_us);
+}
+
+int BeanSerialTransport::debugLoopbackBenchmark(uint8_t size,
+                                                uint16_t iterations,
+                                                LoopbackBenchResult *result,
+                                                bool endToEnd) {
+  MSG_ID_T messageId = endToEnd ? MSG_ID_DB_E2E_LOOPBACK : MSG_ID_DB_LOOPBACK;
+  uint8_t message[MAX_BODY_LENGTH];
+  uint8_t reply[MAX_BODY_LENGTH];
+  uint16_t bins[LOOPBACK_BINS];
+
+  memset(result, 0, sizeof(*result));
+  memset(bins, 0, sizeof(bins));
+  if (size == 0 || size > MAX_BODY_LENGTH || iterations == 0) {
+    return -1;
+  }
+  result->size = size;
+  result->iterations = iterations;
+  result->min_us = 0xFFFFFFFF;
+
+  // A retry would hide a lost frame in a slow round trip
+  uint8_t retries = m_requestRetries;
+  m_requestRetries = 0;
+
+  uint16_t completed = 0;
+  uint32_t start = micros();
+  for (uint16_t i = 0; i < iterations; i++) {
+    // Different bytes every time, so a late reply to an earlier request
+    // doesn't pass
+    for (uint8_t j = 0; j < size; j++) {
+      message[j] = (uint8_t)(i + j * 7);
+    }
+
+    size_t reply_length = sizeof(reply);
+    uint32_t sent = micros();
+    // A fixed, generous timeout: the adaptive one can sit below a long
+    // round trip at a slow link rate, and the late reply would then fail the
+    // next iteration too
+    int response = call_and_response(messageId, message, size, reply,
+                                     &reply_length, RTT_MAX_TIMEOUT_MS);
+    uint32_t rtt = micros() - sent;
+
+    if (response != 0 || reply_length != size ||
+        memcmp(message, reply, size) != 0) {
+      result->failures++;
+      continue;
+    }
+    completed++;
+    bins[loopback_bin(rtt)]++;
+    result->min_us = min(result->min_us, rtt);
+    result->max_us = max(result->max_us, rtt);
+  }
+  result->elapsed_us = micros() - start;
+  m_requestRetries = retries;
+
+  if (completed == 0) {
+    result->min_us = 0;
+    return -1;
+  }
+  result->median_us = loopback_percentile(bins, completed, 50, result);
+  result->p99_us = loopback_percentile(bins, completed, 99, result);
+
+  uint32_t elapsed_ms = max(result->elapsed_us / 1000, 1UL);
+  uint32_t bytes = (uint32_t)completed * 2 * size;
+  result->frames_per_s = (uint32_t)completed * 2 * 1000 / elapsed_ms;
+  // In two parts, as bytes * 1000 can overflow
+  result->bytes_per_s = bytes / elapsed_ms * 1000 +
+                        bytes % elapsed_ms * 1000 / elapsed_ms;
+
+  return result->failures == 0 ? 0 : -1;
+}
+
+void BeanSerialTransport::debugLoopbackSweep(uint16_t iterations,
+                                             Print *report, bool endToEnd) {
+  if (report) {
+    report->println(F("size\tn\tfail\tmin_us\tmed_us\tp99_us\tmax_us\t"
+                      "frames/s\tbytes/s"));
+  }
+
+  uint8_t size = 1;
+  for (;;) {
+    LoopbackBenchResult result;
+    debugLoopbackBenchmark(size, iterations, &result, endToEnd);
+
+    if (report) {
+      report->print(result.size);
+      report->print('\t');
+      report->print(result.iterations);
+      report->print('\t');
+      report->print(result.failures);
+      report->print('\t');
+      report->print(result.min_us);
+      report->print('\t');
+      report->print(result.median_us);
+      report->print('\t');
+      report->print(result.p99_us);
+      report->print('\t');
+      report->print(result.max_us);
+      report->print('\t');
+      report->print(result.frames_per_s);
+      report->print('\t');
+      report->println(result.bytes_per_s);
+    } else {
+      write_message(MSG_ID_DB_LOOPBACK_BENCH, (const uint8_t *)&result,
+                    sizeof(result));
+    }
+
+    if (size == MAX_BODY_LENGTH) {
+      break;
+    }
+    size = min(size * 2, MAX_BODY_LENGTH);
+  }
+}
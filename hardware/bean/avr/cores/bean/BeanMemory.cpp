@@ -0,0 +1,77 @@
+#include "Arduino.h"
+#include "BeanMemory.h"
+#include "BeanSerialTransport.h"
+
+extern "C" {
+#include "avr-libc/stdlib_private.h"
+}
+
+// Memory stats live in their own file, which is also what pulls in the
+// stack paint below: sketches that never ask don't pay for either.
+
+#define STACK_PAINT (0xC5)
+
+// Runs from .init1, before .init2 sets up the stack pointer and the zero
+// register, so it can't call anything or use the stack. Paints from _end,
+// the end of .bss, up to and including __stack, the top of RAM.
+extern "C" void stack_paint(void) __attribute__((naked, used,
+                                                 section(".init1")));
+
+void stack_paint(void) {
+  asm volatile(
+      "  ldi r30, lo8(_end)\n"
+      "  ldi r31, hi8(_end)\n"
+      "  ldi r24, %0\n"
+      "  ldi r25, hi8(__stack)\n"
+      "  rjmp 2f\n"
+      "1:\n"
+      "  st Z+, r24\n"
+      "2:\n"
+      "  cpi r30, lo8(__stack)\n"
+      "  cpc r31, r25\n"
+      "  brlo 1b\n"
+      "  breq 1b\n" ::"M"(STACK_PAINT));
+}
+
+static char *heap_top(void) {
+  return __brkval ? __brkval : __malloc_heap_start;
+}
+
+uint16_t freeStack(void) {
+  char *top = heap_top();
+  char *sp = STACK_POINTER();
+  return sp > top ? sp - top : 0;
+}
+
+void getMemoryStats(MemoryStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+
+  char *top = heap_top();
+  char *peak = max(__malloc_heap_peak, top);
+  stats->heap_size = top - __malloc_heap_start;
+  stats->heap_peak = peak - __malloc_heap_start;
+  for (struct __freelist *fp = __flp; fp; fp = fp->nx) {
+    stats->free_chunks++;
+    stats->heap_free += fp->sz + sizeof(size_t);
+    stats->largest_free = max(stats->largest_free, fp->sz);
+  }
+  stats->malloc_failures = __malloc_failures;
+
+  stats->heap_in_use = stats->heap_size - stats->heap_free;
+  stats->stack_free = freeStack();
+
+  // The heap has overwritten the paint as far as its peak; above that, the
+  // first byte without paint is as deep as the stack has been
+  const uint8_t *p = (const uint8_t *)peak;
+  while (p < (const uint8_t *)STACK_POINTER() && *p == STACK_PAINT) {
+    p++;
+  }
+  stats->stack_headroom = p - (const uint8_t *)peak;
+}
+
+void BeanSerialTransport::debugWriteMemoryStats(void) {
+  MemoryStats stats;
+  getMemoryStats(&stats);
+  write_message(MSG_ID_DB_MEMORY_STATS, (const uint8_t *)&stats,
+                sizeof(stats));
+}
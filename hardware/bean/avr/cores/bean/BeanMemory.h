@@ -0,0 +1,36 @@
+#ifndef BEAN_MEMORY_H
+#define BEAN_MEMORY_H
+
+#include <stdint.h>
+
+// Where the ATmega328P's 2 KB of SRAM is going. The heap grows up from the
+// end of .bss, the stack down from the top of RAM, and nothing stops them
+// meeting: malloc() only keeps __malloc_margin (128) bytes below the stack
+// pointer as it is at the time, and a String that can't grow just stays as
+// it was.
+//
+// A sketch that uses any of this has the space between .bss and the top of
+// RAM painted before the stack is set up, so the deepest the stack has gone
+// can be read back from how much paint is left.
+
+// Sent as-is (little endian, no padding) by Serial.debugWriteMemoryStats().
+struct MemoryStats {
+  uint16_t stack_free;       // between the top of the heap and the stack
+  uint16_t stack_headroom;   // paint left above the heap's peak: the least
+                             // room the stack has had
+  uint16_t heap_size;        // from the start of the heap to __brkval
+  uint16_t heap_peak;        // the most heap_size has been
+  uint16_t heap_in_use;      // handed out by malloc(), size words included
+  uint16_t heap_free;        // on the free list, size words included
+  uint16_t free_chunks;      // free list length
+  uint16_t largest_free;     // the most malloc() can give without growing
+  uint16_t malloc_failures;  // malloc() and realloc() calls that got NULL
+};
+
+// Bytes between the top of the heap and the stack pointer, right now
+uint16_t freeStack(void);
+
+// Walks the free list, and the paint above the heap
+void getMemoryStats(MemoryStats *stats);
+
+#endif
@@ -68,7 +68,7 @@ int BeanMidiClass::sendMessages() {
   midiPacket[byteOffset++] = head_ts;
   // now some messages
   int lastStatus = -1;
-  int lastTime = -1;
+  uint32_t lastTime = 0xFFFFFFFF;
   while (midiReadOffset != midiWriteOffset) {
     if (lastStatus == midiMessages[midiReadOffset].status &&
         lastTime == midiMessages[midiReadOffset].timestamp) {
@@ -162,7 +162,7 @@ int BeanMidiClass::sendMessage(uint8_t *buff, uint8_t numBytes) {
  */
 int BeanMidiClass::sendMessage(uint8_t status, uint8_t byte1, uint8_t byte2) {
   loadMessage(status, byte1, byte2);
-  sendMessages();
+  return sendMessages();
 }
 
 /**
@@ -0,0 +1,66 @@
+#include "Arduino.h"
+#include "BeanProfile.h"
+#include "BeanSerialTransport.h"
+
+// The profiler's table lives in its own file so sketches built without
+// BEAN_PROFILE don't carry it.
+
+#if defined(BEAN_PROFILE)
+
+static ProfileSection profile_sections[BEAN_PROFILE_SECTIONS];
+static bool profile_ready = false;
+
+void profileReset(void) {
+  memset(profile_sections, 0, sizeof(profile_sections));
+  for (uint8_t i = 0; i < BEAN_PROFILE_SECTIONS; i++) {
+    profile_sections[i].min_cycles = 0xFFFF;
+  }
+  profile_ready = true;
+}
+
+void profileCount(uint8_t id, uint16_t cycles) {
+  if (id >= BEAN_PROFILE_SECTIONS) {
+    return;
+  }
+  if (!profile_ready) {
+    profileReset();
+  }
+
+  ProfileSection *section = &profile_sections[id];
+  section->count++;
+  section->total_cycles += cycles;
+  if (cycles < section->min_cycles) {
+    section->min_cycles = cycles;
+  }
+  if (cycles > section->max_cycles) {
+    section->max_cycles = cycles;
+  }
+}
+
+const ProfileSection *profileSections(void) {
+  if (!profile_ready) {
+    profileReset();
+  }
+  return profile_sections;
+}
+
+void BeanSerialTransport::debugWriteProfile(void) {
+  const ProfileSection *sections = profileSections();
+  uint8_t body[1 + sizeof(ProfileSection)];
+  for (uint8_t i = 0; i < BEAN_PROFILE_SECTIONS; i++) {
+    if (sections[i].count == 0) {
+      continue;
+    }
+    body[0] = i;
+    memcpy(body + 1, &sections[i], sizeof(ProfileSection));
+    write_message(MSG_ID_DB_PROFILE, body, sizeof(body));
+  }
+}
+
+#else
+
+void BeanSerialTransport::debugWriteProfile(void) {
+  write_message(MSG_ID_DB_PROFILE, NULL, 0);
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef BEAN_PROFILE_H
+#define BEAN_PROFILE_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+// Cycle counts of code sections, for hot paths micros() is too coarse for:
+//
+//   PROFILE_BEGIN(PROFILE_USER);
+//   filter(samples);
+//   PROFILE_END(PROFILE_USER);
+//
+//   Serial.debugWriteProfile();
+//
+// Built with BEAN_PROFILE defined (Tools > Profiler in the IDE), Timer1
+// free-runs at the CPU clock and each section keeps a count and the min, max
+// and total cycles it took. Without it the macros are empty, and
+// debugWriteProfile() sends a single empty message.
+//
+// Timer1 wraps every 65536 cycles (8 ms on a Bean, 4 ms on a Bean+), so a
+// section has to be shorter than that; one that isn't is counted modulo
+// 65536. An empty section counts as a few cycles. Timer1's pins lose their
+// PWM, and sections can't run in ISRs, as reading TCNT1 there corrupts the
+// read it interrupted. Sections can nest, and an id can be ended from
+// more than one place, but it has to be a plain name or number: it names a
+// local that PROFILE_BEGIN() declares.
+
+// The core's own sections; sketches number theirs from PROFILE_USER.
+enum {
+  PROFILE_WRITE_FRAME,  // encoding a frame into the tx buffer
+  PROFILE_HID_KEY,      // BeanHid looking up a key held, before it's sent
+  PROFILE_PRINT_FLOAT,  // Print::printFloat() of a finite number, writes
+                        // included
+  PROFILE_USER
+};
+
+#ifndef BEAN_PROFILE_SECTIONS
+#define BEAN_PROFILE_SECTIONS (8)
+#endif
+
+// One section. debugWriteProfile() sends a MSG_ID_DB_PROFILE message for
+// each that has run, its id followed by this as-is (little endian, no
+// padding).
+struct ProfileSection {
+  uint32_t total_cycles;
+  uint32_t count;
+  uint16_t min_cycles;
+  uint16_t max_cycles;
+};
+
+#if defined(BEAN_PROFILE)
+
+#if defined(BEAN_LATENCY)
+// BeanLatency.h's ISRs read Timer1 too, so reads here can't be interrupted
+#include <avr/interrupt.h>
+
+static inline uint16_t profile_now(void) {
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t now = TCNT1;
+  SREG = oldSREG;
+  return now;
+}
+#else
+#define profile_now() TCNT1
+#endif
+
+#define PROFILE_BEGIN(id) uint16_t profile_start_##id = profile_now()
+#define PROFILE_END(id) profileCount((id), profile_now() - profile_start_##id)
+
+void profileCount(uint8_t id, uint16_t cycles);
+void profileReset(void);
+const ProfileSection *profileSections(void);
+
+#else
+
+#define PROFILE_BEGIN(id) \
+  do {                    \
+  } while (0)
+#define PROFILE_END(id) \
+  do {                  \
+  } while (0)
+
+inline void profileReset(void) {}
+
+#endif
+
+#endif
@@ -0,0 +1,197 @@
+#include <string.h>
+#include "Arduino.h"
+#include "BeanSerialTransport.h"
+
+// Send side of reliable mode. Like bulk writes it lives in its own file, so
+// the history below only costs RAM in sketches that call enableReliable();
+// write_message() and poll() only reach it through member pointers. The
+// receive side is in the RX interrupt in BeanSerialTransport.cpp.
+
+extern volatile bool reliable_rx_enabled;
+extern volatile uint8_t reliable_rx_expected;
+extern volatile bool reliable_ack_pending;
+extern volatile uint32_t rx_frame_millis;
+extern ReliableStats reliable_stats;
+
+typedef enum {
+  RELIABLE_PENDING,
+  RELIABLE_SACKED,  // the other end holds it, but can't deliver it yet
+  RELIABLE_GIVEN_UP
+} RELIABLE_STATE_T;
+
+// Frame seq is kept in history[seq % RELIABLE_HISTORY_SIZE] until acked.
+static struct {
+  uint16_t messageId;
+  uint8_t length;
+  uint8_t state;
+  uint8_t retries;
+  bool fastRetransmitted;
+  uint32_t sentMillis;
+  uint8_t body[MAX_BODY_LENGTH];
+} history[RELIABLE_HISTORY_SIZE];
+
+static uint8_t tx_base;  // oldest seq not acked or given up on
+static uint8_t tx_next;  // seq of the next new frame
+
+static uint8_t reliable_ack[2];
+static FrameSlot reliable_ack_slot = {reliable_ack, sizeof(reliable_ack), 0,
+                                      false, 0, NULL};
+
+void BeanSerialTransport::enableReliable(bool enable) {
+  if (enable && m_reliablePump == NULL) {
+    if (!addRoute(MSG_ID_RELIABLE_ACK, MSG_ID_RELIABLE_ACK, SINK_SLOT,
+                  &reliable_ack_slot)) {
+      return;
+    }
+    reliable_ack_slot.updated = false;
+    tx_base = tx_next = 0;
+    memset(&reliable_stats, 0, sizeof(reliable_stats));
+
+    noInterrupts();
+    reliable_rx_expected = 0;
+    reliable_ack_pending = false;
+    reliable_rx_enabled = true;
+    interrupts();
+
+    write_message(MSG_ID_RELIABLE_RESET, NULL, 0);
+    m_reliableWriter = &BeanSerialTransport::reliableWrite;
+    m_reliablePump = &BeanSerialTransport::reliablePump;
+  } else if (!enable && m_reliablePump) {
+    // Let what's in flight be acked, or given up on
+    while (tx_base != tx_next) {
+      reliablePump();
+    }
+    m_reliableWriter = NULL;
+    m_reliablePump = NULL;
+    reliable_rx_enabled = false;
+    removeRoute(MSG_ID_RELIABLE_ACK);
+  }
+}
+
+void BeanSerialTransport::getReliableStats(ReliableStats *stats) {
+  noInterrupts();
+  *stats = reliable_stats;
+  interrupts();
+}
+
+size_t BeanSerialTransport::reliableWrite(uint16_t messageId,
+                                          const uint8_t *body,
+                                          size_t body_length) {
+  // Wait for room in the history. Frames are given up on after enough
+  // resends, so this can't wait forever.
+  while ((uint8_t)(tx_next - tx_base) >= RELIABLE_HISTORY_SIZE) {
+    reliablePump();
+  }
+
+  uint8_t seq = tx_next++;
+  uint8_t i = seq % RELIABLE_HISTORY_SIZE;
+  history[i].messageId = messageId;
+  history[i].length = body_length;
+  history[i].state = RELIABLE_PENDING;
+  history[i].retries = 0;
+  history[i].fastRetransmitted = false;
+  memcpy(history[i].body, body, body_length);
+
+  reliable_stats.sent++;
+  reliableSend(seq);
+  return body_length;
+}
+
+void BeanSerialTransport::reliableSend(uint8_t seq) {
+  uint8_t i = seq % RELIABLE_HISTORY_SIZE;
+
+  wake_cc();
+  begin_frame(MSG_ID_RELIABLE_DATA,
+              RELIABLE_HEADER_LENGTH + history[i].length);
+  frame_byte(seq);
+  frame_byte(tx_base);
+  frame_byte((uint8_t)(history[i].messageId >> 8));
+  frame_byte((uint8_t)(history[i].messageId & 0xFF));
+  for (uint8_t j = 0; j < history[i].length; j++) {
+    frame_byte(history[i].body[j]);
+  }
+  end_frame();
+  history[i].sentMillis = m_frameMillis;
+  send_delay();
+}
+
+void BeanSerialTransport::reliablePump(void) {
+  RttEstimator *rtt = &m_rtt[RTT_CLASS_OTHER];
+
+  if (reliable_ack_pending) {
+    uint8_t ack[2] = {reliable_rx_expected, 0};
+    reliable_ack_pending = false;
+    wake_cc();
+    write_frame(MSG_ID_RELIABLE_ACK, ack, sizeof(ack));
+    send_delay();
+  }
+
+  if (reliable_ack_slot.updated) {
+    noInterrupts();
+    uint8_t cumulative = reliable_ack[0];
+    uint8_t selective = reliable_ack[1];
+    uint32_t ackMillis = rx_frame_millis;
+    reliable_ack_slot.updated = false;
+    interrupts();
+
+    // Acks for anything outside the frames in flight are stale
+    if ((uint8_t)(cumulative - tx_base) <= (uint8_t)(tx_next - tx_base)) {
+      for (; tx_base != cumulative; tx_base++) {
+        uint8_t i = tx_base % RELIABLE_HISTORY_SIZE;
+        // Only frames sent once give an unambiguous RTT (Karn's algorithm)
+        if (history[i].retries == 0 && !history[i].fastRetransmitted &&
+            history[i].state == RELIABLE_PENDING) {
+          rttSample(rtt, min(ackMillis - history[i].sentMillis,
+                             (uint32_t)RTT_MAX_TIMEOUT_MS));
+        }
+      }
+
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        uint8_t seq = cumulative + 1 + bit;
+        if ((selective & (1 << bit)) &&
+            (uint8_t)(seq - tx_base) < (uint8_t)(tx_next - tx_base)) {
+          history[seq % RELIABLE_HISTORY_SIZE].state = RELIABLE_SACKED;
+        }
+      }
+
+      // Something after the oldest frame arrived, so the oldest was lost:
+      // resend it now rather than at the timeout, but only once.
+      uint8_t i = tx_base % RELIABLE_HISTORY_SIZE;
+      if (selective && tx_base != tx_next &&
+          history[i].state == RELIABLE_PENDING &&
+          !history[i].fastRetransmitted) {
+        history[i].fastRetransmitted = true;
+        reliable_stats.fast_retransmits++;
+        reliableSend(tx_base);
+      }
+    }
+  }
+
+  for (uint8_t seq = tx_base; seq != tx_next; seq++) {
+    uint8_t i = seq % RELIABLE_HISTORY_SIZE;
+    if (history[i].state != RELIABLE_PENDING ||
+        millis() - history[i].sentMillis < rtt->rto_ms) {
+      continue;
+    }
+
+    rtt->timeouts++;
+    TRACE(TRACE_TIMEOUT, MSG_ID_RELIABLE_DATA);
+    if (history[i].retries >= RELIABLE_MAX_RETRIES) {
+      rtt->failures++;
+      reliable_stats.given_up++;
+      history[i].state = RELIABLE_GIVEN_UP;
+      continue;
+    }
+    rtt->rto_ms = min(rtt->rto_ms * 2, RTT_MAX_TIMEOUT_MS);
+    history[i].retries++;
+    reliable_stats.retransmits++;
+    reliableSend(seq);
+  }
+
+  // Frames given up on at the front of the history no longer hold it up;
+  // the base sent with the next frame tells the other end to stop waiting.
+  while (tx_base != tx_next &&
+         history[tx_base % RELIABLE_HISTORY_SIZE].state == RELIABLE_GIVEN_UP) {
+    tx_base++;
+  }
+}
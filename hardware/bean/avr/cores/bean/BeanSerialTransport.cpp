@@ -5,18 +5,36 @@
 #include "wiring_private.h"
 
 #include "BeanSerialTransport.h"
+#include "BeanFrameCodec.h"
+#include "BeanTrace.h"
 
-// There is a compiler or hardware bug(?) that causes
-// HardwareSerial::write() to lock the Serial Port unless
-// it is explicitely called with a uint8_t.
-// I've copied the #defines into uint8_t types to ensure that
-// HardwareSerial::write() isn't called with a #define by mistake.
-const uint8_t BEAN_SOF = UT_CHAR_START;
-const uint8_t BEAN_EOF = UT_CHAR_END;
-const uint8_t BEAN_ESCAPE = UT_CHAR_ESC;
-const uint8_t BEAN_ESCAPE_XOR = HDLC_ESCAPE_XOR;
 static uint8_t m_ccSleepPinVal = LOW;
 
+// The wake line's level, and when it last went high
+static volatile uint8_t wake_line = LOW;
+static volatile uint32_t wake_line_millis = 0;
+
+// Drives the line that wakes the CC
+static void drive_wake_line(uint8_t level) {
+  digitalWrite(CC_INTERRUPT_PIN, level);
+  if (level != wake_line) {
+    wake_line = level;
+    if (level == HIGH) {
+      wake_line_millis = millis();
+    }
+    TRACE(TRACE_WAKE_LINE, level);
+  }
+}
+
+// Whether the wake line has been high for wait_ms, long enough for the CC to
+// be listening
+static bool cc_listening(uint32_t wait_ms) {
+  noInterrupts();
+  bool listening = wake_line == HIGH && millis() - wake_line_millis >= wait_ms;
+  interrupts();
+  return listening;
+}
+
 static const uint16_t BEAN_MIN_ADVERTISING_INT_MS = 20;    // ms
 static const uint16_t BEAN_MAX_ADVERTISING_INT_MS = 1285;  // ms
 
@@ -47,10 +65,104 @@ ring_buffer reply_buffer = {{0}, 0, 0};
 
 static volatile bool tx_buffer_flushed = true;
 static volatile bool serial_message_complete = false;
+static volatile bool serial_reply_pending = false;
+static volatile bool serial_frame_complete = false;
+// When the last frame from the CC came in, for timing replies and acks
+volatile uint32_t rx_frame_millis = 0;
+
+static TransportStats transport_stats;
+
+// awake_ms is kept as millis() at the last resetPowerStats(), the rest count
+// up
+static PowerStats power_stats;
+
+// Receive side of reliable mode; the send side is in BeanReliable.cpp.
+volatile bool reliable_rx_enabled = false;
+volatile uint8_t reliable_rx_expected = 0;
+volatile bool reliable_ack_pending = false;
+ReliableStats reliable_stats;
+
+// Packet mode: where each whole frame in rx_buffer ends, oldest first
+static volatile bool packet_mode = false;
+static volatile uint8_t packet_ends[PACKET_QUEUE_SIZE];
+static volatile uint8_t packet_first = 0;
+static volatile uint8_t packet_count = 0;
 
 static volatile bool observer_message_sending = false;
 static volatile int observer_msg_len = 0;
 
+// Frames that only update cached CC state are staged here and committed on a
+// good CRC instead of going through reply_buffer, so a state change pushed by
+// the CC can't clobber the response to a pending call_and_response().
+static uint8_t slot_staging[FRAME_SLOT_SIZE];
+static BT_STATES_T bt_states_rx;
+static FrameSlot bt_states_slot = {(uint8_t *)&bt_states_rx,
+                                   sizeof(BT_STATES_T), 0, false, 0, NULL};
+static uint8_t sensor_rx[NUM_CACHED_SENSORS];
+static FrameSlot sensor_slots[NUM_CACHED_SENSORS] = {
+    {&sensor_rx[CACHED_TEMPERATURE], 1, 0, false, 0, NULL},
+    {&sensor_rx[CACHED_BATTERY], 1, 0, false, 0, NULL}};
+
+static const MSG_ID_T sensor_message_ids[NUM_CACHED_SENSORS] = {
+    MSG_ID_CC_TEMP_READ, MSG_ID_CC_BATT_READ};
+
+// Runtime routes, sorted by firstId and never overlapping.
+static MessageRoute route_table[MESSAGE_ROUTE_TABLE_SIZE];
+static uint8_t route_count = 0;
+
+// The compiler turns this into a jump table or a binary search, so routing
+// stays cheap as channels are added. Add new channels here, not in the ISR.
+static uint8_t builtin_route(uint16_t messageId, void **target) {
+  switch (messageId) {
+    case MSG_ID_SERIAL_DATA:
+      *target = &rx_buffer;
+      return SINK_RING;
+    case MSG_ID_MIDI_READ:
+      *target = &midi_buffer;
+      return SINK_RING;
+    case MSG_ID_ANCS_READ:
+      *target = &ancs_buffer;
+      return SINK_RING;
+    case MSG_ID_ANCS_GET_NOTI:
+      *target = &ancs_message_buffer;
+      return SINK_RING;
+    case MSG_ID_OBSERVER_READ:
+      *target = &observer_message;
+      return SINK_RING;
+    case MSG_ID_BT_GET_STATES:
+      *target = &bt_states_slot;
+      return SINK_SLOT;
+    case MSG_ID_CC_TEMP_READ:
+      *target = &sensor_slots[CACHED_TEMPERATURE];
+      return SINK_SLOT;
+    case MSG_ID_CC_BATT_READ:
+      *target = &sensor_slots[CACHED_BATTERY];
+      return SINK_SLOT;
+    default:
+      *target = NULL;
+      return SINK_REPLY;
+  }
+}
+
+static uint8_t find_route(uint16_t messageId, void **target) {
+  uint8_t lo = 0;
+  uint8_t hi = route_count;
+
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (route_table[mid].lastId < messageId) {
+      lo = mid + 1;
+    } else if (route_table[mid].firstId > messageId) {
+      hi = mid;
+    } else {
+      *target = route_table[mid].target;
+      return route_table[mid].sink;
+    }
+  }
+
+  return builtin_route(messageId, target);
+}
+
 static inline void store_char(unsigned char c, ring_buffer *buffer) {
   unsigned int i = (buffer->head + 1) % SERIAL_BUFFER_SIZE;
 
@@ -61,35 +173,82 @@ static inline void store_char(unsigned char c, ring_buffer *buffer) {
   if (i != buffer->tail) {
     buffer->buffer[buffer->head] = c;
     buffer->head = i;
+  } else {
+    transport_stats.overflow_drops++;
   }
 }
 
-static uint32_t calc_crc32(uint32_t crc, uint8_t *buf, uint16_t len) {
-  uint16_t k;
+// Reliable frames, and serial frames in packet mode, are stored past head,
+// and only handed to the reader once the CRC checks out, so a bad one can
+// simply be forgotten. Returns false if the byte didn't fit.
+static inline bool store_uncommitted(unsigned char c, ring_buffer *buffer,
+                                     unsigned int *head) {
+  unsigned int i = (*head + 1) % SERIAL_BUFFER_SIZE;
 
-  crc = ~crc;
-  while (len--) {
-    crc ^= *buf++;
-    for (k = 0; k < 8; k++) {
-      // If CRC LSB is 1, right shift CRC, then XOR CRC with 0xEDB88320
-      // Otherwise, just right shift CRC
-      crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
-    }
+  if (i != buffer->tail) {
+    buffer->buffer[*head] = c;
+    *head = i;
+    return true;
+  }
+  transport_stats.overflow_drops++;
+  return false;
+}
+
+// Records a whole packet ending at head, unless the queue is full
+static inline bool packet_push(unsigned int head) {
+  if (packet_count == PACKET_QUEUE_SIZE) {
+    return false;
+  }
+  packet_ends[(packet_first + packet_count) % PACKET_QUEUE_SIZE] = head;
+  packet_count++;
+  return true;
+}
+
+// The seq a reliable frame needs to be delivered. The sender doesn't resend
+// anything before base, so there's no point waiting for it.
+static inline uint8_t reliable_next_seq(uint8_t base) {
+  return (int8_t)(base - reliable_rx_expected) > 0 ? base
+                                                   : reliable_rx_expected;
+}
+
+// Called for reliable frames with a good CRC; true if seq is the one to
+// deliver.
+static bool reliable_accept(uint8_t seq, uint8_t base) {
+  uint8_t expected = reliable_next_seq(base);
+
+  reliable_stats.skipped += (uint8_t)(expected - reliable_rx_expected);
+  if (seq != expected) {
+    reliable_rx_expected = expected;
+    return false;
   }
-  return ~crc;
+  reliable_rx_expected = expected + 1;
+  return true;
 }
 
-void toUint8Array(uint32_t value, uint8_t *target, uint8_t target_bytes) {
-  int i;
-  uint8_t shift = target_bytes * 8;
-  for (i = 0; i < target_bytes; i++) {
-    shift -= 8;
-    target[i] = (uint8_t)((value >> shift) & 0xFF);
+static const uint16_t channel_message_ids[CHANNEL_OTHER] = {
+    MSG_ID_SERIAL_DATA, MSG_ID_BT_GET_CONFIG, MSG_ID_CC_LED_READ_ALL,
+    MSG_ID_MIDI_READ,   MSG_ID_ANCS_READ,     MSG_ID_OBSERVER_READ,
+    MSG_ID_DB_LOOPBACK};
+
+static uint8_t transport_channel(uint16_t messageId) {
+  uint8_t channel = 0;
+  while (channel < CHANNEL_OTHER &&
+         (messageId & 0xFF00) != (channel_message_ids[channel] & 0xFF00)) {
+    channel++;
   }
+  return channel;
 }
 
+// The frame being received, parsed a byte at a time by the RX interrupt
+static FrameDecoder rx_frame;
+
 static bool rx_char(uint8_t *c) {
 #if defined(UDR0)
+#if defined(BEAN_TRACE)
+  if (bit_is_set(UCSR0A, DOR0)) {
+    TRACE(TRACE_OVERRUN, TRACE_OVERRUN_UART);
+  }
+#endif
   if (bit_is_clear(UCSR0A, UPE0)) {
     *c = UDR0;
     return true;
@@ -128,164 +287,272 @@ ISR(USART0_RX_vect)
 ISR(USART_RXC_vect)  // ATmega8
 #endif
 {
-  // DECLARATIONS
-  static enum {
-    WAITING_FOR_SOF,
-    GETTING_LENGTH,
-    GETTING_MESSAGE_ID_1,
-    GETTING_MESSAGE_ID_2,
-    GETTING_MESSAGE_BODY,
-    GETTING_CRC32,
-    GETTING_EOF
-  } bean_transport_state = WAITING_FOR_SOF;
-
-  static bool escaping = false;
-  static uint16_t messageType = MSG_ID_SERIAL_DATA;
-  static uint8_t messageRemaining = 0;
-  static uint8_t messageCur = 0;
-  static uint8_t temp_var[4];
-  static uint8_t rx_crc32[4];
-  static uint32_t calculated_crc32;
-  uint8_t bytes_ok;
-
-  // buffer
+  LATENCY_SCOPE(LATENCY_USART_RX);
+  FRAME_EVENT_T event;
+  bool accepted;
+
+  // where the body goes: a ring buffer, a frame slot, or nowhere
   static ring_buffer *buffer = NULL;
+  static FrameSlot *slot = NULL;
+  static uint8_t *staging = NULL;
+  static uint8_t staged = 0;
+  static uint8_t channel = CHANNEL_SERIAL;
+  static uint16_t messageType = MSG_ID_SERIAL_DATA;
+  static unsigned int ring_head;  // uncommitted head, see store_uncommitted()
+  static bool uncommitted = false;
+  static bool overflowed = false;
+#if defined(BEAN_TRACE)
+  static uint16_t overflow_drops;  // at the start of the frame
+#endif
+  uint8_t sink;
+  void *target;
+
+  // reliable mode header: seq, base and the real message ID
+  static bool wrapped = false;
+  static uint8_t header[RELIABLE_HEADER_LENGTH];
+  static uint8_t header_length;
 
   uint8_t next;
   if (!rx_char(&next)) {
+    transport_stats.rx_errors++;
     return;
   }
 
-  // only handle escape char in message
-  if (bean_transport_state != WAITING_FOR_SOF) {
-    if (escaping == true) {
-      next ^= BEAN_ESCAPE_XOR;
-    } else if (escaping == false && next == BEAN_ESCAPE) {
-      escaping = true;
-      return;
-    }
-  }
-
-  if (escaping == false) {
-    if ((next == BEAN_SOF && bean_transport_state != WAITING_FOR_SOF) ||
-        (next == BEAN_EOF && bean_transport_state != GETTING_EOF) ||
-        next == BEAN_ESCAPE) {
-      // RESET STATE
-      escaping = false;
-      messageType = WAITING_FOR_SOF;
-      messageRemaining = 0;
-      messageCur = 0;
+  event = rx_frame.feed(next);
+  switch (event) {
+    case FRAME_EVENT_RESET:
+      transport_stats.framing_resets++;
       buffer = NULL;
-      serial_message_complete = false;
+      staging = NULL;
+      wrapped = false;
       return;
-    }
-  }
 
-  escaping = false;
+    case FRAME_EVENT_ID:
+      messageType = rx_frame.messageId();
+      TRACE(TRACE_RX_START, messageType);
+#if defined(BEAN_TRACE)
+      overflow_drops = transport_stats.overflow_drops;
+#endif
+      observer_msg_len = rx_frame.bodyLength() + FRAME_ID_LENGTH;
+      buffer = NULL;
+      staging = NULL;
+      wrapped = messageType == MSG_ID_RELIABLE_DATA && reliable_rx_enabled &&
+                rx_frame.bodyLength() >= RELIABLE_HEADER_LENGTH;
+      header_length = 0;
+      if (wrapped) {
+        return;
+      }
+      break;
 
-  switch (bean_transport_state) {
-    case WAITING_FOR_SOF:
-      if (next == BEAN_SOF) {
-        bean_transport_state = GETTING_LENGTH;
-        serial_message_complete = false;
+    case FRAME_EVENT_BODY:
+      next = rx_frame.byte();
+      if (wrapped && header_length < RELIABLE_HEADER_LENGTH) {
+        header[header_length++] = next;
+        if (header_length < RELIABLE_HEADER_LENGTH) {
+          return;
+        }
+        messageType = (header[2] << 8) | header[3];
+        break;
+      }
+      if (buffer && uncommitted) {
+        overflowed |= !store_uncommitted(next, buffer, &ring_head);
+      } else if (buffer) {
+        store_char(next, buffer);
+      } else if (staging && staged < slot->size) {
+        staging[staged++] = next;
       }
+      return;
 
-      break;
+    case FRAME_EVENT_FRAME:
+    case FRAME_EVENT_CRC_ERROR:
+      if (buffer == &midi_buffer) {
+        for (int i = 0; i < 3; i++) {
+          // null message to specify the end of a BLE packet
+          if (uncommitted) {
+            store_uncommitted(0, buffer, &ring_head);
+          } else {
+            store_char(0, buffer);
+          }
+        }
+      }
+      if (buffer == &observer_message) {
+        observer_message_sending = false;
+      }
+#if defined(BEAN_TRACE)
+      if (transport_stats.overflow_drops != overflow_drops) {
+        TRACE(TRACE_OVERRUN, TRACE_OVERRUN_RING);
+      }
+#endif
+      if (event == FRAME_EVENT_FRAME) {
+        TRACE(TRACE_RX_END, messageType);
+        transport_stats.rx_frames[channel]++;
+        transport_stats.rx_bytes +=
+            FRAME_ENCODED_LENGTH(rx_frame.bodyLength());
+        power_stats.rx_frames++;
+        power_stats.rx_bytes += FRAME_ENCODED_LENGTH(rx_frame.bodyLength());
+        rx_frame_millis = millis();
+        accepted = !wrapped || reliable_accept(header[0], header[1]);
+        if (wrapped) {
+          reliable_ack_pending = true;
+        }
+        // A packet goes in whole, or not at all
+        if (accepted && packet_mode && buffer == &rx_buffer &&
+            (overflowed || ring_head == buffer->head ||
+             !packet_push(ring_head))) {
+          buffer = NULL;
+        }
+        if (accepted && uncommitted && buffer) {
+          buffer->head = ring_head;
+        }
+        if (!accepted) {
+          reliable_stats.duplicates++;
+        } else if (buffer == NULL && staging == NULL) {
+          transport_stats.dropped_frames++;
+        } else if (buffer == &reply_buffer) {
+          serial_message_complete = true;
+        } else if (buffer == &rx_buffer) {
+          serial_frame_complete = true;
+        } else if (staging) {
+          if (staging == slot_staging) {
+            memcpy(slot->data, slot_staging, staged);
+          }
+          slot->length = staged;
+          slot->messageId = messageType;
+          slot->updated = true;
+        }
+      } else {
+        transport_stats.crc_failures++;
+        TRACE(TRACE_CRC_FAILURE, messageType);
+      }
+      staging = NULL;
+      buffer = NULL;
+      wrapped = false;
+      return;
 
-    case GETTING_LENGTH:
-      messageRemaining = next;
-      bean_transport_state = GETTING_MESSAGE_ID_1;
-      observer_msg_len = next;  // we don't have message type yet, but save the
-                                // length for later
-      calculated_crc32 = calc_crc32(0, &next, 1);
-      break;
+    default:
+      return;
+  }
 
-    case GETTING_MESSAGE_ID_1:
-      messageType = ((unsigned int)next) << 8;
-      messageRemaining--;
-      bean_transport_state = GETTING_MESSAGE_ID_2;
-      calculated_crc32 = calc_crc32(calculated_crc32, &next, 1);
+  // The message ID is known; pick where the body goes
+  slot = NULL;
+  staged = 0;
+  channel = transport_channel(messageType);
+  // A reliable frame other than the next one is a repeat, or early; either
+  // way it is only acked.
+  if (wrapped && header[0] != reliable_next_seq(header[1])) {
+    sink = SINK_DROP;
+  } else {
+    sink = find_route(messageType, &target);
+  }
+  switch (sink) {
+    case SINK_REPLY:
+      // Only the first reply to a pending request is kept; anything else
+      // unrouted is dropped rather than clobbering it.
+      if (serial_reply_pending && !serial_message_complete) {
+        buffer = &reply_buffer;
+        reply_buffer.head = reply_buffer.tail = 0;
+      }
       break;
-
-    case GETTING_MESSAGE_ID_2:
-      messageType |= next;
-      messageRemaining--;
-
-      if (messageType == MSG_ID_MIDI_READ) {
-        buffer = &midi_buffer;
-      } else if (messageType == MSG_ID_ANCS_READ) {
-        buffer = &ancs_buffer;
-      } else if (messageType == MSG_ID_ANCS_GET_NOTI) {
-        buffer = &ancs_message_buffer;
-      } else if (messageType == MSG_ID_OBSERVER_READ) {
-        buffer = &observer_message;
+    case SINK_RING:
+      buffer = (ring_buffer *)target;
+      if (buffer == &observer_message) {
         observer_message_sending = true;
         observer_message.head = observer_message.tail =
             0;  // if the user missed a previous message drop it
-      } else {
-        buffer =
-            (messageType == MSG_ID_SERIAL_DATA) ? &rx_buffer : &reply_buffer;
       }
-
-      if (messageRemaining > 0) {
-        bean_transport_state = GETTING_MESSAGE_BODY;
-      } else {
-        bean_transport_state = GETTING_CRC32;
-        messageRemaining = 4;
+      break;
+    case SINK_SLOT:
+    case SINK_CALLBACK:
+      slot = (FrameSlot *)target;
+      if (slot->callback == NULL && slot->size <= FRAME_SLOT_SIZE) {
+        staging = slot_staging;
+      } else if (!slot->updated) {
+        staging = slot->data;
       }
-      calculated_crc32 = calc_crc32(calculated_crc32, &next, 1);
-
       break;
+    default:
+      break;
+  }
+  if (buffer) {
+    ring_head = buffer->head;
+  }
+  uncommitted = wrapped || (packet_mode && buffer == &rx_buffer);
+  overflowed = false;
+}
+#endif
+#endif
 
-    case GETTING_MESSAGE_BODY:
-      if (buffer) {
-        store_char(next, buffer);
-        messageRemaining--;
-        calculated_crc32 = calc_crc32(calculated_crc32, &next, 1);
-      }
+// Routes a message that arrived inside another frame (a container) the way
+// the RX interrupt routes a frame of its own. The outer frame's CRC has
+// already been checked.
+void BeanSerialTransport::deliver_message(uint16_t messageId,
+                                          const uint8_t *body,
+                                          size_t body_length) {
+  void *target;
+  ring_buffer *buffer = NULL;
+  FrameSlot *slot;
 
-      if (messageRemaining == 0) {
-        bean_transport_state = GETTING_CRC32;
-        messageRemaining = 4;
+  noInterrupts();
+  transport_stats.rx_frames[transport_channel(messageId)]++;
+  switch (find_route(messageId, &target)) {
+    case SINK_REPLY:
+      if (serial_reply_pending && !serial_message_complete) {
+        buffer = &reply_buffer;
+        reply_buffer.head = reply_buffer.tail = 0;
+      } else {
+        transport_stats.dropped_frames++;
       }
       break;
-    case GETTING_CRC32:
-      messageRemaining--;
-      rx_crc32[3 - messageRemaining] = next;
-      if (messageRemaining == 0) {
-        toUint8Array(calculated_crc32, temp_var, 4);
-        bean_transport_state = GETTING_EOF;
+    case SINK_RING:
+      buffer = (ring_buffer *)target;
+      if (buffer == &observer_message) {
+        observer_message.head = observer_message.tail = 0;
       }
       break;
-    case GETTING_EOF:
-      // RESET STATE
-      if (messageType == MSG_ID_MIDI_READ) {
-        for (int i = 0; i < 3; i++)
-          // null message to specify the end of a BLE packet
-          store_char(0, buffer);
-      }
-      if (messageType == MSG_ID_OBSERVER_READ) {
-        observer_message_sending = false;
-      }
-      bytes_ok = 0;
-      for (int i = 0; i < 4; i++) {
-        if (temp_var[i] == rx_crc32[i]) {
-          bytes_ok += 1;
-        }
-      }
-      if (bytes_ok == 4) {
-        serial_message_complete = true;
+    case SINK_SLOT:
+    case SINK_CALLBACK:
+      slot = (FrameSlot *)target;
+      if ((slot->callback == NULL && slot->size <= FRAME_SLOT_SIZE) ||
+          !slot->updated) {
+        slot->length = min(body_length, (size_t)slot->size);
+        memcpy(slot->data, body, slot->length);
+        slot->messageId = messageId;
+        slot->updated = true;
+      } else {
+        transport_stats.dropped_frames++;
       }
-      bean_transport_state = WAITING_FOR_SOF;
-      messageType = MSG_ID_SERIAL_DATA;
-      messageRemaining = 0;
-      messageCur = 0;
-      buffer = NULL;
+      break;
+    default:
+      transport_stats.dropped_frames++;
       break;
   }
+
+  if (buffer == &rx_buffer && packet_mode) {
+    unsigned int room = (rx_buffer.tail + SERIAL_BUFFER_SIZE - rx_buffer.head -
+                         1) % SERIAL_BUFFER_SIZE;
+    if (body_length == 0 || body_length > room ||
+        !packet_push((rx_buffer.head + body_length) % SERIAL_BUFFER_SIZE)) {
+      transport_stats.dropped_frames++;
+      buffer = NULL;
+    }
+  }
+  if (buffer) {
+    for (size_t i = 0; i < body_length; i++) {
+      store_char(body[i], buffer);
+    }
+    if (buffer == &midi_buffer) {
+      for (int i = 0; i < 3; i++) {
+        store_char(0, buffer);
+      }
+    }
+    if (buffer == &reply_buffer) {
+      serial_message_complete = true;
+    } else if (buffer == &rx_buffer) {
+      serial_frame_complete = true;
+    }
+  }
+  interrupts();
 }
-#endif
-#endif
 
 // The Original HWSerial version of this function
 // relies on the TX Vector flag to tell when tx_buffer_flushed.
@@ -293,8 +560,24 @@ ISR(USART_RXC_vect)  // ATmega8
 // set) pin for the CC, so for BeanSerial we use 'tx_buffer_flushed' bool
 // instead.
 void BeanSerialTransport::flush() {
+  static uint16_t spun_us = 0;
+
+  if (m_containerPump) {
+    (this->*m_containerPump)(true);
+  }
+
+  unsigned long start = micros();
+
   // logic is handled in writes and interrupts
-  while (tx_buffer_flushed == false) {}
+  while (tx_buffer_flushed == false) {
+    interrupt_wait();
+  }
+
+  // keep the sub-millisecond remainder so short spins still add up
+  unsigned long spun = micros() - start + spun_us;
+  transport_stats.flush_ms += spun / 1000;
+  power_stats.wait_ms += spun / 1000;
+  spun_us = spun % 1000;
 
   // this is a holdover from HWSerial.
   transmitting = false;
@@ -304,7 +587,7 @@ void BeanSerialTransport::flush() {
 ISR(USART_TX_vect) {
   // lower interrupt line that wakes The CC
   if (tx_buffer.head == tx_buffer.tail) {
-    digitalWrite(CC_INTERRUPT_PIN, m_ccSleepPinVal);
+    drive_wake_line(m_ccSleepPinVal);
     cbi(UCSR0B, TXCIE0);
     tx_buffer_flushed = true;
   }
@@ -338,32 +621,27 @@ ISR(USART_UDRE_vect) {
 // Called in main, before setup, to enable things such as setting the LED
 // color during setup.
 void BeanSerialTransport::begin(void) {
-  HardwareSerial::begin(38400);
+  static bool link_rate_offered = false;
+
+  HardwareSerial::begin(m_linkRate);
   pinMode(CC_INTERRUPT_PIN, OUTPUT);
-  digitalWrite(CC_INTERRUPT_PIN, LOW);
+  set_wake_line(LOW);
 
   if (tx_buffer.head == tx_buffer.tail) {
     tx_buffer_flushed = true;
-    digitalWrite(CC_INTERRUPT_PIN, m_ccSleepPinVal);
-  }
-}
-
-inline void BeanSerialTransport::insert_escaped_char(uint8_t input) {
-  // It's crucial that HardwareSerial::write is only called
-  // with excplicit uint8_t types otherwise weird overloading
-  // happens, and things you don't expect result
-  switch (input) {
-    case BEAN_SOF:  // fallthrough
-    case BEAN_EOF:  // fallthrough
-    case BEAN_ESCAPE:
-      HardwareSerial::write(BEAN_ESCAPE);
-      // without the cast, the XOR is getting promoted
-      // to another type, probably an int, and causing unexpected
-      // results in the messages.
-      HardwareSerial::write(uint8_t(input ^ BEAN_ESCAPE_XOR));
-      break;
-    default:
-      HardwareSerial::write(input);
+    set_wake_line(m_ccSleepPinVal);
+  }
+
+  traceBegin();
+
+  if (!link_rate_offered) {
+    static const uint32_t rates[] = {BEAN_LINK_RATES};
+    link_rate_offered = true;
+    // A board whose only rate is the one the link starts at boots without
+    // the round trip and the confirm window
+    if (sizeof(rates) / sizeof(rates[0]) > 1 || rates[0] != m_linkRate) {
+      negotiateLinkRate(rates, sizeof(rates) / sizeof(rates[0]));
+    }
   }
 }
 
@@ -376,91 +654,529 @@ void BeanSerialTransport::BTConfigUartSleep(UART_SLEEP_MODE_T mode) {
     m_wakeDelay = 0;
     m_enforcedDelay = 0;
     m_ccSleepPinVal = HIGH;
-    digitalWrite(CC_INTERRUPT_PIN, HIGH);
+    set_wake_line(HIGH);
   }
 }
 
-size_t BeanSerialTransport::write_message(uint16_t messageId,
-                                          const uint8_t *body,
-                                          size_t body_length) {
+static void begin_once(void) {
   static bool serial_initialized = false;
-  uint32_t crc32 = 0;
-  uint8_t temp_var[4];
 
   if (!serial_initialized) {
-    Serial.begin();
+    // Set first: begin() sends the link rate negotiation
     serial_initialized = true;
+    Serial.begin();
+  }
+}
+
+void BeanSerialTransport::set_wake_line(uint8_t level) {
+  drive_wake_line(level);
+}
+
+void BeanSerialTransport::holdCCAwake(bool hold) {
+  static uint8_t sleepPinVal = LOW;
+
+  if (hold) {
+    sleepPinVal = m_ccSleepPinVal;
+    m_ccSleepPinVal = HIGH;
+  } else {
+    m_ccSleepPinVal = sleepPinVal;
+    noInterrupts();
+    if (tx_buffer_flushed) {
+      set_wake_line(m_ccSleepPinVal);
+    }
+    interrupts();
   }
+}
+
+size_t BeanSerialTransport::write_message(uint16_t messageId,
+                                          const uint8_t *body,
+                                          size_t body_length) {
+  begin_once();
 
   if (body_length > MAX_BODY_LENGTH) {
     return -1;
   }
 
+  if (m_containerWriter) {
+    // Sends what was queued if its window is over
+    (this->*m_containerPump)(false);
+    return (this->*m_containerWriter)(messageId, body, body_length);
+  }
+  return send_message(messageId, body, body_length);
+}
+
+size_t BeanSerialTransport::send_message(uint16_t messageId,
+                                         const uint8_t *body,
+                                         size_t body_length) {
+  if (m_reliableWriter) {
+    return (this->*m_reliableWriter)(messageId, body, body_length);
+  }
+
+  wake_cc();
+  write_frame(messageId, body, body_length);
+  send_delay();
+
+  return body_length;
+}
+
+void BeanSerialTransport::wake_cc(void) {
   // if the buffer is empty, raise the ccinterrupt
   // and wait for the cc to wake before starting the transmit
   // testing has shown this to take up to 4ms.  adding 1 ms padding.
+  // A frame from post_request() went without its send delay; wait out the
+  // rest of it first.
+  if (m_posted) {
+    m_posted = false;
+    uint32_t since = millis() - m_postMillis;
+    if (since < m_enforcedDelay) {
+      delay(m_enforcedDelay - since);
+      transport_stats.delay_ms += m_enforcedDelay - since;
+      power_stats.delay_ms += m_enforcedDelay - since;
+    }
+  }
+  bool listening = cc_listening(m_wakeDelay);
   tx_buffer_flushed = false;
-  digitalWrite(CC_INTERRUPT_PIN, HIGH);
-  if (tx_buffer.head == tx_buffer.tail && m_wakeDelay > 0) {
+  set_wake_line(HIGH);
+  if (tx_buffer.head == tx_buffer.tail && m_wakeDelay > 0 && !listening) {
     delay(m_wakeDelay);
+    transport_stats.delay_ms += m_wakeDelay;
+    power_stats.delay_ms += m_wakeDelay;
+    power_stats.cc_wakes++;
   }
+}
 
-  HardwareSerial::write(BEAN_SOF);
-  // body_length + "2" for message type.
-  temp_var[0] = body_length + 2;
-  temp_var[1] = (uint8_t)(messageId >> 8);
-  temp_var[2] = (uint8_t)(messageId & 0xFF);
-  crc32 = calc_crc32(crc32, temp_var, 3);
-  for (int i = 0; i < 3; i++) {
-    insert_escaped_char(temp_var[i]);
-  }
+// The CC is woken by the first call that finds it asleep, and the request
+// goes out on a later one, once it is listening. The frame goes straight to
+// the UART, outside reliable mode and containers: a lost GET is only asked
+// for again.
+bool BeanSerialTransport::post_request(uint16_t messageId) {
+  begin_once();
 
-  crc32 = calc_crc32(crc32, (uint8_t *)body, body_length);
-  for (uint8_t i = 0; i < body_length; i++) {
-    insert_escaped_char(body[i]);
+  if (m_posted && millis() - m_postMillis < m_enforcedDelay) {
+    return false;
   }
-
-  toUint8Array(crc32, temp_var, sizeof(uint32_t));
-  for (uint8_t i = 0; i < sizeof(uint32_t); i++) {
-    insert_escaped_char(temp_var[i]);
+  if (tx_buffer.head == tx_buffer.tail && m_wakeDelay > 0 &&
+      !cc_listening(m_wakeDelay)) {
+    noInterrupts();
+    if (wake_line == LOW) {
+      set_wake_line(HIGH);
+      power_stats.cc_wakes++;
+    }
+    interrupts();
+    return false;
   }
-  HardwareSerial::write(BEAN_EOF);
+
+  write_frame(messageId, NULL, 0);
+  m_posted = true;
+  m_postMillis = millis();
+  return true;
+}
+
+void BeanSerialTransport::send_delay(void) {
   // throttle the transfer speed
   if (m_enforcedDelay > 0) {
     delay(m_enforcedDelay);
+    transport_stats.delay_ms += m_enforcedDelay;
+    power_stats.delay_ms += m_enforcedDelay;
+  }
+}
+
+size_t BeanSerialTransport::write_frame(uint16_t messageId,
+                                        const uint8_t *body,
+                                        size_t body_length) {
+  if (body_length > MAX_BODY_LENGTH) {
+    return -1;
   }
 
+  PROFILE_BEGIN(PROFILE_WRITE_FRAME);
+  begin_frame(messageId, body_length);
+  for (uint8_t i = 0; i < body_length; i++) {
+    frame_byte(body[i]);
+  }
+  end_frame();
+  PROFILE_END(PROFILE_WRITE_FRAME);
+
   return body_length;
 }
 
+// There is a compiler or hardware bug(?) that causes
+// HardwareSerial::write() to lock the Serial Port unless
+// it is explicitely called with a uint8_t, hence the uint8_t here.
+struct UartSink {
+  void put(uint8_t c) {
+    if (c == FRAME_ESCAPE) {
+      transport_stats.bytes_escaped++;
+    }
+    Serial.HardwareSerial::write(c);
+  }
+};
+
+// The frame being written by begin_frame()/frame_byte()/end_frame()
+static UartSink uart_sink;
+static FrameEncoder<UartSink> tx_frame(uart_sink);
+
+void BeanSerialTransport::begin_frame(uint16_t messageId, size_t body_length) {
+  begin_once();
+
+  // Anything queued for a container goes first
+  if (m_containerPump) {
+    (this->*m_containerPump)(true);
+  }
+
+  transport_stats.tx_frames[transport_channel(messageId)]++;
+  transport_stats.tx_bytes += FRAME_ENCODED_LENGTH(body_length);
+  power_stats.tx_frames++;
+  power_stats.tx_bytes += FRAME_ENCODED_LENGTH(body_length);
+
+  tx_buffer_flushed = false;
+  set_wake_line(HIGH);
+
+  TRACE(TRACE_TX_START, messageId);
+  tx_frame.begin(messageId, body_length);
+}
+
+void BeanSerialTransport::frame_byte(uint8_t c) { tx_frame.byte(c); }
+
+void BeanSerialTransport::end_frame(void) {
+  tx_frame.end();
+  m_frameMillis = millis();
+  TRACE(TRACE_TX_END, 0);
+}
+
+static RTT_CLASS_T rtt_class(uint16_t messageId) {
+  if (messageId == MSG_ID_DB_E2E_LOOPBACK) {
+    return RTT_CLASS_REMOTE;
+  } else if ((messageId & 0xFF00) == (MSG_ID_BT_GET_CONFIG & 0xFF00)) {
+    return RTT_CLASS_RADIO;
+  } else if ((messageId & 0xFF00) == (MSG_ID_CC_LED_READ_ALL & 0xFF00)) {
+    return RTT_CLASS_PERIPHERAL;
+  }
+  return RTT_CLASS_OTHER;
+}
+
+// Requests that only read, so that sending one twice does no harm. Anything
+// else (the debug counter, link rate changes) gets one attempt.
+static bool request_idempotent(uint16_t messageId) {
+  switch (messageId) {
+    case MSG_ID_BT_GET_CONFIG:
+    case MSG_ID_BT_GET_SCRATCH:
+    case MSG_ID_BT_GET_STATES:
+    case MSG_ID_CC_LED_READ_ALL:
+    case MSG_ID_CC_ACCEL_READ:
+    case MSG_ID_CC_ACCEL_GET_RANGE:
+    case MSG_ID_CC_ACCEL_READ_REG:
+    case MSG_ID_CC_TEMP_READ:
+    case MSG_ID_CC_BATT_READ:
+    case MSG_ID_GATT_GET_GATT:
+    case MSG_ID_DB_LOOPBACK:
+    case MSG_ID_DB_E2E_LOOPBACK:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Jacobson/Karels estimator in fixed point, see RFC 6298.
+void BeanSerialTransport::rttSample(RttEstimator *rtt, uint16_t rtt_ms) {
+  if (rtt_ms > RTT_MAX_TIMEOUT_MS) {
+    rtt_ms = RTT_MAX_TIMEOUT_MS;
+  }
+
+  if (rtt->samples == 0) {
+    rtt->srtt = rtt_ms << 3;
+    rtt->rttvar = rtt_ms << 1;
+  } else {
+    int16_t err = rtt_ms - (rtt->srtt >> 3);
+    rtt->srtt += err;
+    if (err < 0) {
+      err = -err;
+    }
+    rtt->rttvar += err - (rtt->rttvar >> 2);
+  }
+
+  if (rtt->samples < 0xFFFF) {
+    rtt->samples++;
+  }
+  uint16_t rto = (rtt->srtt >> 3) + rtt->rttvar;
+  rtt->rto_ms = constrain(rto, RTT_MIN_TIMEOUT_MS, RTT_MAX_TIMEOUT_MS);
+}
+
+// Sends a request and waits for the RX interrupt to set *replied. An attempt
+// that goes unanswered is sent again, up to m_requestRetries times if the
+// request is idempotent, with the timeout doubled each time. Both the timeout
+// and the RTT run from when the request went into the TX ring to when its
+// reply came in, so the wake and send delays write_message() spends around
+// the frame don't count.
+int BeanSerialTransport::request(MSG_ID_T messageId, const uint8_t *body,
+                                 size_t body_length, volatile bool *replied,
+                                 ring_buffer *reply, unsigned long timeout_ms) {
+  RttEstimator *rtt = &m_rtt[rtt_class(messageId)];
+  uint8_t retries = request_idempotent(messageId) ? m_requestRetries : 0;
+
+  for (uint8_t attempt = 0; attempt <= retries; attempt++) {
+    noInterrupts();
+    LATENCY_OFF_BEGIN(LATENCY_REQUEST);
+    // clear our rx buffer to ensure that we don't read some old message out
+    // of it
+    if (reply) {
+      reply->head = reply->tail = 0;
+    }
+    *replied = false;
+    serial_reply_pending = (reply != NULL);
+    LATENCY_OFF_END(LATENCY_REQUEST);
+    interrupts();
+
+    write_message(messageId, body, body_length);
+    if (m_containerPump) {
+      (this->*m_containerPump)(true);
+    }
+    uint32_t sent = m_frameMillis;
+
+    unsigned long timeout = timeout_ms ? timeout_ms : rtt->rto_ms;
+    _startMillis = millis();
+    while (*replied == false && (millis() - sent < timeout)) {
+      // the reply may come in a container
+      if (m_containerPump) {
+        (this->*m_containerPump)(false);
+      }
+    }
+    transport_stats.wait_ms += millis() - _startMillis;
+    power_stats.wait_ms += millis() - _startMillis;
+
+    if (*replied) {
+      // A reply to a resent request could be answering either attempt, so
+      // only first attempts are timed (Karn's algorithm).
+      if (attempt == 0) {
+        noInterrupts();
+        uint32_t rtt_ms = rx_frame_millis - sent;
+        interrupts();
+        rttSample(rtt, min(rtt_ms, RTT_MAX_TIMEOUT_MS));
+      }
+      serial_reply_pending = false;
+      m_requestFailed = false;
+      return 0;
+    }
+
+    rtt->timeouts++;
+    transport_stats.timeouts++;
+    TRACE(TRACE_TIMEOUT, messageId);
+    if (timeout_ms == 0) {
+      rtt->rto_ms = min(rtt->rto_ms * 2, RTT_MAX_TIMEOUT_MS);
+    }
+  }
+
+  serial_reply_pending = false;
+  rtt->failures++;
+  m_requestFailed = true;
+  return -1;
+}
+
 int BeanSerialTransport::call_and_response(
     MSG_ID_T messageId, const uint8_t *body, size_t body_length,
     uint8_t *response, size_t *response_length, unsigned long timeout_ms) {
+  if (request(messageId, body, body_length, _message_complete, _reply_buffer,
+              timeout_ms) != 0) {
+    return -1;
+  }
+
+  // copy the message body into out
+  memcpy(response, _reply_buffer->buffer,
+         min(_reply_buffer->head, *response_length));
+  *response_length = _reply_buffer->head;
+
+  return 0;
+}
+
+static bool link_rate_exact(uint32_t rate) {
+  // With U2X the UART runs at F_CPU / 8 / (UBRR + 1)
+  return rate > 0 && F_CPU % (8 * rate) == 0 && F_CPU / 8 / rate <= 4096;
+}
+
+void BeanSerialTransport::set_link_rate(uint32_t rate) {
+  // Let the last two bytes (UDR and the shift register) go at the old rate
+  while (tx_buffer_flushed == false) {
+    interrupt_wait();
+  }
+  delayMicroseconds(20000000UL / m_linkRate + 1);
+
+  m_linkRate = rate;
+  HardwareSerial::begin(rate);
+}
+
+// Offers the CC the given rates, fastest first, and switches to the one it
+// picks. See MSG_ID_LINK_RATE.
+bool BeanSerialTransport::negotiateLinkRate(const uint32_t *rates,
+                                            uint8_t count) {
+  uint8_t offer[LINK_RATE_MAX_OFFERS * 4];
+  uint8_t length = 0;
+
+  for (uint8_t i = 0; i < count && length < sizeof(offer); i++) {
+    if (rates[i] != m_linkRate &&
+        (rates[i] == LINK_RATE_DEFAULT || link_rate_exact(rates[i]))) {
+      offer[length++] = (uint8_t)(rates[i] >> 24);
+      offer[length++] = (uint8_t)(rates[i] >> 16);
+      offer[length++] = (uint8_t)(rates[i] >> 8);
+      offer[length++] = (uint8_t)rates[i];
+    }
+  }
+  if (length == 0) {
+    return false;
+  }
+
+  // A CC that doesn't know the request shouldn't hold startup up for long
+  uint8_t retries = m_requestRetries;
+  uint8_t reply[4];
+  size_t reply_length = sizeof(reply);
+  m_requestRetries = 0;
+  int response =
+      call_and_response((MSG_ID_T)MSG_ID_LINK_RATE, offer, length, reply,
+                        &reply_length, LINK_RATE_TIMEOUT_MS);
+  m_requestRetries = retries;
+  if (response != 0 || reply_length != sizeof(reply)) {
+    return false;
+  }
+
+  uint32_t rate = ((uint32_t)reply[0] << 24) | ((uint32_t)reply[1] << 16) |
+                  ((uint32_t)reply[2] << 8) | reply[3];
+  uint8_t i = 0;
+  while (i < length && memcmp(&offer[i], reply, sizeof(reply)) != 0) {
+    i += sizeof(reply);
+  }
+  if (i == length) {
+    return false;
+  }
+
+  set_link_rate(rate);
+  delay(LINK_RATE_SETTLE_MS);
+  power_stats.delay_ms += LINK_RATE_SETTLE_MS;
+
+  uint8_t echo[4];
+  size_t echo_length = sizeof(echo);
+  if (call_and_response((MSG_ID_T)MSG_ID_LINK_RATE_CONFIRM, reply,
+                        sizeof(reply), echo, &echo_length,
+                        LINK_RATE_TIMEOUT_MS) == 0 &&
+      echo_length == sizeof(echo) && memcmp(echo, reply, sizeof(echo)) == 0) {
+    return true;
+  }
+
+  // Meet the CC back at the default rate once it has given up too
+  set_link_rate(LINK_RATE_DEFAULT);
+  delay(LINK_RATE_CONFIRM_WINDOW_MS);
+  power_stats.delay_ms += LINK_RATE_CONFIRM_WINDOW_MS;
+  return false;
+}
+
+uint32_t BeanSerialTransport::getLinkRate(void) { return m_linkRate; }
+
+bool BeanSerialTransport::setLinkRate(uint32_t rate) {
+  begin_once();
+  return rate == m_linkRate || negotiateLinkRate(&rate, 1);
+}
+
+void BeanSerialTransport::enablePackets(bool enable) {
   noInterrupts();
-  // clear our rx buffer to ensure that we don't read some old message out of it
-  _reply_buffer->head = _reply_buffer->tail = 0;
-  *_message_complete = false;
+  packet_mode = enable;
+  packet_first = 0;
+  packet_count = 0;
   interrupts();
+}
 
-  // send our message
-  write_message(messageId, body, body_length);
-  // wait for RX to hold an EOF, and then return the data
+int BeanSerialTransport::packetAvailable(void) {
+  int length = -1;
 
-  _startMillis = millis();
-  do {
-  } while (*_message_complete == false &&
-           (millis() - _startMillis < timeout_ms));
+  noInterrupts();
+  while (packet_count > 0) {
+    // Bytes taken with read() may have eaten into the packet, or past it
+    unsigned int end = packet_ends[packet_first];
+    unsigned int packet =
+        (end + SERIAL_BUFFER_SIZE - rx_buffer.tail) % SERIAL_BUFFER_SIZE;
+    unsigned int queued = (rx_buffer.head + SERIAL_BUFFER_SIZE -
+                           rx_buffer.tail) % SERIAL_BUFFER_SIZE;
+    if (packet > 0 && packet <= queued) {
+      length = packet;
+      break;
+    }
+    packet_first = (packet_first + 1) % PACKET_QUEUE_SIZE;
+    packet_count--;
+  }
+  interrupts();
 
-  if (*_message_complete) {
-    // copy the message body into out
-    memcpy(response, _reply_buffer->buffer,
-           min(_reply_buffer->head, *response_length));
-    *response_length = _reply_buffer->head;
+  return length;
+}
 
-    return 0;
+int BeanSerialTransport::readPacket(uint8_t *buffer, size_t length) {
+  int packet = packetAvailable();
+  if (packet < 0) {
+    return -1;
   }
 
-  return -1;
+  for (int i = 0; i < packet; i++) {
+    if ((size_t)i < length) {
+      buffer[i] = rx_buffer.buffer[rx_buffer.tail];
+    }
+    rx_buffer.tail = (rx_buffer.tail + 1) % SERIAL_BUFFER_SIZE;
+  }
+
+  noInterrupts();
+  packet_first = (packet_first + 1) % PACKET_QUEUE_SIZE;
+  packet_count--;
+  interrupts();
+
+  return packet;
+}
+
+void BeanSerialTransport::getTransportStats(TransportStats *stats) {
+  noInterrupts();
+  *stats = transport_stats;
+  interrupts();
+}
+
+void BeanSerialTransport::resetTransportStats(void) {
+  noInterrupts();
+  memset(&transport_stats, 0, sizeof(transport_stats));
+  interrupts();
+}
+
+void BeanSerialTransport::getPowerStats(PowerStats *stats) {
+  noInterrupts();
+  *stats = power_stats;
+  interrupts();
+  stats->awake_ms = millis() - power_stats.awake_ms;
+}
+
+void BeanSerialTransport::resetPowerStats(void) {
+  noInterrupts();
+  memset(&power_stats, 0, sizeof(power_stats));
+  interrupts();
+  power_stats.awake_ms = millis();
+}
+
+void BeanSerialTransport::countDelay(uint32_t duration_ms) {
+  power_stats.delay_ms += duration_ms;
+}
+
+void BeanSerialTransport::countSleep(uint32_t duration_ms) {
+  power_stats.asleep_ms += duration_ms;
+  power_stats.sleeps++;
+}
+
+void BeanSerialTransport::setRequestRetries(uint8_t retries) {
+  m_requestRetries = retries;
+}
+
+void BeanSerialTransport::getRttStats(RTT_CLASS_T rttClass, RttStats *stats) {
+  if (rttClass >= NUM_RTT_CLASSES) {
+    memset(stats, 0, sizeof(RttStats));
+    return;
+  }
+
+  const RttEstimator *rtt = &m_rtt[rttClass];
+  stats->srtt_ms = rtt->srtt >> 3;
+  stats->rttvar_ms = rtt->rttvar >> 2;
+  stats->rto_ms = rtt->rto_ms;
+  stats->samples = rtt->samples;
+  stats->timeouts = rtt->timeouts;
+  stats->failures = rtt->failures;
 }
 
 /////////
@@ -474,6 +1190,7 @@ void BeanSerialTransport::BTSetAdvertisingOnOff(const bool setting,
   advOnOff.adv_onOff = setting ? 1 : 0;
   write_message(MSG_ID_BT_ADV_ONOFF, (const uint8_t *)&advOnOff,
                 sizeof(advOnOff));
+  expireStates();
 }
 
 void BeanSerialTransport::BTSetLocalName(const char *name) {
@@ -500,10 +1217,204 @@ void BeanSerialTransport::BTSetLocalName(const char *name) {
   }
 }
 
+void BeanSerialTransport::requestStates(void) {
+  m_btStatesRequestMillis = millis();
+  m_btStatesRefresh = true;
+  sendRefreshes();
+}
+
+// Posts the refreshes that are waiting, as far as post_request() lets them
+// go without blocking; poll() sends the rest later.
+void BeanSerialTransport::sendRefreshes(void) {
+  if (m_btStatesRefresh) {
+    if (!post_request(MSG_ID_BT_GET_STATES)) {
+      return;
+    }
+    m_btStatesRefresh = false;
+    m_btStatesRequestMillis = millis();
+  }
+  for (uint8_t i = 0; i < NUM_CACHED_SENSORS; i++) {
+    if (m_sensors[i].refresh) {
+      if (!post_request(sensor_message_ids[i])) {
+        return;
+      }
+      m_sensors[i].refresh = false;
+      m_sensors[i].requestMillis = millis();
+    }
+  }
+}
+
+// Sketches tend to check the connection state on every loop(), so serve it
+// from the cache. A stale cache is returned as-is while a refresh is requested;
+// the reply is folded in by the next call or poll(). Only an empty cache
+// blocks.
 int BeanSerialTransport::BTGetStates(BT_STATES_T *btStates) {
-  size_t length = sizeof(BT_STATES_T);
-  return call_and_response(MSG_ID_BT_GET_STATES, NULL, (size_t)0,
-                           (uint8_t *)btStates, &length);
+  foldReplies();
+
+  if (!m_btStatesValid || m_btStatesExpired) {
+    m_btStatesRequestMillis = millis();
+    request(MSG_ID_BT_GET_STATES, NULL, 0, &bt_states_slot.updated, NULL, 0);
+    foldReplies();
+
+    if (!m_btStatesValid || m_btStatesExpired) {
+      m_requestFailed = true;
+      return -1;
+    }
+  } else if (millis() - m_btStatesMillis >= BT_STATES_REFRESH_MS &&
+             millis() - m_btStatesRequestMillis >= BT_STATES_REFRESH_MS) {
+    requestStates();
+  }
+
+  *btStates = m_btStates;
+  m_requestFailed = false;
+  return 0;
+}
+
+void BeanSerialTransport::BTSetConnectionCallback(
+    void (*callback)(bool connected)) {
+  m_connectionCallback = callback;
+}
+
+void BeanSerialTransport::expireStates(void) { m_btStatesExpired = true; }
+
+void BeanSerialTransport::expireCaches(void) {
+  expireStates();
+
+  for (uint8_t i = 0; i < NUM_CACHED_SENSORS; i++) {
+    m_sensors[i].stale = true;
+  }
+}
+
+void BeanSerialTransport::poll(void) {
+  if (m_bulkPump) {
+    (this->*m_bulkPump)();
+  }
+  if (m_reliablePump) {
+    (this->*m_reliablePump)();
+  }
+  if (m_containerPump) {
+    (this->*m_containerPump)(false);
+  }
+
+  foldReplies();
+  if (m_btStatesValid &&
+      m_connectionReported != (bool)m_btStates.conn_state) {
+    m_connectionReported = m_btStates.conn_state;
+    if (m_connectionCallback) {
+      m_connectionCallback(m_connectionReported);
+    }
+  }
+
+  // Callback slots aren't written while updated is set, so the body can be
+  // handed over in place.
+  for (uint8_t i = 0; i < route_count; i++) {
+    if (route_table[i].sink == SINK_CALLBACK) {
+      FrameSlot *slot = (FrameSlot *)route_table[i].target;
+      if (slot->updated) {
+        slot->callback(slot->messageId, slot->data, slot->length);
+        slot->updated = false;
+      }
+    }
+  }
+
+  // With a callback registered, keep the cache fresh even if the sketch
+  // never asks, so connects and disconnects are noticed without a push
+  // from the CC.
+  if (m_connectionCallback &&
+      millis() - m_btStatesRequestMillis >= BT_STATES_REFRESH_MS &&
+      (!m_btStatesValid || m_btStatesExpired ||
+       millis() - m_btStatesMillis >= BT_STATES_REFRESH_MS)) {
+    requestStates();
+  }
+  sendRefreshes();
+}
+
+// Folds state and sensor replies into the caches. Unlike poll() it runs none
+// of the sketch's callbacks, so the getters can call it.
+void BeanSerialTransport::foldReplies(void) {
+  if (bt_states_slot.updated) {
+    noInterrupts();
+    BT_STATES_T states = bt_states_rx;
+    bool complete = bt_states_slot.length >= sizeof(BT_STATES_T);
+    bt_states_slot.updated = false;
+    interrupts();
+
+    if (complete) {
+      foldStates(states);
+    }
+  }
+
+  for (uint8_t i = 0; i < NUM_CACHED_SENSORS; i++) {
+    if (sensor_slots[i].updated) {
+      noInterrupts();
+      m_sensors[i].value = sensor_rx[i];
+      sensor_slots[i].updated = false;
+      interrupts();
+
+      m_sensors[i].valid = true;
+      m_sensors[i].stale = false;
+      m_sensors[i].refresh = false;
+      m_sensors[i].millis = millis();
+    }
+  }
+}
+
+// The connection callback runs from poll(), for changes against the first
+// state ever folded in.
+void BeanSerialTransport::foldStates(const BT_STATES_T &states) {
+  if (!m_btStatesValid) {
+    m_connectionReported = states.conn_state;
+  }
+  m_btStates = states;
+  m_btStatesValid = true;
+  m_btStatesExpired = false;
+  m_btStatesRefresh = false;
+  m_btStatesMillis = millis();
+}
+
+bool BeanSerialTransport::addRoute(uint16_t firstId, uint16_t lastId,
+                                   MESSAGE_SINK_T sink, void *target) {
+  if (lastId < firstId || route_count >= MESSAGE_ROUTE_TABLE_SIZE) {
+    return false;
+  }
+  if ((sink == SINK_RING || sink == SINK_SLOT || sink == SINK_CALLBACK) &&
+      target == NULL) {
+    return false;
+  }
+  if (sink == SINK_CALLBACK && ((FrameSlot *)target)->callback == NULL) {
+    return false;
+  }
+
+  uint8_t i = 0;
+  while (i < route_count && route_table[i].lastId < firstId) {
+    i++;
+  }
+  if (i < route_count && route_table[i].firstId <= lastId) {
+    return false;
+  }
+
+  MessageRoute route = {firstId, lastId, (uint8_t)sink, target};
+  noInterrupts();
+  memmove(&route_table[i + 1], &route_table[i],
+          (route_count - i) * sizeof(MessageRoute));
+  route_table[i] = route;
+  route_count++;
+  interrupts();
+
+  return true;
+}
+
+void BeanSerialTransport::removeRoute(uint16_t firstId) {
+  for (uint8_t i = 0; i < route_count; i++) {
+    if (route_table[i].firstId == firstId) {
+      noInterrupts();
+      memmove(&route_table[i], &route_table[i + 1],
+              (route_count - i - 1) * sizeof(MessageRoute));
+      route_count--;
+      interrupts();
+      return;
+    }
+  }
 }
 
 void BeanSerialTransport::BTSetPairingPin(const uint32_t pin) {
@@ -650,6 +1561,7 @@ int BeanSerialTransport::readGATT(ADV_SWITCH_ENABLED_T *reading) {
 int BeanSerialTransport::writeGATT(ADV_SWITCH_ENABLED_T services) {
   write_message(MSG_ID_GATT_SET_GATT, (const uint8_t *)&services,
                 sizeof(services));
+  return 0;
 }
 
 int BeanSerialTransport::setCustomAdvertisement(uint8_t *buf, int len) {
@@ -726,6 +1638,9 @@ int BeanSerialTransport::getAncsNotiDetails(uint8_t *buffer, size_t length,
                                                   uint8_t *data, uint32_t timeout) {
   ancs_message_buffer.head = ancs_message_buffer.tail;  //  clear buffer
   write_message(MSG_ID_ANCS_GET_NOTI, (const uint8_t *)buffer, length);
+  if (m_containerPump) {
+    (this->*m_containerPump)(true);
+  }
   uint32_t startMillis = millis();
 
   do {
@@ -774,6 +1689,9 @@ int BeanSerialTransport::getObserverMessage(OBSERVER_INFO_MESSAGE_T *message,
                                             unsigned long timeout) {
   // Begin observing
   write_message(MSG_ID_OBSERVER_START, NULL, 0);
+  if (m_containerPump) {
+    (this->*m_containerPump)(true);
+  }
 
   // Wait for Observed ADV if Any
   memset(message, 0, sizeof(OBSERVER_INFO_MESSAGE_T));
@@ -798,7 +1716,7 @@ int BeanSerialTransport::getObserverMessage(OBSERVER_INFO_MESSAGE_T *message,
 
   // copy the message body into out
   memcpy(message, observer_message.buffer,
-         min(observer_msg_len, sizeof(OBSERVER_INFO_MESSAGE_T)));
+         min((size_t)observer_msg_len, sizeof(OBSERVER_INFO_MESSAGE_T)));
   // Stop Observing
   write_message(MSG_ID_OBSERVER_STOP, NULL, 0);
   return 1;
@@ -852,23 +1770,64 @@ void BeanSerialTransport::wakeOnAccel(uint8_t int_enable) {
                 sizeof(payload));
 }
 
+/////////
+// Cached sensors
+/////////
+
+void BeanSerialTransport::requestSensor(CACHED_SENSOR_T sensor) {
+  m_sensors[sensor].requestMillis = millis();
+  m_sensors[sensor].refresh = true;
+  sendRefreshes();
+}
+
+// Only the very first reading (or any reading with a TTL of 0) blocks. After
+// that the last known value is returned immediately, and an expired one is
+// refreshed in the background; the reply is folded in by the next call or
+// poll().
+int BeanSerialTransport::readSensor(CACHED_SENSOR_T sensor, uint8_t *value) {
+  CachedReading *reading = &m_sensors[sensor];
+
+  foldReplies();
+
+  if (!reading->valid || reading->ttl_ms == 0) {
+    reading->requestMillis = millis();
+    if (request(sensor_message_ids[sensor], NULL, 0,
+                &sensor_slots[sensor].updated, NULL, 0) != 0) {
+      return -1;
+    }
+    foldReplies();
+  } else if (reading->stale ||
+             (millis() - reading->millis >= reading->ttl_ms &&
+              millis() - reading->requestMillis >= reading->ttl_ms)) {
+    reading->stale = false;
+    requestSensor(sensor);
+  }
+
+  *value = reading->value;
+  m_requestFailed = false;
+  return 0;
+}
+
+void BeanSerialTransport::setSensorCacheTtl(CACHED_SENSOR_T sensor,
+                                            uint32_t ttl_ms) {
+  if (sensor < NUM_CACHED_SENSORS) {
+    m_sensors[sensor].ttl_ms = ttl_ms;
+  }
+}
+
 /////////
 // Temperature
 /////////
 
 int BeanSerialTransport::temperatureRead(int8_t *tempRead) {
-  size_t size = 1;
-  return call_and_response(MSG_ID_CC_TEMP_READ, NULL, (size_t)0,
-                           (uint8_t *)tempRead, &size);
+  return readSensor(CACHED_TEMPERATURE, (uint8_t *)tempRead);
 }
 
 /////////
 // Battery Level
 /////////
 int BeanSerialTransport::batteryRead(uint8_t *level) {
-  size_t size = 1;
-  return call_and_response(MSG_ID_CC_BATT_READ, NULL, (size_t)0,
-                           (uint8_t *)level, &size);
+  return readSensor(CACHED_BATTERY, level);
 }
 
 ////////
@@ -889,8 +1848,12 @@ void BeanSerialTransport::enableWakeOnConnect(bool enable) {
 // Debug
 bool BeanSerialTransport::debugLoopbackVerify(const uint8_t *message,
                                               const size_t size) {
-  uint8_t res[size];  // NOLINT(runtime/arrays)
+  // Fixed, so the stack this takes doesn't depend on the caller
+  uint8_t res[MAX_BODY_LENGTH];
   size_t res_size = size;
+  if (size > sizeof(res)) {
+    return false;
+  }
   if (call_and_response(MSG_ID_DB_LOOPBACK, message, size, res, &res_size) !=
       0) {
     return false;
@@ -905,12 +1868,15 @@ bool BeanSerialTransport::debugLoopbackVerify(const uint8_t *message,
 
 bool BeanSerialTransport::debugEndToEndLoopbackVerify(const uint8_t *message,
                                                       const size_t size) {
-  uint8_t res[size];  // NOLINT(runtime/arrays)
+  uint8_t res[MAX_BODY_LENGTH];
   size_t res_size = size;
-  // note that we've set the timeout to 250 here and not the default 100ms as
-  // this is going to the phone and back.
-  if (call_and_response(MSG_ID_DB_E2E_LOOPBACK, message, size, res, &res_size,
-                        250) != 0) {
+  if (size > sizeof(res)) {
+    return false;
+  }
+  // this is going to the phone and back, so it is timed as RTT_CLASS_REMOTE
+  // which starts out at 250ms rather than 100ms.
+  if (call_and_response(MSG_ID_DB_E2E_LOOPBACK, message, size, res,
+                        &res_size) != 0) {
     return false;
   }
 
@@ -922,7 +1888,7 @@ bool BeanSerialTransport::debugEndToEndLoopbackVerify(const uint8_t *message,
 }
 
 int BeanSerialTransport::debugGetDebugCounter(int *counter) {
-  size_t return_size;
+  size_t return_size = sizeof(*counter);
   return call_and_response(MSG_ID_DB_COUNTER, NULL, 0, (uint8_t *)counter,
                            &return_size);
 }
@@ -932,11 +1898,28 @@ void BeanSerialTransport::debugWritePtm(const uint8_t *message,
   write_message(MSG_ID_DB_PTM, message, size);
 }
 
+void BeanSerialTransport::debugWriteTransportStats(void) {
+  TransportStats stats;
+  getTransportStats(&stats);
+  write_message(MSG_ID_DB_TRANSPORT_STATS, (const uint8_t *)&stats,
+                sizeof(stats));
+}
+
+void BeanSerialTransport::debugWritePowerStats(void) {
+  PowerStats stats;
+  getPowerStats(&stats);
+  write_message(MSG_ID_DB_POWER_STATS, (const uint8_t *)&stats,
+                sizeof(stats));
+}
+
 /////////////////////
 /////////////////////
 /////////////////////
 // This is the public write function that is used all the time
 size_t BeanSerialTransport::write(uint8_t c) {
+  if (m_serialWriter) {
+    return (this->*m_serialWriter)(&c, 1);
+  }
   write_message(MSG_ID_SERIAL_DATA, &c, 1);
   return 1;
 }
@@ -944,6 +1927,10 @@ size_t BeanSerialTransport::write(uint8_t c) {
 size_t BeanSerialTransport::write(const uint8_t *buffer, size_t size) {
   if (buffer == NULL || size == 0) return 0;
 
+  if (m_serialWriter) {
+    return (this->*m_serialWriter)(buffer, size);
+  }
+
   if (size > MAX_BODY_LENGTH) {
     size_t end = MAX_BODY_LENGTH - 1;
     size_t start = 0;
@@ -976,11 +1963,11 @@ size_t BeanSerialTransport::print(const __FlashStringHelper *ifsh) {
     buffer[n++] = c;
 
     if (n == MAX_BODY_LENGTH) {
-      write_message(MSG_ID_SERIAL_DATA, buffer, n);
+      write(buffer, n);
       n = 0;
     }
   }
-  write_message(MSG_ID_SERIAL_DATA, buffer, n);
+  write(buffer, n);
   return n;
 }
 
@@ -990,11 +1977,12 @@ void BeanSerialTransport::debugLoopBackFullSerialMessages() {
   char buffer[APP_MSG_MAX_LENGTH + 1];
 
   while (1) {
-    *_message_complete = false;
+    serial_frame_complete = false;
 
     // wait for RX to hold an EOF, and then return the data
-    while (*_message_complete == false) {
+    while (serial_frame_complete == false) {
       // BLOCK UNTIL WE GET THE ENTIRE RESPONSE
+      interrupt_wait();
     }
     size_t length = APP_MSG_MAX_LENGTH + 1;
     length = readBytes(buffer, length);
@@ -1008,6 +1996,7 @@ void BeanSerialTransport::BTSetEnableConfigSave(bool enableSave) {
 
 void BeanSerialTransport::BTDisconnect(void) {
   write_message(MSG_ID_BT_DISCONNECT, NULL, 0);
+  expireStates();
 }
 
 void BeanSerialTransport::BTRestart(void) {
@@ -13,32 +13,417 @@ struct ScratchData {
 
 typedef enum { UART_SLEEP_NORMAL, UART_SLEEP_NEVER } UART_SLEEP_MODE_T;
 
+// Slow-changing CC readings that are served from a cache.
+typedef enum {
+  CACHED_TEMPERATURE,
+  CACHED_BATTERY,
+  NUM_CACHED_SENSORS
+} CACHED_SENSOR_T;
+
+// A reading is served for ttl_ms after it arrives. After that the last value
+// is still returned while a refresh is requested in the background.
+struct CachedReading {
+  uint8_t value;
+  bool valid;
+  bool stale;
+  bool refresh;  // waiting for post_request()
+  uint32_t millis;
+  uint32_t requestMillis;
+  uint32_t ttl_ms;
+};
+
+// Where a frame from the CC goes, decided as soon as its message ID is in.
+typedef enum {
+  SINK_REPLY,     // the response to a pending call_and_response()
+  SINK_RING,      // appended to a ring_buffer as it arrives
+  SINK_SLOT,      // copied to a FrameSlot once the CRC checks out
+  SINK_CALLBACK,  // like SINK_SLOT, then handed to the slot's callback by poll()
+  SINK_DROP
+} MESSAGE_SINK_T;
+
+typedef void (*FrameCallback)(uint16_t messageId, const uint8_t *body,
+                              uint8_t length);
+
+// Holds the last good frame routed to it. Bodies longer than size are cut
+// short. SINK_SLOT frames of up to FRAME_SLOT_SIZE bytes replace an unread
+// frame; larger ones, and all SINK_CALLBACK frames, are dropped until the
+// previous one has been consumed (updated cleared).
+struct FrameSlot {
+  uint8_t *data;
+  uint8_t size;
+  volatile uint8_t length;
+  volatile bool updated;
+  uint16_t messageId;
+  FrameCallback callback;
+};
+
+#define FRAME_SLOT_SIZE (8)
+
+// Routes added at runtime. They take precedence over the built-in ones.
+struct MessageRoute {
+  uint16_t firstId;
+  uint16_t lastId;
+  uint8_t sink;
+  void *target;
+};
+
+#define MESSAGE_ROUTE_TABLE_SIZE (6)
+
+// Frames are counted per channel, by the group of their message ID.
+typedef enum {
+  CHANNEL_SERIAL,
+  CHANNEL_RADIO,
+  CHANNEL_PERIPHERAL,
+  CHANNEL_MIDI,
+  CHANNEL_ANCS,
+  CHANNEL_OBSERVER,
+  CHANNEL_DEBUG,
+  CHANNEL_OTHER,
+  NUM_TRANSPORT_CHANNELS
+} TRANSPORT_CHANNEL_T;
+
+// Health counters of the link to the CC. 16 bit counters wrap. Sent as-is
+// (little endian, no padding) by debugWriteTransportStats().
+struct TransportStats {
+  uint16_t rx_frames[NUM_TRANSPORT_CHANNELS];  // good CRC
+  uint16_t tx_frames[NUM_TRANSPORT_CHANNELS];
+  uint16_t crc_failures;
+  uint16_t framing_resets;  // SOF, EOF or escape where it didn't belong
+  uint16_t rx_errors;       // parity errors reported by the UART
+  uint16_t overflow_drops;  // bytes lost to a full ring buffer
+  uint16_t dropped_frames;  // good frames with nowhere to go
+  uint16_t timeouts;        // request attempts that went unanswered
+  uint32_t bytes_escaped;   // sent with an escape prefix
+  uint32_t delay_ms;        // time spent in the wake and send delays
+  uint32_t flush_ms;        // time spent spinning in flush()
+  uint32_t wait_ms;         // time spent waiting for replies
+  // Bytes of the frames counted above, SOF to EOF, before escaping. What
+  // went out on the wire is tx_bytes + bytes_escaped.
+  uint32_t tx_bytes;
+  uint32_t rx_bytes;
+};
+
+// One payload size of a loopback benchmark, see debugLoopbackBenchmark().
+// Times are round trips in micros(), from sending a request to having its
+// reply. The median and p99 come from a histogram with four bins an octave,
+// so they are within about 12%. Sent as-is (little endian, no padding) by
+// debugLoopbackSweep().
+struct LoopbackBenchResult {
+  uint32_t min_us;
+  uint32_t median_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+  uint32_t elapsed_us;    // the whole run, failures and send delays included
+  uint32_t bytes_per_s;   // body bytes of completed round trips, both ways
+  uint16_t frames_per_s;  // frames of completed round trips, both ways
+  uint16_t iterations;
+  uint16_t failures;      // no reply, or not the bytes sent
+  uint16_t size;          // body bytes each way
+};
+
+// Where the AVR's time went since resetPowerStats(), and the link traffic
+// that kept the CC busy, for working out what a sketch costs in charge (see
+// host/sim/EnergyBench.cpp). millis() stands still while the AVR is powered
+// down, so awake_ms is millis() since the reset and asleep_ms is what
+// Bean.sleep() asked for. Sent as-is (little endian, no padding) by
+// debugWritePowerStats().
+struct PowerStats {
+  uint32_t awake_ms;
+  uint32_t asleep_ms;
+  uint32_t delay_ms;   // in the core's own delays, not the sketch's
+  uint32_t wait_ms;    // spinning for replies and in flush()
+  uint32_t tx_frames;
+  uint32_t rx_frames;
+  uint32_t tx_bytes;   // SOF to EOF, before escaping
+  uint32_t rx_bytes;
+  uint32_t cc_wakes;   // frames that had to wake the CC first
+  uint32_t sleeps;     // Bean.sleep() calls that powered down
+};
+
+// Debug messages sent by the core that aren't part of AppMessages.h. They
+// are meant for host tools listening on the serial link.
+#define MSG_ID_DB_TRANSPORT_STATS (0xFE10)
+#define MSG_ID_DB_LOOPBACK_BENCH (0xFE11)
+#define MSG_ID_DB_POWER_STATS (0xFE12)
+#define MSG_ID_DB_PROFILE (0xFE13)
+#define MSG_ID_DB_TRACE (0xFE14)
+#define MSG_ID_DB_MEMORY_STATS (0xFE15)
+#define MSG_ID_DB_LATENCY (0xFE16)
+
+// Transport extensions that aren't part of AppMessages.h either. The CC end
+// has to implement them; see beanModuleEmulator/BeanCCStandIn.py.
+//
+// A bulk write is a numbered run of frames: MSG_ID_BULK_START (seq, total
+// length as uint32 LE) followed by MSG_ID_BULK_DATA (seq, data). The CC
+// answers with MSG_ID_BULK_ACK (next seq expected) and drops frames out of
+// order, so anything unacked is simply sent again (go-back-N).
+#define MSG_ID_BULK_START (0x0A00)
+#define MSG_ID_BULK_DATA (0x0A01)
+#define MSG_ID_BULK_ACK (0x0A02)
+
+typedef enum {
+  BULK_IDLE,
+  BULK_SENDING,
+  BULK_DONE,
+  BULK_FAILED,
+  BULK_CANCELLED
+} BULK_STATUS_T;
+
+// Copies up to length bytes of the payload, starting at offset, to buffer.
+// Called again for the same offset when frames are resent.
+typedef size_t (*BulkReader)(uint32_t offset, uint8_t *buffer, size_t length);
+typedef void (*BulkCallback)(BULK_STATUS_T status, uint32_t acked,
+                             uint32_t length);
+
+#define BULK_DEFAULT_WINDOW (4)
+#define BULK_MAX_WINDOW (16)
+
+// Compressed virtual serial data: a flags byte, then an LZSS stream whose
+// window carries over from frame to frame. See BeanCompression.cpp.
+#define MSG_ID_SERIAL_DATA_LZ (0x0A10)
+#define LZ_FLAG_RESET (0x01)  // window emptied before this frame
+#define LZ_WINDOW_SIZE (128)
+// Frames between resets, outside reliable mode
+#define LZ_RESET_FRAMES (16)
+
+// Records from a TelemetryEncoder, see BeanTelemetry.h
+#define MSG_ID_TELEMETRY (0x0A20)
+
+// Reliable mode wraps each frame write_message() sends as
+// MSG_ID_RELIABLE_DATA (seq, base, message ID, body), base being the oldest
+// seq the sender hasn't given up on. The receiver delivers in seq order,
+// skips ahead to base, and answers with MSG_ID_RELIABLE_ACK (next seq
+// expected, bitmap of which of the 8 seqs after that it already holds).
+// Unacked frames are resent, except the ones in the bitmap, and given up on
+// after RELIABLE_MAX_RETRIES resends. MSG_ID_RELIABLE_RESET starts both ends
+// over at seq 0. The Bean holds no frames out of order, so its acks never
+// set the bitmap.
+#define MSG_ID_RELIABLE_DATA (0x0A30)
+#define MSG_ID_RELIABLE_ACK (0x0A31)
+#define MSG_ID_RELIABLE_RESET (0x0A32)
+#define RELIABLE_HEADER_LENGTH (4)
+// Frames in flight, each taking ~70 bytes of RAM; a power of two.
+#define RELIABLE_HISTORY_SIZE (4)
+#define RELIABLE_MAX_RETRIES (4)
+
+// A container carries several messages in one frame, each as (message ID,
+// length, body). With containers enabled, write_message() queues messages
+// for up to CONTAINER_WINDOW_MS and sends them together; received containers
+// are unpacked and routed as if each message had its own frame. The queue
+// goes out with the next message, frame, flush() or request after the
+// window, or from poll() once loop() returns.
+#define MSG_ID_CONTAINER (0x0A40)
+#define CONTAINER_HEADER_LENGTH (3)
+#define CONTAINER_WINDOW_MS (2)
+
+// The CC link starts at LINK_RATE_DEFAULT. begin() then offers the CC the
+// rates in BEAN_LINK_RATES (build.link_rates in boards.txt) that F_CPU
+// divides exactly with U2X, as big-endian uint32s in a MSG_ID_LINK_RATE
+// request. The CC answers with the one it picked and switches to it; so does
+// the Bean, and the switch stands once the CC echoes MSG_ID_LINK_RATE_CONFIRM
+// back at the new rate. Otherwise the Bean goes back to LINK_RATE_DEFAULT,
+// and the CC does too after LINK_RATE_CONFIRM_WINDOW_MS without a confirm.
+// Negotiating costs up to LINK_RATE_TIMEOUT_MS at every boot, and a failed
+// confirm LINK_RATE_CONFIRM_WINDOW_MS more, so a BEAN_LINK_RATES of just
+// LINK_RATE_DEFAULT skips it.
+#define MSG_ID_LINK_RATE (0x0A50)
+#define MSG_ID_LINK_RATE_CONFIRM (0x0A51)
+#define LINK_RATE_DEFAULT (38400UL)
+#define LINK_RATE_MAX_OFFERS (4)
+#define LINK_RATE_TIMEOUT_MS (20)
+#define LINK_RATE_SETTLE_MS (2)
+#define LINK_RATE_CONFIRM_WINDOW_MS (100)
+
+#ifndef BEAN_LINK_RATES
+#define BEAN_LINK_RATES LINK_RATE_DEFAULT
+#endif
+
+// Packet mode keeps received MSG_ID_SERIAL_DATA frames whole: a frame only
+// joins the receive buffer once its CRC checks out and all of it fits, and
+// readPacket() hands back one frame at a time. Up to PACKET_QUEUE_SIZE frames
+// can wait to be read.
+#define PACKET_QUEUE_SIZE (4)
+
+struct ReliableStats {
+  uint16_t sent;
+  uint16_t retransmits;       // after a timeout
+  uint16_t fast_retransmits;  // after an ack reported a gap
+  uint16_t given_up;
+  uint16_t duplicates;  // received frames dropped as repeats or out of order
+  uint16_t skipped;     // received seqs the sender gave up on
+};
+
+#define MAX_BODY_LENGTH (APP_MSG_MAX_LENGTH - 2)
+
 // Used for waking the CC out of deep sleep mode.
 #define UART_DEFAULT_WAKE_WAIT (7)
 #define UART_DEFAULT_SEND_WAIT (13)
 
+// How long a cached BT_STATES_T is served before a refresh is requested.
+#define BT_STATES_REFRESH_MS (500)
+
+// Default time-to-live of cached sensor readings. A TTL of 0 reads the CC on
+// every call.
+#define TEMPERATURE_CACHE_TTL_MS (5000)
+#define BATTERY_CACHE_TTL_MS (60000)
+
+// Round trips are timed separately per class of request, since a local CC
+// read and a round trip through the connected central differ by 10x.
+typedef enum {
+  RTT_CLASS_RADIO,       // radio configuration and state (MSG_ID_BT_*)
+  RTT_CLASS_PERIPHERAL,  // LED, accelerometer and sensors (MSG_ID_CC_*)
+  RTT_CLASS_REMOTE,      // anything that goes out over the air and back
+  RTT_CLASS_OTHER,
+  RTT_CLASS_BULK,        // bulk data frames, acked by the CC as they arrive
+  NUM_RTT_CLASSES
+} RTT_CLASS_T;
+
+// Smoothed round trip time and mean deviation (RFC 6298) of one class. The
+// timeout of the next request is srtt + 4 * rttvar, doubled after every
+// timeout until a reply is timed again.
+struct RttStats {
+  uint16_t srtt_ms;
+  uint16_t rttvar_ms;
+  uint16_t rto_ms;
+  uint16_t samples;
+  uint16_t timeouts;  // attempts that went unanswered
+  uint16_t failures;  // requests that failed after all retries
+};
+
+#define RTT_INITIAL_TIMEOUT_MS (100)
+#define RTT_REMOTE_INITIAL_TIMEOUT_MS (250)
+#define RTT_MIN_TIMEOUT_MS (20)
+#define RTT_MAX_TIMEOUT_MS (500)
+
+// How many times a request that gets no reply is sent again.
+#define REQUEST_DEFAULT_RETRIES (2)
+
 class BeanSerialTransport : public HardwareSerial {
   friend class BeanClass;
   friend class BeanMidiClass;
   friend class BeanAncsClass;
   friend class BeanHid_;
+  friend class TelemetryFrameWriter;
+  friend class TelemetryBufferWriter;
 
  private:
   uint32_t m_wakeDelay;
   uint32_t m_enforcedDelay;
 
+  // Last known advertising/connection state. Updated from replies to
+  // MSG_ID_BT_GET_STATES and from state changes pushed by the CC.
+  BT_STATES_T m_btStates;
+  bool m_btStatesValid;
+  bool m_btStatesExpired;
+  bool m_btStatesRefresh;  // a refresh waiting for post_request()
+  uint32_t m_btStatesMillis;
+  uint32_t m_btStatesRequestMillis;
+  bool m_connectionReported;  // conn_state as last passed to the callback
+  void (*m_connectionCallback)(bool connected);
+
+  size_t (BeanSerialTransport::*m_serialWriter)(const uint8_t *buffer,
+                                                size_t size);
+  size_t writeCompressed(const uint8_t *buffer, size_t size);
+
+  size_t (BeanSerialTransport::*m_reliableWriter)(uint16_t messageId,
+                                                  const uint8_t *body,
+                                                  size_t body_length);
+  void (BeanSerialTransport::*m_reliablePump)(void);
+  size_t reliableWrite(uint16_t messageId, const uint8_t *body,
+                       size_t body_length);
+  void reliablePump(void);
+  void reliableSend(uint8_t seq);
+
+  size_t (BeanSerialTransport::*m_containerWriter)(uint16_t messageId,
+                                                   const uint8_t *body,
+                                                   size_t body_length);
+  void (BeanSerialTransport::*m_containerPump)(bool flush);
+  size_t containerWrite(uint16_t messageId, const uint8_t *body,
+                        size_t body_length);
+  void containerPump(bool flush);
+  void containerSend(void);
+  void deliver_message(uint16_t messageId, const uint8_t *body,
+                       size_t body_length);
+
+  void (BeanSerialTransport::*m_bulkPump)(void);
+  void bulkPump(void);
+  void bulkSend(uint32_t frame);
+  void bulkFinish(BULK_STATUS_T status);
+
+  void requestStates(void);
+  void sendRefreshes(void);
+  void foldReplies(void);
+  void foldStates(const BT_STATES_T &states);
+
+  CachedReading m_sensors[NUM_CACHED_SENSORS];
+
+  int readSensor(CACHED_SENSOR_T sensor, uint8_t *value);
+  void requestSensor(CACHED_SENSOR_T sensor);
+
+  // Scaled as in Jacobson's paper: srtt is kept x8 and rttvar x4.
+  struct RttEstimator {
+    uint16_t srtt;
+    uint16_t rttvar;
+    uint16_t rto_ms;
+    uint16_t samples;
+    uint16_t timeouts;
+    uint16_t failures;
+  };
+  RttEstimator m_rtt[NUM_RTT_CLASSES];
+  uint8_t m_requestRetries;
+  bool m_requestFailed;
+  uint32_t m_frameMillis;  // when end_frame() last queued a frame
+  uint32_t m_linkRate;
+
+  // When the last post_request() frame went out, if its send delay hasn't
+  // been waited out yet
+  bool m_posted;
+  uint32_t m_postMillis;
+
+  void set_link_rate(uint32_t rate);
+  bool negotiateLinkRate(const uint32_t *rates, uint8_t count);
+
+  void rttSample(RttEstimator *rtt, uint16_t rtt_ms);
+  int request(MSG_ID_T messageId, const uint8_t *body, size_t body_length,
+              volatile bool *replied, ring_buffer *reply,
+              unsigned long timeout_ms);
+
  protected:
   ring_buffer *_reply_buffer;
-  void insert_escaped_char(uint8_t input);
   volatile bool *_message_complete;
 
   size_t write_message(uint16_t messageId, const uint8_t *body,
                        size_t body_length);
+  // write_message() without going through a container
+  size_t send_message(uint16_t messageId, const uint8_t *body,
+                      size_t body_length);
+  // Just the frame, without waking the CC or the send delay.
+  size_t write_frame(uint16_t messageId, const uint8_t *body,
+                     size_t body_length);
+  // write_frame() a byte at a time, for bodies that are encoded as they are
+  // sent: exactly body_length frame_byte() calls, then end_frame().
+  void begin_frame(uint16_t messageId, size_t body_length);
+  void frame_byte(uint8_t c);
+  void end_frame(void);
+  // The parts of write_message() around the frame
+  void wake_cc(void);
+  void send_delay(void);
+  // A request without a body, sent only if that doesn't mean waiting for the
+  // CC to wake or for the send delay; false if it wasn't sent. Its reply is
+  // routed like any other.
+  bool post_request(uint16_t messageId);
+  // Raises or lowers CC_INTERRUPT_PIN, keeping track of when it went high
+  void set_wake_line(uint8_t level);
+  // Keeps CC_INTERRUPT_PIN raised between frames while hold is set.
+  void holdCCAwake(bool hold);
 
+  // A timeout of 0 uses the adaptive timeout of the message's RTT class.
+  // Only the reads listed in request_idempotent() are retried; add a new
+  // request there if sending it twice does no harm.
   int call_and_response(MSG_ID_T messageId, const uint8_t *body,
                         size_t body_length, uint8_t *response,
                         size_t *response_length,
-                        unsigned long timeout_ms = 100);
+                        unsigned long timeout_ms = 0);
 
   // API Control
   // BT
@@ -58,6 +443,12 @@ class BeanSerialTransport : public HardwareSerial {
   void BTConfigUartSleep(UART_SLEEP_MODE_T mode);
   void BTDisconnect(void);
   void BTRestart(void);
+  void BTSetConnectionCallback(void (*callback)(bool connected));
+
+  // Forget cached CC state, e.g. after the ATmega slept and millis() stopped.
+  void expireCaches(void);
+  // Forget only the BT state, after something that changes it.
+  void expireStates(void);
 
   // LED Control
   void ledSet(const LED_SETTING_T &setting);
@@ -100,6 +491,14 @@ class BeanSerialTransport : public HardwareSerial {
   // battery
   int batteryRead(uint8_t *level);
 
+  void setSensorCacheTtl(CACHED_SENSOR_T sensor, uint32_t ttl_ms);
+
+  // Request timing
+  void setRequestRetries(uint8_t retries);
+  void getRttStats(RTT_CLASS_T rttClass, RttStats *stats);
+  // Whether the last request, or cached read, went unanswered
+  bool lastRequestFailed(void) { return m_requestFailed; }
+
   // Arduino Sleep
   void sleep(uint32_t duration_ms);
   void enableWakeOnConnect(bool enable);
@@ -111,15 +510,16 @@ class BeanSerialTransport : public HardwareSerial {
   void  BTSetConfig(BT_RADIOCONFIG_T config, bool save);
 
   // To work on bean, the serial must be initialized
-  // at 57600 with standard settings, and cannot be disabled
+  // at the negotiated link rate with standard settings, and cannot be disabled
   // or all control messaging will break.  We've overidden begin() and end()
-  // functions to not do a whole heck of a lot as a result.
+  // functions to not do a whole heck of a lot as a result. Use setLinkRate()
+  // to change the rate.
   void begin(void);
-  virtual void begin(unsigned long ignored) {
+  virtual void begin(unsigned long /* ignored */) {
     // Do nothing.
     // We're overiding what users can do here.
   }
-  virtual void begin(unsigned long ignored, uint8_t also_ignored) {
+  virtual void begin(unsigned long /* ignored */, uint8_t /* ignored */) {
     // Do nothing.
     // We're overiding what users can do here.
   }
@@ -130,6 +530,78 @@ class BeanSerialTransport : public HardwareSerial {
 
   virtual void flush(void);
 
+  // Runs work deferred out of the RX interrupt, such as folding pushed state
+  // into the caches and calling the connection callback. Called from main()
+  // after every loop(). The sketch's callbacks only ever run from here, never
+  // from a getter.
+  void poll(void);
+
+  // Routes message IDs firstId..lastId to a sink. target is the ring_buffer
+  // for SINK_RING, the FrameSlot for SINK_SLOT and SINK_CALLBACK, and NULL
+  // otherwise. Fails if the table is full or the range overlaps another one.
+  bool addRoute(uint16_t firstId, uint16_t lastId, MESSAGE_SINK_T sink,
+                void *target);
+  void removeRoute(uint16_t firstId);
+
+  // Bulk writes. Sends length bytes, fetched through reader as needed, with
+  // up to window frames waiting for an ack instead of one send delay per
+  // frame. Progress and the outcome are reported to callback from poll().
+  // Fails if a transfer is already running or no route is free for acks.
+  bool beginBulkWrite(uint32_t length, BulkReader reader, BulkCallback callback,
+                      uint8_t window = BULK_DEFAULT_WINDOW);
+  // data has to stay valid until the transfer is over.
+  bool beginBulkWrite(const uint8_t *data, uint32_t length,
+                      BulkCallback callback);
+  BULK_STATUS_T bulkWriteStatus(void);
+  void cancelBulkWrite(void);
+
+  // Compresses virtual serial data written from here on. Frames that don't
+  // shrink are still sent raw, so the other end has to understand both. A
+  // lost frame garbles what follows up to the next window reset, at most
+  // LZ_RESET_FRAMES frames later; in reliable mode nothing is lost.
+  void enableCompression(bool enable);
+
+  // Sequence numbers, acks and retransmission for everything sent with
+  // write_message(). The other end has to speak it too.
+  void enableReliable(bool enable);
+  void getReliableStats(ReliableStats *stats);
+
+  // Batches messages sent back to back into container frames, so they share
+  // one frame's overhead and send delay. The other end has to unpack them.
+  // The core's own waits (requests, flush(), Bean.sleep()) send the queue
+  // first, but delay() doesn't: a sketch that sends and then waits in
+  // delay() holds its last messages until loop() returns, so it should call
+  // flush() before the delay().
+  void enableContainers(bool enable);
+
+  // Rate of the UART link to the CC. setLinkRate() negotiates a new one with
+  // the CC, which has to support it; on failure the link is left at
+  // LINK_RATE_DEFAULT.
+  uint32_t getLinkRate(void);
+  bool setLinkRate(uint32_t rate);
+
+  // Packet mode. packetAvailable() is the length of the oldest whole packet
+  // received, or -1 if there is none. readPacket() reads it and returns its
+  // full length, or -1. A packet longer than length is still taken off the
+  // queue, with only its first length bytes copied, as recvfrom() does with
+  // MSG_TRUNC; a return above length means it was cut short. Size buffer
+  // from packetAvailable() to avoid that. read() and friends still work, and
+  // can eat into packets.
+  void enablePackets(bool enable);
+  int packetAvailable(void);
+  int readPacket(uint8_t *buffer, size_t length);
+
+  // Transport statistics
+  void getTransportStats(TransportStats *stats);
+  void resetTransportStats(void);
+
+  // Power accounting. Bean.sleep() reports each power-down with
+  // countSleep() and the time it spent in delay() with countDelay().
+  void getPowerStats(PowerStats *stats);
+  void resetPowerStats(void);
+  void countDelay(uint32_t duration_ms);
+  void countSleep(uint32_t duration_ms);
+
   virtual size_t write(uint8_t);
   size_t write(const uint8_t *buffer, size_t size);
 
@@ -142,10 +614,32 @@ class BeanSerialTransport : public HardwareSerial {
   // Debug
   bool debugLoopbackVerify(const uint8_t *message, const size_t size);
   bool debugEndToEndLoopbackVerify(const uint8_t *message, const size_t size);
+  // Times iterations round trips of size bytes over MSG_ID_DB_LOOPBACK, or
+  // MSG_ID_DB_E2E_LOOPBACK through the phone, without retries. Returns 0 if
+  // every one came back intact. The wake and send delays are part of every
+  // round trip unless Bean.keepAwake(true) turns them off.
+  int debugLoopbackBenchmark(uint8_t size, uint16_t iterations,
+                             LoopbackBenchResult *result,
+                             bool endToEnd = false);
+  // debugLoopbackBenchmark() for sizes from 1 to MAX_BODY_LENGTH, doubling.
+  // Each result is printed to report as a table row, or sent as a
+  // MSG_ID_DB_LOOPBACK_BENCH message without one.
+  void debugLoopbackSweep(uint16_t iterations, Print *report = NULL,
+                          bool endToEnd = false);
   int debugGetDebugCounter(int *counter);
   void debugWrite(const char c) { HardwareSerial::write((uint8_t)c); }
   void debugLoopBackFullSerialMessages(void);
   void debugWritePtm(const uint8_t *message, const size_t size);
+  void debugWriteTransportStats(void);
+  void debugWritePowerStats(void);
+  // The BeanProfile.h table, a message a section
+  void debugWriteProfile(void);
+  // The BeanTrace.h ring, oldest first
+  void debugWriteTrace(void);
+  // getMemoryStats(), see BeanMemory.h
+  void debugWriteMemoryStats(void);
+  // The BeanLatency.h histograms, then a message a site
+  void debugWriteLatency(void);
 
   // constructor
   BeanSerialTransport(ring_buffer *rx_buffer, ring_buffer *tx_buffer,
@@ -162,6 +656,35 @@ class BeanSerialTransport : public HardwareSerial {
     *message_complete = false;
     m_wakeDelay = UART_DEFAULT_WAKE_WAIT;
     m_enforcedDelay = UART_DEFAULT_SEND_WAIT;
+    m_btStatesValid = false;
+    m_btStatesExpired = false;
+    m_btStatesRefresh = false;
+    m_btStatesMillis = 0;
+    m_btStatesRequestMillis = 0;
+    m_connectionReported = false;
+    m_connectionCallback = NULL;
+    m_bulkPump = NULL;
+    m_serialWriter = NULL;
+    m_reliableWriter = NULL;
+    m_reliablePump = NULL;
+    m_containerWriter = NULL;
+    m_containerPump = NULL;
+
+    memset(m_sensors, 0, sizeof(m_sensors));
+    m_sensors[CACHED_TEMPERATURE].ttl_ms = TEMPERATURE_CACHE_TTL_MS;
+    m_sensors[CACHED_BATTERY].ttl_ms = BATTERY_CACHE_TTL_MS;
+
+    memset(m_rtt, 0, sizeof(m_rtt));
+    for (uint8_t i = 0; i < NUM_RTT_CLASSES; i++) {
+      m_rtt[i].rto_ms = RTT_INITIAL_TIMEOUT_MS;
+    }
+    m_rtt[RTT_CLASS_REMOTE].rto_ms = RTT_REMOTE_INITIAL_TIMEOUT_MS;
+    m_requestRetries = REQUEST_DEFAULT_RETRIES;
+    m_requestFailed = false;
+    m_frameMillis = 0;
+    m_linkRate = LINK_RATE_DEFAULT;
+    m_posted = false;
+    m_postMillis = 0;
   }  // End constructor
 };   // End BeanSerialTransport
 
@@ -0,0 +1,264 @@
+#ifndef BEAN_TELEMETRY_H
+#define BEAN_TELEMETRY_H
+
+#include "Arduino.h"
+
+// Compact binary records, sent as MSG_ID_TELEMETRY frames instead of printed
+// text. The record struct describes its own layout with a member template,
+// which the encoder instantiates once to size the frame and once to encode
+// it straight into the frame as it goes out, so there is no schema table and
+// no body buffer. Reliable mode and containers need the body whole, so with
+// either on it is encoded on the stack and sent with write_message():
+//
+//   struct Reading {
+//     uint32_t time;
+//     int16_t temperature;
+//     int16_t x, y, z;
+//     bool moving;
+//
+//     template <typename Fields>
+//     void telemetry(Fields &f, const Reading &prev) const {
+//       f.delta(time, prev.time);
+//       f.delta(temperature, prev.temperature);
+//       f.delta(x, prev.x);
+//       f.delta(y, prev.y);
+//       f.delta(z, prev.z);
+//       f.flag(moving);
+//     }
+//   };
+//
+//   TelemetryEncoder<Reading> telemetry(1);
+//   telemetry.write(reading);
+//
+// Frame body: [schema ID][TELEMETRY_KEY | sequence][fields]. Fields are
+//
+//   value(v)     varint, zig-zag encoded if v is signed
+//   delta(v, p)  zig-zag varint of v - p, wrapping at the width of v
+//   flag(b)      one bit; each 8 flags (or the last few) take a byte, sent
+//                after the field that fills it (or at the end of the record)
+//   fixed(v)     sizeof(v) bytes, little endian; for floats
+//
+// In a key record every field is encoded against a zeroed record, so a
+// decoder can start there. Every keyInterval-th record is a key record.
+// beanModuleEmulator/BeanTelemetry.py decodes records given the same field
+// list.
+
+#define TELEMETRY_KEY (0x80)
+#define TELEMETRY_SEQUENCE_MASK (0x7F)
+#define TELEMETRY_DEFAULT_KEY_INTERVAL (16)
+
+template <typename T>
+struct TelemetryTraits {};
+template <>
+struct TelemetryTraits<uint8_t> {
+  typedef uint8_t Unsigned;
+  typedef int8_t Signed;
+};
+template <>
+struct TelemetryTraits<int8_t> {
+  typedef uint8_t Unsigned;
+  typedef int8_t Signed;
+};
+template <>
+struct TelemetryTraits<uint16_t> {
+  typedef uint16_t Unsigned;
+  typedef int16_t Signed;
+};
+template <>
+struct TelemetryTraits<int16_t> {
+  typedef uint16_t Unsigned;
+  typedef int16_t Signed;
+};
+template <>
+struct TelemetryTraits<uint32_t> {
+  typedef uint32_t Unsigned;
+  typedef int32_t Signed;
+};
+template <>
+struct TelemetryTraits<int32_t> {
+  typedef uint32_t Unsigned;
+  typedef int32_t Signed;
+};
+
+// Counts the bytes of a record
+class TelemetrySizer {
+ public:
+  TelemetrySizer() : length(0) {}
+  void byte(uint8_t) { length++; }
+  size_t length;
+};
+
+// Encodes a record straight into a MSG_ID_TELEMETRY frame, for a record the
+// sizer has found to be length bytes long
+class TelemetryFrameWriter {
+ public:
+  // Reliable mode keeps a copy of every body, and containers queue them
+  static bool streams(void) {
+    return !Serial.m_reliableWriter && !Serial.m_containerWriter;
+  }
+
+  explicit TelemetryFrameWriter(size_t length) {
+    Serial.wake_cc();
+    Serial.begin_frame(MSG_ID_TELEMETRY, length);
+  }
+  void byte(uint8_t c) { Serial.frame_byte(c); }
+  void send(void) {
+    Serial.end_frame();
+    Serial.send_delay();
+  }
+};
+
+// Encodes a record into a body on the stack, for write_message()
+class TelemetryBufferWriter {
+ public:
+  TelemetryBufferWriter() : m_length(0) {}
+  void byte(uint8_t c) { m_body[m_length++] = c; }
+  void send(void) {
+    Serial.write_message(MSG_ID_TELEMETRY, m_body, m_length);
+  }
+
+ private:
+  uint8_t m_body[MAX_BODY_LENGTH];
+  size_t m_length;
+};
+
+template <typename Sink>
+class TelemetryFields {
+ public:
+  explicit TelemetryFields(Sink &sink) : m_sink(sink), m_flags(0), m_bit(0) {}
+
+  template <typename T>
+  void value(T v) {
+    typedef typename TelemetryTraits<T>::Unsigned U;
+    typedef typename TelemetryTraits<T>::Signed S;
+    if ((T)-1 < 0) {
+      putZigZag<U>((S)v);
+    } else {
+      put((U)v);
+    }
+  }
+
+  template <typename T>
+  void delta(T v, T prev) {
+    typedef typename TelemetryTraits<T>::Unsigned U;
+    typedef typename TelemetryTraits<T>::Signed S;
+    putZigZag<U>((S)(U)((U)v - (U)prev));
+  }
+
+  void flag(bool b) {
+    if (b) {
+      m_flags |= 1 << m_bit;
+    }
+    if (++m_bit == 8) {
+      m_sink.byte(m_flags);
+      m_flags = 0;
+      m_bit = 0;
+    }
+  }
+
+  template <typename T>
+  void fixed(T v) {
+    const uint8_t *bytes = (const uint8_t *)&v;
+    for (uint8_t i = 0; i < sizeof(v); i++) {
+      m_sink.byte(bytes[i]);
+    }
+  }
+
+  // Sends the flags byte that hasn't filled up
+  void finish(void) {
+    if (m_bit) {
+      m_sink.byte(m_flags);
+    }
+  }
+
+ private:
+  template <typename U>
+  void put(U v) {
+    while (v >= 0x80) {
+      m_sink.byte((uint8_t)v | 0x80);
+      v >>= 7;
+    }
+    m_sink.byte((uint8_t)v);
+  }
+
+  template <typename U, typename S>
+  void putZigZag(S v) {
+    put((U)(((U)v << 1) ^ (U)(v >> (sizeof(v) * 8 - 1))));
+  }
+
+  Sink &m_sink;
+  uint8_t m_flags;
+  uint8_t m_bit;
+};
+
+template <typename Record>
+class TelemetryEncoder {
+ public:
+  explicit TelemetryEncoder(
+      uint8_t schemaId, uint8_t keyInterval = TELEMETRY_DEFAULT_KEY_INTERVAL)
+      : m_schemaId(schemaId),
+        m_keyInterval(keyInterval),
+        m_sequence(0),
+        m_sinceKey(0) {}
+
+  // Sends one record as one frame. Returns false, sending nothing, if the
+  // record doesn't fit in a frame.
+  bool write(const Record &record) {
+    bool key = m_sinceKey == 0;
+    if (key) {
+      memset(&m_prev, 0, sizeof(m_prev));
+    }
+
+    TelemetrySizer sizer;
+    TelemetryFields<TelemetrySizer> size(sizer);
+    record.telemetry(size, m_prev);
+    size.finish();
+    if (sizer.length + 2 > MAX_BODY_LENGTH) {
+      return false;
+    }
+
+    if (TelemetryFrameWriter::streams()) {
+      TelemetryFrameWriter writer(sizer.length + 2);
+      encode(writer, record, key);
+    } else {
+      sendBuffered(record, key);
+    }
+
+    m_prev = record;
+    m_sequence++;
+    if (++m_sinceKey >= m_keyInterval) {
+      m_sinceKey = 0;
+    }
+    return true;
+  }
+
+  // Makes the next record a key record, e.g. when the host has just
+  // connected and can't have seen the last one.
+  void sendKey(void) { m_sinceKey = 0; }
+
+ private:
+  template <typename Writer>
+  void encode(Writer &writer, const Record &record, bool key) {
+    writer.byte(m_schemaId);
+    writer.byte((key ? TELEMETRY_KEY : 0) |
+                (m_sequence & TELEMETRY_SEQUENCE_MASK));
+    TelemetryFields<Writer> fields(writer);
+    record.telemetry(fields, m_prev);
+    fields.finish();
+    writer.send();
+  }
+
+  // Out of line, so that only this path puts a body on the stack
+  __attribute__((noinline)) void sendBuffered(const Record &record, bool key) {
+    TelemetryBufferWriter writer;
+    encode(writer, record, key);
+  }
+
+  Record m_prev;
+  uint8_t m_schemaId;
+  uint8_t m_keyInterval;
+  uint8_t m_sequence;
+  uint8_t m_sinceKey;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "Arduino.h"
+#include "BeanSerialTransport.h"
+#include "BeanTrace.h"
+
+// The trace ring lives in its own file so sketches built without BEAN_TRACE
+// don't carry it.
+
+#if defined(BEAN_TRACE)
+
+static TraceRecord trace_ring[BEAN_TRACE_RECORDS];
+static uint8_t trace_next = 0;
+static uint8_t trace_count = 0;
+// Set while the ring is being sent, whose own frames would overwrite it
+static volatile bool trace_paused = false;
+
+extern "C" volatile unsigned long timer0_overflow_count;
+
+void traceEvent(uint8_t event, uint16_t arg) {
+  uint8_t oldSREG = SREG;
+
+  // Timer0 read as micros() reads it, inside this one critical section
+  cli();
+  if (!trace_paused) {
+    uint8_t overflows = (uint8_t)timer0_overflow_count;
+    uint8_t ticks = TCNT0;
+    if ((TIFR0 & _BV(TOV0)) && ticks < 255) {
+      overflows++;
+    }
+    TraceRecord *record = &trace_ring[trace_next];
+    record->stamp = ((uint16_t)overflows << 8) | ticks;
+    record->arg = arg;
+    record->event = event;
+    if (++trace_next == BEAN_TRACE_RECORDS) {
+      trace_next = 0;
+    }
+    if (trace_count < BEAN_TRACE_RECORDS) {
+      trace_count++;
+    }
+  }
+  SREG = oldSREG;
+}
+
+void traceClear(void) {
+  noInterrupts();
+  trace_next = 0;
+  trace_count = 0;
+  interrupts();
+}
+
+static uint8_t trace_request[1];
+
+static void trace_requested(uint16_t, const uint8_t *, uint8_t) {
+  Serial.debugWriteTrace();
+}
+
+static FrameSlot trace_slot = {trace_request, sizeof(trace_request), 0,
+                               false, 0, trace_requested};
+
+void traceBegin(void) {
+  static bool routed = false;
+
+  if (!routed) {
+    routed = Serial.addRoute(MSG_ID_DB_TRACE, MSG_ID_DB_TRACE, SINK_CALLBACK,
+                             &trace_slot);
+  }
+}
+
+void BeanSerialTransport::debugWriteTrace(void) {
+  static const uint8_t per_message =
+      (MAX_BODY_LENGTH - TRACE_HEADER_LENGTH) / TRACE_RECORD_LENGTH;
+  uint8_t body[TRACE_HEADER_LENGTH + per_message * TRACE_RECORD_LENGTH];
+
+  trace_paused = true;
+  uint8_t remaining = trace_count;
+  uint8_t i = (trace_next + BEAN_TRACE_RECORDS - trace_count) %
+              BEAN_TRACE_RECORDS;
+  do {
+    uint8_t records = min(remaining, per_message);
+    uint8_t *out = body + TRACE_HEADER_LENGTH;
+    remaining -= records;
+    body[0] = remaining;
+    body[1] = 64 / clockCyclesPerMicrosecond();
+    for (uint8_t j = 0; j < records; j++) {
+      const TraceRecord *record = &trace_ring[i];
+      out[0] = record->event;
+      memcpy(out + 1, &record->arg, sizeof(record->arg));
+      memcpy(out + 3, &record->stamp, sizeof(record->stamp));
+      out += TRACE_RECORD_LENGTH;
+      if (++i == BEAN_TRACE_RECORDS) {
+        i = 0;
+      }
+    }
+    write_message(MSG_ID_DB_TRACE, body, out - body);
+  } while (remaining > 0);
+  trace_paused = false;
+}
+
+#else
+
+void BeanSerialTransport::debugWriteTrace(void) {
+  write_message(MSG_ID_DB_TRACE, NULL, 0);
+}
+
+#endif
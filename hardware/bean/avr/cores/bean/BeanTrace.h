@@ -0,0 +1,77 @@
+#ifndef BEAN_TRACE_H
+#define BEAN_TRACE_H
+
+#include <stdint.h>
+
+// A ring of the transport's last events, for working out afterwards what a
+// Bean in the field was doing. Built with BEAN_TRACE defined (Tools > Trace
+// in the IDE), the core records the events below as they happen, and a
+// MSG_ID_DB_TRACE message from the host, or Serial.debugWriteTrace(), sends
+// the ring back oldest first. beanModuleEmulator/BeanTrace.py renders it as
+// a timeline; BeanCCStandIn.py --trace-every asks for it.
+//
+// Each event costs a read of timer0 and a 5 byte store, about 40 cycles,
+// all of it in one critical section. Events are stamped with 16 bits of
+// timer0's ticks of 64 cycles (8 us on the Bean, 4 us on the Bean+), which
+// wrap every 524 or 262 ms; BeanTrace.py unwraps them, assuming events that
+// far apart don't follow each other. Without BEAN_TRACE, TRACE() is empty.
+// Sketches can add their own events from TRACE_USER up.
+
+enum {
+  TRACE_NONE,
+  TRACE_TX_START,     // arg: message ID; a frame starts into the tx buffer
+  TRACE_TX_END,       // the whole frame is in the tx buffer
+  TRACE_RX_START,     // arg: message ID; its header has arrived
+  TRACE_RX_END,       // arg: message ID; its CRC checked out
+  TRACE_CRC_FAILURE,  // arg: message ID
+  TRACE_TIMEOUT,      // arg: message ID of a request that went unanswered
+  TRACE_SLEEP,        // arg: ms asked for, at most 0xFFFF; powering down
+  TRACE_WAKE,         // arg: ms spent powered down, at most 0xFFFF
+  TRACE_WAKE_LINE,    // arg: the level the CC's wake line changed to
+  TRACE_OVERRUN,      // arg: a TRACE_OVERRUN_* cause
+  TRACE_USER
+};
+
+enum {
+  TRACE_OVERRUN_UART,  // a byte came in before the last was read
+  TRACE_OVERRUN_RING   // a byte found its ring buffer full
+};
+
+#ifndef BEAN_TRACE_RECORDS
+#define BEAN_TRACE_RECORDS (40)
+#endif
+
+// One event. On the wire it is packed: event, arg and stamp, little endian.
+// Each MSG_ID_DB_TRACE body starts with the number of records still to come
+// after it and the microseconds in a tick.
+struct TraceRecord {
+  uint16_t stamp;  // low byte of timer0's overflow count, then TCNT0
+  uint16_t arg;
+  uint8_t event;
+};
+
+#define TRACE_RECORD_LENGTH (5)
+#define TRACE_HEADER_LENGTH (2)
+
+#if defined(BEAN_TRACE)
+
+#define TRACE(event, arg) traceEvent((event), (arg))
+
+void traceEvent(uint8_t event, uint16_t arg);
+void traceClear(void);
+
+// Answers MSG_ID_DB_TRACE from the host; called by Serial.begin()
+void traceBegin(void);
+
+#else
+
+#define TRACE(event, arg) \
+  do {                    \
+  } while (0)
+
+inline void traceClear(void) {}
+inline void traceBegin(void) {}
+
+#endif
+
+#endif
@@ -248,7 +248,6 @@ try_again:
 void HardwareSerial::begin(unsigned long baud, byte config)
 {
   uint16_t baud_setting;
-  uint8_t current_config;
   bool use_u2x = true;
 
 #if F_CPU == 16000000UL
@@ -296,7 +295,7 @@ void HardwareSerial::end()
 {
   // wait for transmission of outgoing data
   while (_tx_buffer->head != _tx_buffer->tail)
-    ;
+    interrupt_wait();
 
   cbi(*_ucsrb, _rxen);
   cbi(*_ucsrb, _txen);
@@ -333,10 +332,90 @@ int HardwareSerial::read(void)
   }
 }
 
+size_t HardwareSerial::peekSpans(StreamSpan spans[2])
+{
+  // read head once; the RX interrupt may move it
+  unsigned int head = _rx_buffer->head;
+  unsigned int tail = _rx_buffer->tail;
+
+  spans[0].data = &_rx_buffer->buffer[tail];
+  spans[1].data = _rx_buffer->buffer;
+  if (head >= tail) {
+    spans[0].length = head - tail;
+    spans[1].length = 0;
+  } else {
+    spans[0].length = SERIAL_BUFFER_SIZE - tail;
+    spans[1].length = head;
+  }
+  return spans[0].length + spans[1].length;
+}
+
+void HardwareSerial::consume(size_t count)
+{
+  unsigned int buffered = available();
+  if (count > buffered) {
+    count = buffered;
+  }
+  _rx_buffer->tail = (unsigned int)(_rx_buffer->tail + count) % SERIAL_BUFFER_SIZE;
+}
+
+// byte i of the buffered bytes described by spans
+static inline uint8_t spanAt(const StreamSpan *spans, size_t i)
+{
+  return i < spans[0].length ? spans[0].data[i] : spans[1].data[i - spans[0].length];
+}
+
+int HardwareSerial::findBuffered(char delimiter)
+{
+  StreamSpan spans[2];
+  peekSpans(spans);
+
+  for (uint8_t s = 0; s < 2; s++) {
+    const void *at = spans[s].length ? memchr(spans[s].data, delimiter, spans[s].length) : NULL;
+    if (at != NULL)
+      return (s ? spans[0].length : 0) + ((const uint8_t *)at - spans[s].data);
+  }
+  return -1;
+}
+
+size_t HardwareSerial::parseIntBuffered(long *value, size_t length)
+{
+  StreamSpan spans[2];
+  size_t buffered = peekSpans(spans);
+  size_t end = length < buffered ? length : buffered;
+  size_t i = 0;
+  boolean isNegative = false;
+  long parsed = 0;
+
+  // skip to the first digit, keeping a minus sign right before it
+  for (; i < end; i++) {
+    uint8_t c = spanAt(spans, i);
+    if (c >= '0' && c <= '9')
+      break;
+    isNegative = (c == '-');
+  }
+  if (i == end)
+    return 0;
+
+  for (; i < end; i++) {
+    uint8_t c = spanAt(spans, i);
+    if (c < '0' || c > '9')
+      break;
+    parsed = parsed * 10 + c - '0';
+  }
+  // ran out of received bytes before length: more digits may be on the way
+  if (i == buffered && i < length)
+    return 0;
+
+  *value = isNegative ? -parsed : parsed;
+  return i;
+}
+
 void HardwareSerial::flush()
 {
   // UDR is kept full while the buffer is not empty, so TXC triggers when EMPTY && SENT
-  while (transmitting && ! (*_ucsra & _BV(TXC0)));
+  while (transmitting && ! (*_ucsra & _BV(TXC0)))
+    interrupt_wait();
   transmitting = false;
 }
 
@@ -348,7 +427,7 @@ size_t HardwareSerial::write(uint8_t c)
   // wait for the interrupt handler to empty it a bit
   // ???: return 0 here instead?
   while (i == _tx_buffer->tail)
-    ;
+    interrupt_wait();
 	
   _tx_buffer->buffer[_tx_buffer->head] = c;
   _tx_buffer->head = i;
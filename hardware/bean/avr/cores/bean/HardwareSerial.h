@@ -51,6 +51,13 @@ struct ring_buffer
 };
 
 
+// A run of received bytes that can be parsed where they are
+struct StreamSpan
+{
+  const uint8_t *data;
+  size_t length;
+};
+
 class HardwareSerial : public Stream
 {
   protected:
@@ -91,6 +98,22 @@ class HardwareSerial : public Stream
     inline size_t write(int n) { return write((uint8_t)n); }
     using Print::write; // pull in write(str) and write(buf, size) from Print
     operator bool();
+
+    // Zero-copy access to what has already been received; nothing here waits.
+    // peekSpans() points spans[0] and spans[1] at the buffered bytes, in order
+    // (the ring wraps at most once), and returns how many there are.
+    // consume() then drops the first count of them. Not virtual, so Stream's
+    // vtable, which every stream class has a copy of, doesn't grow.
+    size_t peekSpans(StreamSpan spans[2]);
+    void consume(size_t count);
+
+    int findBuffered(char delimiter); // offset of delimiter in the buffered bytes, or -1
+
+    size_t parseIntBuffered(long *value, size_t length); // parses the first integer in the first length bytes
+    // skips what comes before it, like parseInt, and stops at the first non-digit or at length
+    // returns how many bytes it took up to the end of the integer, or 0, leaving value alone,
+    // if there is none yet: digits that run to the end of what has been received, short of
+    // length, may be the start of a longer number, so they are left for a later call
 };
 
 
@@ -231,6 +231,8 @@ size_t Print::printFloat(double number, uint8_t digits)
   if (number > 4294967040.0) return print ("ovf");  // constant determined empirically
   if (number <-4294967040.0) return print ("ovf");  // constant determined empirically
   
+  PROFILE_BEGIN(PROFILE_PRINT_FLOAT);
+
   // Handle negative numbers
   if (number < 0.0)
   {
@@ -264,5 +266,6 @@ size_t Print::printFloat(double number, uint8_t digits)
     remainder -= toPrint; 
   } 
   
+  PROFILE_END(PROFILE_PRINT_FLOAT);
   return n;
 }
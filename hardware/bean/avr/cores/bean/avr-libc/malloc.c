@@ -59,6 +59,10 @@ char *__malloc_heap_end = &__heap_end;
 char *__brkval;
 struct __freelist *__flp;
 
+/* Bean: the highest __brkval has been, and how many requests failed */
+char *__malloc_heap_peak;
+unsigned int __malloc_failures;
+
 ATTRIBUTE_CLIB_SECTION
 void *
 malloc(size_t len)
@@ -159,11 +163,13 @@ malloc(size_t len)
 	cp = __malloc_heap_end;
 	if (cp == 0)
 		cp = STACK_POINTER() - __malloc_margin;
-	if (cp <= __brkval)
+	if (cp <= __brkval) {
 	  /*
 	   * Memory exhausted.
 	   */
+	  __malloc_failures++;
 	  return 0;
+	}
 	avail = cp - __brkval;
 	/*
 	 * Both tests below are needed to catch the case len >= 0xfffe.
@@ -171,12 +177,15 @@ malloc(size_t len)
 	if (avail >= len && avail >= len + sizeof(size_t)) {
 		fp1 = (struct __freelist *)__brkval;
 		__brkval += len + sizeof(size_t);
+		if (__brkval > __malloc_heap_peak)
+			__malloc_heap_peak = __brkval;
 		fp1->sz = len;
 		return &(fp1->nx);
 	}
 	/*
 	 * Step 4: There's no help, just fail. :-/
 	 */
+	__malloc_failures++;
 	return 0;
 }
 
@@ -130,10 +130,13 @@ realloc(void *ptr, size_t len)
 			cp1 = STACK_POINTER() - __malloc_margin;
 		if (cp < cp1) {
 			__brkval = cp;
+			if (__brkval > __malloc_heap_peak)
+				__malloc_heap_peak = __brkval;
 			fp1->sz = len;
 			return ptr;
 		}
 		/* If that failed, we are out of luck. */
+		__malloc_failures++;
 		return 0;
 	}
 
@@ -47,6 +47,8 @@ extern struct __freelist *__flp; /* freelist pointer (head of freelist) */
 extern size_t __malloc_margin;	/* user-changeable before the first malloc() */
 extern char *__malloc_heap_start;
 extern char *__malloc_heap_end;
+extern char *__malloc_heap_peak;	/* Bean: highest __brkval so far */
+extern unsigned int __malloc_failures;	/* Bean: requests that got 0 */
 
 extern char __heap_start;
 extern char __heap_end;
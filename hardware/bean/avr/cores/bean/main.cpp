@@ -19,6 +19,7 @@ int main(void)
   for (;;) {
     loop();
     if (serialEventRun) serialEventRun();
+    Serial.poll();
   }
 
   return 0;
@@ -20,6 +20,18 @@ void operator delete[](void * ptr)
   free(ptr);
 }
 
+#if __cpp_sized_deallocation
+void operator delete(void * ptr, size_t)
+{
+  free(ptr);
+}
+
+void operator delete[](void * ptr, size_t)
+{
+  free(ptr);
+}
+#endif
+
 int __cxa_guard_acquire(__guard *g) {return !*(char *)(g);};
 void __cxa_guard_release (__guard *g) {*(char *)g = 1;};
 void __cxa_guard_abort (__guard *) {}; 
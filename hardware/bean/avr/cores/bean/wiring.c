@@ -23,6 +23,7 @@
 */
 
 #include "wiring_private.h"
+#include "BeanLatency.h"
 
 // the prescaler is set so that timer0 ticks every 64 clock cycles, and the
 // the overflow handler is called every 256 ticks.
@@ -72,7 +73,9 @@ unsigned long millis()
 	// disable interrupts while we read timer0_millis or we might get an
 	// inconsistent value (e.g. in the middle of a write to timer0_millis)
 	cli();
+	LATENCY_OFF_BEGIN(LATENCY_MILLIS);
 	m = timer0_millis;
+	LATENCY_OFF_END(LATENCY_MILLIS);
 	SREG = oldSREG;
 
 	return m;
@@ -234,6 +237,15 @@ void init()
 	// note, however, that fast pwm mode can achieve a frequency of up
 	// 8 MHz (with a 16 MHz clock) at 50% duty cycle
 
+#if defined(BEAN_LATENCY)
+	// timer 1 free-runs at the cpu clock for BeanLatency.h's probe, and
+	// BeanProfile.h if that's on too, so there is no pwm on its pins
+	latencyBegin();
+#elif defined(BEAN_PROFILE)
+	// timer 1 free-runs at the cpu clock for BeanProfile.h, in normal mode,
+	// so there is no pwm on its pins
+	TCCR1B = _BV(CS10);
+#else
 #if defined(TCCR1B) && defined(CS11) && defined(CS10)
 	TCCR1B = 0;
 
@@ -253,6 +265,7 @@ void init()
 	sbi(TCCR1A, WGM10);
 #elif defined(TCCR1)
 	#warning this needs to be finished
+#endif
 #endif
 
 	// set timer 2 prescale factor to 64
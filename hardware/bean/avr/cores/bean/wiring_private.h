@@ -64,6 +64,14 @@ extern "C"{
 
 typedef void (*voidFuncPtr)(void);
 
+// Spun in loops that wait for an interrupt handler to make progress. It is
+// nothing on the AVR; the host build in host/sim runs the handlers from it.
+#ifdef BEAN_HOST
+void interrupt_wait(void);
+#else
+#define interrupt_wait()
+#endif
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
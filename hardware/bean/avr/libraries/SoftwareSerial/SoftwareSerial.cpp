@@ -432,6 +432,7 @@ size_t SoftwareSerial::write(uint8_t b)
     b = ~b;
 
   cli();  // turn off interrupts for a clean txmit
+  LATENCY_OFF_BEGIN(LATENCY_SOFTWARE_SERIAL);
 
   // Write the start bit
   if (inv)
@@ -459,6 +460,7 @@ size_t SoftwareSerial::write(uint8_t b)
   else
     *reg |= reg_mask;
 
+  LATENCY_OFF_END(LATENCY_SOFTWARE_SERIAL);
   SREG = oldSREG; // turn interrupts back on
   tunedDelay(_tx_delay);
   
@@ -0,0 +1,50 @@
+#include "BeanFrame.h"
+
+#include "BeanFrameCodec.h"
+
+struct BeanFrameParser {
+  FrameParser<> parser;
+};
+
+size_t bean_frame_encode(uint16_t message_id, const uint8_t *body,
+                         uint8_t body_length, uint8_t *out, size_t size) {
+  return frameEncode(message_id, body, body_length, out, size);
+}
+
+BeanFrameParser *bean_frame_parser_new(void) { return new BeanFrameParser; }
+
+void bean_frame_parser_free(BeanFrameParser *parser) { delete parser; }
+
+size_t bean_frame_parser_feed(BeanFrameParser *parser, const uint8_t *data,
+                              size_t length, int *complete) {
+  size_t i = 0;
+
+  *complete = 0;
+  while (i < length) {
+    if (parser->parser.feed(data[i++])) {
+      *complete = 1;
+      break;
+    }
+  }
+  return i;
+}
+
+uint16_t bean_frame_parser_message_id(const BeanFrameParser *parser) {
+  return parser->parser.messageId();
+}
+
+const uint8_t *bean_frame_parser_body(const BeanFrameParser *parser) {
+  return parser->parser.body();
+}
+
+size_t bean_frame_parser_length(const BeanFrameParser *parser) {
+  return parser->parser.length();
+}
+
+uint32_t bean_frame_parser_crc_errors(const BeanFrameParser *parser) {
+  return parser->parser.crcErrors;
+}
+
+uint32_t bean_frame_parser_resets(const BeanFrameParser *parser) {
+  return parser->parser.resets;
+}
@@ -0,0 +1,39 @@
+#ifndef BEAN_FRAME_H
+#define BEAN_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C interface to the Bean framing in BeanFrameCodec.h, for host tools in
+// other languages (e.g. Python through ctypes).
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Encodes a frame into out. Returns its length, which is more than size if it
+// didn't fit.
+size_t bean_frame_encode(uint16_t message_id, const uint8_t *body,
+                         uint8_t body_length, uint8_t *out, size_t size);
+
+typedef struct BeanFrameParser BeanFrameParser;
+
+BeanFrameParser *bean_frame_parser_new(void);
+void bean_frame_parser_free(BeanFrameParser *parser);
+
+// Feeds bytes until a whole frame with a good CRC has arrived, or the data
+// runs out. Returns how many bytes it used, and sets *complete if a frame is
+// ready; its ID and body stay put until the next call.
+size_t bean_frame_parser_feed(BeanFrameParser *parser, const uint8_t *data,
+                              size_t length, int *complete);
+uint16_t bean_frame_parser_message_id(const BeanFrameParser *parser);
+const uint8_t *bean_frame_parser_body(const BeanFrameParser *parser);
+size_t bean_frame_parser_length(const BeanFrameParser *parser);
+uint32_t bean_frame_parser_crc_errors(const BeanFrameParser *parser);
+uint32_t bean_frame_parser_resets(const BeanFrameParser *parser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
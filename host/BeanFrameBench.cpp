@@ -0,0 +1,95 @@
+// Encodes and decodes frames with BeanFrameCodec.h and reports frames/s.
+//
+//   make -C host bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "BeanFrameCodec.h"
+
+namespace {
+
+const int kFrames = 200000;
+const uint8_t kBodyLengths[] = {0, 8, 32, 64, 128, 253};
+
+enum Payload { RANDOM, TEXT, ALL_ESCAPED };
+const char *const kPayloadNames[] = {"random", "text", "escaped"};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void fill(uint8_t *body, uint8_t length, Payload payload) {
+  static const char text[] = "t=12034,temp=23,x=-5,y=3,z=256\r\n";
+  for (uint8_t i = 0; i < length; i++) {
+    switch (payload) {
+      case RANDOM:
+        body[i] = rand() & 0xFF;
+        break;
+      case TEXT:
+        body[i] = text[i % (sizeof(text) - 1)];
+        break;
+      case ALL_ESCAPED:
+        body[i] = FRAME_SOF;
+        break;
+    }
+  }
+}
+
+void run(uint8_t length, Payload payload) {
+  uint8_t body[FRAME_MAX_BODY_LENGTH];
+  fill(body, length, payload);
+
+  std::vector<uint8_t> wire(kFrames * FRAME_MAX_ENCODED_LENGTH(length));
+  size_t used = 0;
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int i = 0; i < kFrames; i++) {
+    used += frameEncode((uint16_t)i, body, length, &wire[used],
+                        wire.size() - used);
+  }
+  double encode_s = seconds_since(start);
+
+  FrameParser<> parser;
+  int decoded = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < used; i++) {
+    if (parser.feed(wire[i])) {
+      decoded++;
+    }
+  }
+  double decode_s = seconds_since(start);
+
+  if (decoded != kFrames || parser.crcErrors || parser.resets ||
+      parser.length() != length ||
+      memcmp(parser.body(), body, length) != 0) {
+    fprintf(stderr, "round trip failed: %d of %d frames\n", decoded, kFrames);
+    exit(1);
+  }
+
+  printf("%4u  %-8s %6.2f  %10.0f  %8.2f  %10.0f  %8.2f\n", length,
+         kPayloadNames[payload], (double)used / kFrames,
+         kFrames / encode_s, used / encode_s / 1e6, kFrames / decode_s,
+         used / decode_s / 1e6);
+}
+
+}  // namespace
+
+int main() {
+  printf("body  payload   wire B    enc fr/s  enc MB/s    dec fr/s  dec MB/s\n");
+  for (size_t i = 0; i < sizeof(kBodyLengths); i++) {
+    for (int payload = RANDOM; payload <= ALL_ESCAPED; payload++) {
+      if (kBodyLengths[i] == 0 && payload != RANDOM) {
+        continue;
+      }
+      run(kBodyLengths[i], (Payload)payload);
+    }
+  }
+  return 0;
+}
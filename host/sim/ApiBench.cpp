@@ -0,0 +1,79 @@
+// Runs resources/test_sketches/api_latency.ino on the host and prints the
+// table it writes to virtual serial: per Bean, BeanMidi, BeanHid and
+// BeanAncs call, the simulated microseconds it blocked for, and the frames
+// and bytes it cost on the link. The CC is simulated here, answering each
+// request at once, unless BEAN_SIM_CC names a stand-in to run it against
+// instead (see LoopbackBench.cpp):
+//
+//   make -C host apibench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BeanSim.h"
+#include "Arduino.h"
+
+#include "api_latency.ino"
+
+namespace {
+
+bool done = false;
+bool bridged = false;
+std::vector<char> line;
+
+// Prints what the sketch writes, a line at a time
+void serial_data(const SimFrame &frame) {
+  for (size_t i = 0; i < frame.body.size(); i++) {
+    char c = frame.body[i];
+    if (c == '\r') {
+      continue;
+    }
+    if (c != '\n') {
+      line.push_back(c);
+      continue;
+    }
+    line.push_back('\0');
+    puts(&line[0]);
+    done |= strcmp(&line[0], "done") == 0;
+    line.clear();
+  }
+}
+
+// Prints what the sketch writes to virtual serial, and leaves the rest to
+// the simulated CC
+void cc_handler(const SimFrame &frame, void *) {
+  if (frame.messageId == MSG_ID_SERIAL_DATA) {
+    serial_data(frame);
+  } else if (!bridged) {
+    sim_cc_answer(frame, NULL);
+  }
+}
+
+}  // namespace
+
+int main() {
+  const char *peer = getenv("BEAN_SIM_CC");
+  bridged = peer && *peer;
+  if (bridged && !sim_cc_connect(peer)) {
+    fprintf(stderr, "ApiBench: can't open %s\n", peer);
+    return 1;
+  }
+  sim_cc_set_handler(cc_handler, NULL);
+
+  setup();
+
+  if (!bridged) {
+    // A notification for BeanAncs to read
+    ANCS_SOURCE_MSG_T notification = {0, 0, 4, 1, 1};
+    sim_cc_send(MSG_ID_ANCS_READ, (const uint8_t *)&notification,
+                sizeof(notification));
+  }
+  sim_cc_send(MSG_ID_SERIAL_DATA, (const uint8_t *)"\n", 1);
+
+  while (!done) {
+    loop();
+    sim_advance(100);
+  }
+  return 0;
+}
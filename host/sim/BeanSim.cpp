@@ -0,0 +1,623 @@
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+// termios' baud rates that binary.h has binary constants of the same name for
+#undef B0
+#undef B110
+#undef B1000000
+
+#include "BeanSim.h"
+#include "BeanFrameCodec.h"
+#include "wiring_private.h"
+#include <avr/sleep.h>
+
+// The core's interrupt handlers. Weak, so a build without one of them links.
+extern "C" {
+void USART_RX_vect(void) __attribute__((weak));
+void USART_UDRE_vect(void) __attribute__((weak));
+void USART_TX_vect(void) __attribute__((weak));
+}
+
+#define BEAN_SIM_DEFINE_8(name) volatile uint8_t name;
+#define BEAN_SIM_DEFINE_16(name) volatile uint16_t name;
+BEAN_SIM_REGISTERS_8(BEAN_SIM_DEFINE_8)
+BEAN_SIM_REGISTERS_16(BEAN_SIM_DEFINE_16)
+
+static const uint8_t PIN_COUNT = 32;
+static const uint64_t NEVER = ~(uint64_t)0;
+// Most a rate can be off by before the far end reads garbage, in percent
+static const uint32_t LINK_RATE_TOLERANCE = 2;
+
+struct Timer {
+  uint64_t when;
+  SimCallback callback;
+  void *context;
+};
+
+// All times are in nanoseconds, so byte times at odd rates don't drift
+static uint64_t now_ns;
+// Time spent powered down, when Timer0 and so millis() stand still
+static uint64_t stopped_ns;
+static uint32_t poll_cost_ns = 1000;
+static bool dispatching;
+static uint32_t handlers_run;
+static std::vector<Timer> timers;
+
+static uint8_t pin_out[PIN_COUNT];
+static uint8_t pin_in[PIN_COUNT];
+static int analog_in[PIN_COUNT];
+static voidFuncPtr external_handlers[EXTERNAL_NUM_INTERRUPTS];
+
+// Core to CC: the byte being shifted out, and when it's done
+static bool tx_shifting;
+static bool tx_finished;
+static uint8_t tx_byte;
+static uint64_t tx_done_ns;
+
+// CC to core: bytes not yet sent, the one on the wire, and one waiting in UDR0
+static std::deque<uint8_t> rx_queue;
+static uint64_t rx_done_ns = NEVER;
+static bool rx_waiting;
+
+static uint32_t cc_rate;
+static uint32_t cc_next_rate;
+static bool cc_rate_pending;
+static SimCcHandler cc_handler;
+static void *cc_context;
+static FrameParser<> cc_parser;
+static std::vector<SimFrame> cc_frames;
+static SimLinkStats link_stats;
+
+// The stand-in from sim_cc_connect(), and the wall clock time that matches
+// simulated time 0
+static int peer_fd = -1;
+static uint64_t peer_origin_ns;
+
+uint32_t sim_link_rate(void) {
+  uint32_t ubrr = ((UBRR0H & 0x0F) << 8) | UBRR0L;
+  uint32_t divisor = (UCSR0A & _BV(U2X0)) ? 8 : 16;
+  return F_CPU / divisor / (ubrr + 1);
+}
+
+static bool rates_match(void) {
+  if (cc_rate == 0) {
+    return true;
+  }
+  uint32_t rate = sim_link_rate();
+  uint32_t diff = rate > cc_rate ? rate - cc_rate : cc_rate - rate;
+  return diff * 100 <= cc_rate * LINK_RATE_TOLERANCE;
+}
+
+// 8N1: ten bits a byte
+static uint64_t byte_ns(uint32_t rate) {
+  return 10000000000ULL / (rate ? rate : 1);
+}
+
+static bool interrupts_on(void) { return SREG & _BV(SREG_I); }
+
+// Handlers run as the hardware runs them: with interrupts off until they
+// return.
+static void run_handler(void (*handler)(void)) {
+  if (handler == NULL) {
+    return;
+  }
+  SREG &= ~_BV(SREG_I);
+  handlers_run++;
+  handler();
+  SREG |= _BV(SREG_I);
+}
+
+static void cc_receive(uint8_t c) {
+  link_stats.bytesToCc++;
+  if (!rates_match()) {
+    link_stats.garbled++;
+    return;
+  }
+  if (peer_fd >= 0 && write(peer_fd, &c, 1) != 1) {
+    fprintf(stderr, "sim: lost the CC stand-in\n");
+    exit(1);
+  }
+  uint32_t crc_errors = cc_parser.crcErrors;
+  if (cc_parser.feed(c)) {
+    SimFrame frame;
+    frame.messageId = cc_parser.messageId();
+    frame.body.assign(cc_parser.body(), cc_parser.body() + cc_parser.length());
+    frame.micros = now_ns / 1000;
+    cc_frames.push_back(frame);
+    link_stats.framesToCc++;
+    if (cc_handler) {
+      cc_handler(cc_frames.back(), cc_context);
+    }
+  }
+  link_stats.crcErrors += cc_parser.crcErrors - crc_errors;
+}
+
+static void rx_start(void) {
+  if (!rx_queue.empty()) {
+    rx_done_ns = now_ns + byte_ns(cc_rate ? cc_rate : sim_link_rate());
+  } else {
+    rx_done_ns = NEVER;
+    if (cc_rate_pending) {
+      cc_rate = cc_next_rate;
+      cc_rate_pending = false;
+    }
+  }
+}
+
+// Whatever the USART does at this instant, until it has nothing left to do
+static void usart_step(void) {
+  bool progress = true;
+
+  while (progress) {
+    progress = false;
+
+    if (tx_shifting && tx_done_ns <= now_ns) {
+      tx_shifting = false;
+      tx_finished = true;
+      cc_receive(tx_byte);
+    }
+    if (!tx_shifting && interrupts_on() && (UCSR0B & _BV(UDRIE0))) {
+      run_handler(USART_UDRE_vect);
+      // The handler turns UDRIE0 off when it has nothing to send
+      if (UCSR0B & _BV(UDRIE0)) {
+        tx_byte = UDR0;
+        tx_shifting = true;
+        tx_finished = false;
+        tx_done_ns = now_ns + byte_ns(sim_link_rate());
+        UCSR0A &= ~_BV(TXC0);
+      }
+      progress = true;
+    }
+    if (tx_finished && !tx_shifting) {
+      tx_finished = false;
+      UCSR0A |= _BV(TXC0);
+    }
+    if ((UCSR0A & _BV(TXC0)) && (UCSR0B & _BV(TXCIE0)) && interrupts_on()) {
+      UCSR0A &= ~_BV(TXC0);
+      run_handler(USART_TX_vect);
+      progress = true;
+    }
+
+    if (rx_done_ns <= now_ns) {
+      uint8_t c = rx_queue.front();
+      rx_queue.pop_front();
+      link_stats.bytesFromCc++;
+      if (!rates_match()) {
+        link_stats.garbled++;
+      } else if (rx_waiting) {
+        link_stats.overruns++;
+        UCSR0A |= _BV(DOR0);
+      } else if (UCSR0B & _BV(RXEN0)) {
+        UDR0 = c;
+        UCSR0A |= _BV(RXC0);
+        rx_waiting = true;
+      }
+      rx_start();
+      progress = true;
+    }
+    if (rx_waiting && (UCSR0B & _BV(RXCIE0)) && interrupts_on()) {
+      rx_waiting = false;
+      run_handler(USART_RX_vect);
+      UCSR0A &= ~(_BV(RXC0) | _BV(DOR0));
+      progress = true;
+    }
+  }
+}
+
+static uint64_t next_event_ns(void) {
+  uint64_t next = rx_done_ns;
+  if (tx_shifting && tx_done_ns < next) {
+    next = tx_done_ns;
+  }
+  for (size_t i = 0; i < timers.size(); i++) {
+    if (timers[i].when < next) {
+      next = timers[i].when;
+    }
+  }
+  return next;
+}
+
+static void run_timers(void) {
+  for (size_t i = 0; i < timers.size();) {
+    if (timers[i].when <= now_ns) {
+      Timer timer = timers[i];
+      timers.erase(timers.begin() + i);
+      timer.callback(timer.context);
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+}
+
+static uint64_t wall_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec - peer_origin_ns;
+}
+
+// Waits until the wall clock reaches until_ns, or the stand-in sends
+// something. Its bytes go on the link as they arrive.
+static bool peer_wait(uint64_t until_ns) {
+  uint64_t wall = wall_ns();
+  uint64_t wait = until_ns > wall ? until_ns - wall : 0;
+  struct timeval timeout = {(time_t)(wait / 1000000000),
+                            (suseconds_t)(wait % 1000000000 / 1000)};
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(peer_fd, &fds);
+  if (select(peer_fd + 1, &fds, NULL, NULL, &timeout) <= 0) {
+    return false;
+  }
+
+  uint8_t bytes[256];
+  ssize_t length = read(peer_fd, bytes, sizeof(bytes));
+  if (length <= 0) {
+    fprintf(stderr, "sim: lost the CC stand-in\n");
+    exit(1);
+  }
+  wall = wall_ns();
+  if (wall > now_ns) {
+    now_ns = wall < until_ns ? wall : until_ns;
+  }
+  sim_cc_send_raw(bytes, length);
+  return true;
+}
+
+extern "C" volatile unsigned long timer0_overflow_count;
+
+// Timer0 as wiring.c runs it: a tick every 64 clocks, an overflow every 256
+// ticks. Overflows are counted straight away, so TOV0 is never left pending.
+static void timer0_step(void) {
+  uint64_t ticks = (now_ns - stopped_ns) * (F_CPU / 1000000) / 64000;
+  timer0_overflow_count = (unsigned long)(ticks >> 8);
+  TCNT0 = (uint8_t)ticks;
+}
+
+static void advance_ns(uint64_t ns) {
+  // Time spent inside a handler, or inside a CC callback, is just spent
+  if (dispatching) {
+    now_ns += ns;
+    timer0_step();
+    return;
+  }
+
+  uint64_t end_ns = now_ns + ns;
+  // Running behind the stand-in's clock, catch up
+  if (peer_fd >= 0 && wall_ns() > end_ns) {
+    end_ns = wall_ns();
+  }
+  dispatching = true;
+  for (;;) {
+    run_timers();
+    usart_step();
+    uint64_t next = next_event_ns();
+    if (peer_fd >= 0 && peer_wait(next < end_ns ? next : end_ns)) {
+      continue;
+    }
+    if (next > end_ns) {
+      break;
+    }
+    if (next > now_ns) {
+      now_ns = next;
+    }
+  }
+  now_ns = end_ns;
+  timer0_step();
+  dispatching = false;
+}
+
+void sim_reset(void) {
+#define BEAN_SIM_CLEAR(name) name = 0;
+  BEAN_SIM_REGISTERS_8(BEAN_SIM_CLEAR)
+  BEAN_SIM_REGISTERS_16(BEAN_SIM_CLEAR)
+#undef BEAN_SIM_CLEAR
+  // main() runs with interrupts on, once init() has had them turned on
+  SREG = _BV(SREG_I);
+  UCSR0A = _BV(UDRE0);
+
+  now_ns = 0;
+  stopped_ns = 0;
+  timer0_overflow_count = 0;
+  poll_cost_ns = 1000;
+  handlers_run = 0;
+  timers.clear();
+  memset(pin_out, 0, sizeof(pin_out));
+  memset(pin_in, 0, sizeof(pin_in));
+  memset(analog_in, 0, sizeof(analog_in));
+  memset(external_handlers, 0, sizeof(external_handlers));
+
+  tx_shifting = false;
+  tx_finished = false;
+  rx_queue.clear();
+  rx_done_ns = NEVER;
+  rx_waiting = false;
+
+  cc_rate = 0;
+  cc_rate_pending = false;
+  cc_handler = NULL;
+  cc_context = NULL;
+  cc_parser = FrameParser<>();
+  cc_frames.clear();
+  memset(&link_stats, 0, sizeof(link_stats));
+  if (peer_fd >= 0) {
+    close(peer_fd);
+    peer_fd = -1;
+  }
+}
+
+uint64_t sim_micros(void) { return now_ns / 1000; }
+
+void sim_advance(uint32_t us) { advance_ns((uint64_t)us * 1000); }
+
+void sim_set_poll_cost(uint32_t us) { poll_cost_ns = us * 1000; }
+
+void sim_schedule(uint64_t delay_us, SimCallback callback, void *context) {
+  Timer timer = {now_ns + (uint64_t)delay_us * 1000, callback, context};
+  timers.push_back(timer);
+}
+
+void sim_external_interrupt(uint8_t number) {
+  if (number < EXTERNAL_NUM_INTERRUPTS && interrupts_on()) {
+    run_handler(external_handlers[number]);
+  }
+}
+
+uint8_t sim_pin(uint8_t pin) { return pin < PIN_COUNT ? pin_out[pin] : 0; }
+
+void sim_set_pin(uint8_t pin, uint8_t level) {
+  if (pin < PIN_COUNT) {
+    pin_in[pin] = level;
+  }
+}
+
+void sim_set_analog(uint8_t pin, int value) {
+  if (pin < PIN_COUNT) {
+    analog_in[pin] = value;
+  }
+}
+
+void sim_cc_set_handler(SimCcHandler handler, void *context) {
+  cc_handler = handler;
+  cc_context = context;
+}
+
+void sim_cc_send(uint16_t messageId, const uint8_t *body, size_t length) {
+  uint8_t frame[FRAME_MAX_ENCODED_LENGTH(FRAME_MAX_BODY_LENGTH)];
+  if (length > FRAME_MAX_BODY_LENGTH) {
+    length = FRAME_MAX_BODY_LENGTH;
+  }
+  sim_cc_send_raw(frame, frameEncode(messageId, body, (uint8_t)length, frame,
+                                     sizeof(frame)));
+}
+
+void sim_cc_send_raw(const uint8_t *bytes, size_t length) {
+  bool idle = rx_queue.empty();
+  rx_queue.insert(rx_queue.end(), bytes, bytes + length);
+  if (idle) {
+    rx_start();
+  }
+}
+
+const std::vector<SimFrame> &sim_cc_frames(void) { return cc_frames; }
+
+void sim_cc_set_link_rate(uint32_t rate) {
+  if (rx_queue.empty()) {
+    cc_rate = rate;
+  } else {
+    cc_next_rate = rate;
+    cc_rate_pending = true;
+  }
+}
+
+const SimLinkStats &sim_link_stats(void) { return link_stats; }
+
+static int open_tcp(const char *peer) {
+  char host[256];
+  const char *colon = strrchr(peer, ':');
+  if (colon == NULL || (size_t)(colon - peer) >= sizeof(host)) {
+    return -1;
+  }
+  memcpy(host, peer, colon - peer);
+  host[colon - peer] = '\0';
+
+  struct addrinfo hints;
+  struct addrinfo *addresses;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, colon + 1, &hints, &addresses) != 0) {
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd >= 0) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  return fd;
+}
+
+bool sim_cc_connect(const char *peer) {
+  int fd = open(peer, O_RDWR | O_NOCTTY);
+  if (fd >= 0) {
+    struct termios raw;
+    if (tcgetattr(fd, &raw) == 0) {
+      cfmakeraw(&raw);
+      tcsetattr(fd, TCSANOW, &raw);
+    }
+  } else {
+    fd = open_tcp(peer);
+  }
+  if (fd < 0) {
+    return false;
+  }
+
+  if (peer_fd >= 0) {
+    close(peer_fd);
+  }
+  peer_fd = fd;
+  peer_origin_ns = 0;
+  peer_origin_ns = wall_ns() - now_ns;
+  return true;
+}
+
+// What wiring.c, wiring_digital.c, wiring_analog.c and WInterrupts.c do on
+// the AVR
+
+extern "C" {
+
+volatile unsigned long timer0_overflow_count = 0;
+
+void init(void) { sei(); }
+
+unsigned long millis(void) {
+  advance_ns(poll_cost_ns);
+  return (unsigned long)((now_ns - stopped_ns) / 1000000);
+}
+
+unsigned long micros(void) {
+  advance_ns(poll_cost_ns);
+  return (unsigned long)((now_ns - stopped_ns) / 1000);
+}
+
+void delay(unsigned long ms) {
+  advance_ns((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us) { advance_ns((uint64_t)us * 1000); }
+
+void interrupt_wait(void) {
+  uint64_t next = next_event_ns();
+  // Step to whatever happens next, so a wait costs no more host time than
+  // it must; with nothing coming, just let time pass.
+  if (next != NEVER && next > now_ns && next - now_ns < 1000000) {
+    advance_ns(next - now_ns);
+  } else {
+    advance_ns(poll_cost_ns ? poll_cost_ns : 1000);
+  }
+}
+
+void sim_sleep_cpu(void) {
+  uint32_t ran = handlers_run;
+  uint64_t start_ns = now_ns;
+  bool power_down = (SMCR & (_BV(SM0) | _BV(SM1) | _BV(SM2))) ==
+                    SLEEP_MODE_PWR_DOWN;
+  while (handlers_run == ran) {
+    uint64_t next = next_event_ns();
+    if (next == NEVER && peer_fd >= 0) {
+      // The stand-in may yet send something
+      advance_ns(1000000);
+      continue;
+    }
+    if (next == NEVER) {
+      fprintf(stderr, "sim: sleep_cpu() at %llu us with nothing to wake it\n",
+              (unsigned long long)(now_ns / 1000));
+      abort();
+    }
+    advance_ns(next > now_ns ? next - now_ns : 0);
+  }
+  if (power_down) {
+    stopped_ns += now_ns - start_ns;
+  }
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  if (pin < PIN_COUNT) {
+    pin_out[pin] = level;
+  }
+}
+
+int digitalRead(uint8_t pin) { return pin < PIN_COUNT ? pin_in[pin] : 0; }
+
+int analogRead(uint8_t pin) { return pin < PIN_COUNT ? analog_in[pin] : 0; }
+
+void analogReference(uint8_t) {}
+
+void analogWrite(uint8_t pin, int value) {
+  digitalWrite(pin, value >= 128 ? HIGH : LOW);
+}
+
+void attachInterrupt(uint8_t number, void (*handler)(void), int) {
+  if (number < EXTERNAL_NUM_INTERRUPTS) {
+    external_handlers[number] = handler;
+  }
+}
+
+void detachInterrupt(uint8_t number) {
+  if (number < EXTERNAL_NUM_INTERRUPTS) {
+    external_handlers[number] = NULL;
+  }
+}
+
+char *ltoa(long value, char *s, int radix) {
+  if (radix == 10) {
+    sprintf(s, "%ld", value);
+    return s;
+  }
+  return ultoa((unsigned long)value, s, radix);
+}
+
+char *ultoa(unsigned long value, char *s, int radix) {
+  char digits[sizeof(value) * 8 + 1];
+  int i = 0;
+  if (radix < 2 || radix > 36) {
+    s[0] = '\0';
+    return s;
+  }
+  do {
+    digits[i++] = "0123456789abcdefghijklmnopqrstuvwxyz"[value % radix];
+    value /= radix;
+  } while (value);
+  for (int j = 0; j < i; j++) {
+    s[j] = digits[i - 1 - j];
+  }
+  s[i] = '\0';
+  return s;
+}
+
+char *itoa(int value, char *s, int radix) {
+  if (radix == 10) {
+    return ltoa(value, s, radix);
+  }
+  return ultoa((unsigned int)value, s, radix);
+}
+
+char *utoa(unsigned int value, char *s, int radix) {
+  return ultoa(value, s, radix);
+}
+
+char *dtostrf(double value, signed char width, unsigned char precision,
+              char *s) {
+  sprintf(s, "%*.*f", width, precision, value);
+  return s;
+}
+
+}  // extern "C"
+
+// Registers come out of reset as sim_reset() leaves them
+static struct PowerOn {
+  PowerOn() { sim_reset(); }
+} power_on;
@@ -0,0 +1,107 @@
+#ifndef BEAN_SIM_H
+#define BEAN_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Runs the Bean core on the host. The core's sources are built against the
+// stub headers next to this one (see host/Makefile), and this file stands in
+// for the hardware around them:
+//
+// - Time. Simulated time only moves when the core waits: millis() and
+//   micros() cost sim_set_poll_cost() each, delay() and delayMicroseconds()
+//   take as long as they say, and loops waiting on an interrupt step to the
+//   next event. Tests move it along with sim_advance(). As on the AVR,
+//   millis() and micros() stand still while it is powered down.
+// - The USART. Bytes take as long on the wire as the rate in UBRR0 says. The
+//   core's own USART_RX/UDRE/TX handlers run as bytes come and go, whenever
+//   SREG's I bit is set.
+// - The CC. Frames from the core are decoded with BeanFrameCodec.h and given
+//   to a handler; frames for the core are queued on the link. Or the link
+//   goes to a stand-in outside the process, see sim_cc_connect().
+//
+// Include the standard headers a test needs before Arduino.h, whose min()
+// and max() macros break them.
+
+typedef void (*SimCallback)(void *context);
+
+// Everything back to the state at reset: time 0, registers and pins clear,
+// nothing on the link. The core's own statics are left alone.
+void sim_reset(void);
+
+// Simulated microseconds since reset
+uint64_t sim_micros(void);
+
+// Runs everything due in the next us microseconds
+void sim_advance(uint32_t us);
+
+// How far each call to millis() or micros() moves time; 1 us by default.
+// Polling loops only end if this isn't 0.
+void sim_set_poll_cost(uint32_t us);
+
+// Calls callback once delay_us from now
+void sim_schedule(uint64_t delay_us, SimCallback callback, void *context);
+
+// Runs the handler attachInterrupt() gave external interrupt number
+// (0 for INT0, 1 for INT1), if interrupts are on.
+void sim_external_interrupt(uint8_t number);
+
+// The last level digitalWrite() gave pin, and the one digitalRead() returns
+uint8_t sim_pin(uint8_t pin);
+void sim_set_pin(uint8_t pin, uint8_t level);
+void sim_set_analog(uint8_t pin, int value);
+
+struct SimFrame {
+  uint16_t messageId;
+  std::vector<uint8_t> body;
+  uint64_t micros;  // when its EOF arrived
+};
+
+struct SimLinkStats {
+  uint32_t bytesToCc;
+  uint32_t bytesFromCc;
+  uint32_t framesToCc;
+  uint32_t crcErrors;  // frames to the CC that failed their CRC
+  uint32_t garbled;    // bytes lost to mismatched link rates
+  uint32_t overruns;   // bytes for the core lost because UDR0 wasn't read
+};
+
+typedef void (*SimCcHandler)(const SimFrame &frame, void *context);
+
+// Called with each frame the core sends the CC, as its EOF arrives
+void sim_cc_set_handler(SimCcHandler handler, void *context);
+
+// Queues a frame, or raw bytes, for the core. They arrive at the link rate.
+void sim_cc_send(uint16_t messageId, const uint8_t *body, size_t length);
+void sim_cc_send_raw(const uint8_t *bytes, size_t length);
+
+// Every frame the core has sent since reset
+const std::vector<SimFrame> &sim_cc_frames(void);
+
+// The rate the CC's UART runs at. With 0, the default, it always matches
+// the core's. A new rate takes effect once the bytes queued for the core
+// have gone, as the CC switches after its reply.
+void sim_cc_set_link_rate(uint32_t rate);
+
+// The rate the core's USART is set to, from UBRR0 and U2X0
+uint32_t sim_link_rate(void);
+
+// Puts a real CC stand-in on the far end of the link, in place of the
+// handler and sim_cc_send(): a PTY or serial device path, or host:port for
+// TCP (see beanModuleEmulator/BeanCCStandIn.py --pty and --tcp). Frames
+// still go to the handler, which just watches. From then on simulated time
+// keeps pace with the wall clock, so the stand-in's timing counts. Returns
+// false if peer can't be opened.
+bool sim_cc_connect(const char *peer);
+
+const SimLinkStats &sim_link_stats(void);
+
+// A handler that answers every request the core makes with a plausible
+// reply, keeps the scratch banks, and lowers the sleep line (waking the AVR)
+// once the time a Bean.sleep() asked for is up. Anything that isn't a
+// request, virtual serial included, is ignored. See sim/SimCc.cpp.
+void sim_cc_answer(const SimFrame &frame, void *context);
+
+#endif
@@ -0,0 +1,168 @@
+// Microbenchmarks of the core's transport, run on the host with BeanSim.
+// Each reports host time per operation, and how long the operation takes in
+// simulated time over the link to the CC.
+//
+//   make -C host bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "BeanSim.h"
+#include "Arduino.h"
+
+namespace {
+
+const int kIterations = 2000;
+const uint8_t kSizes[] = {1, 16, 64};
+const int kBulkIterations = 20;
+const uint32_t kBulkLength = 4096;
+
+uint8_t bulk_expected;
+
+// Answers the requests the benchmarks make, as the CC would
+void cc_handler(const SimFrame &frame, void *) {
+  if (frame.messageId == MSG_ID_LINK_RATE && frame.body.size() >= 4) {
+    // Take the fastest rate offered, once the reply has gone
+    sim_cc_send(frame.messageId, &frame.body[0], 4);
+    sim_cc_set_link_rate(((uint32_t)frame.body[0] << 24) |
+                         ((uint32_t)frame.body[1] << 16) |
+                         ((uint32_t)frame.body[2] << 8) | frame.body[3]);
+  } else if (frame.messageId == MSG_ID_LINK_RATE_CONFIRM) {
+    sim_cc_send(frame.messageId, &frame.body[0], frame.body.size());
+  } else if (frame.messageId == MSG_ID_CC_ACCEL_READ) {
+    ACC_READING_T reading = {1, -2, 256, 2};
+    sim_cc_send(frame.messageId, (const uint8_t *)&reading, sizeof(reading));
+  } else if ((frame.messageId == MSG_ID_BULK_START ||
+              frame.messageId == MSG_ID_BULK_DATA) &&
+             !frame.body.empty()) {
+    if (frame.messageId == MSG_ID_BULK_START) {
+      bulk_expected = frame.body[0];
+    }
+    if (frame.body[0] == bulk_expected) {
+      bulk_expected++;
+    }
+    sim_cc_send(MSG_ID_BULK_ACK, &bulk_expected, 1);
+  }
+}
+
+class Timer {
+ public:
+  Timer()
+      : m_host(std::chrono::steady_clock::now()), m_sim(sim_micros()) {}
+
+  void report(const char *name, int count) {
+    double host_ns = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - m_host)
+                         .count();
+    printf("%-28s %10.0f %12.1f\n", name, host_ns / count,
+           (double)(sim_micros() - m_sim) / count);
+  }
+
+ private:
+  std::chrono::steady_clock::time_point m_host;
+  uint64_t m_sim;
+};
+
+void check(bool ok, const char *what) {
+  if (!ok) {
+    fprintf(stderr, "%s\n", what);
+    exit(1);
+  }
+}
+
+void bench_write(uint8_t size) {
+  uint8_t data[64];
+  char name[32];
+  memset(data, 'x', sizeof(data));
+
+  size_t frames = sim_cc_frames().size();
+  Timer timer;
+  for (int i = 0; i < kIterations; i++) {
+    Serial.write(data, size);
+    Serial.flush();
+  }
+  snprintf(name, sizeof(name), "Serial.write %u B", size);
+  timer.report(name, kIterations);
+  check(sim_cc_frames().size() - frames >= (size_t)kIterations,
+        "Serial.write: frames missing at the CC");
+}
+
+void bench_read(uint8_t size) {
+  uint8_t data[64];
+  char name[32];
+  memset(data, 'y', sizeof(data));
+
+  size_t got = 0;
+  Timer timer;
+  for (int i = 0; i < kIterations; i++) {
+    sim_cc_send(MSG_ID_SERIAL_DATA, data, size);
+    while (Serial.available() < size) {
+      sim_advance(10);
+    }
+    got += Serial.readBytes((char *)data, size);
+  }
+  snprintf(name, sizeof(name), "Serial.read %u B", size);
+  timer.report(name, kIterations);
+  check(got == (size_t)kIterations * size, "Serial.read: bytes missing");
+}
+
+// The same payload as virtual serial data: written in full frames, and as
+// a bulk write
+void bench_bulk(void) {
+  static uint8_t data[kBulkLength];
+  memset(data, 'z', sizeof(data));
+
+  Timer chunked;
+  for (int i = 0; i < kBulkIterations; i++) {
+    for (uint32_t offset = 0; offset < kBulkLength; offset += 64) {
+      Serial.write(data + offset, 64);
+    }
+    Serial.flush();
+  }
+  chunked.report("Serial.write 4 KB", kBulkIterations);
+
+  Timer bulk;
+  for (int i = 0; i < kBulkIterations; i++) {
+    check(Serial.beginBulkWrite(data, kBulkLength, NULL),
+          "beginBulkWrite: refused");
+    while (Serial.bulkWriteStatus() == BULK_SENDING) {
+      Serial.poll();
+    }
+    check(Serial.bulkWriteStatus() == BULK_DONE, "bulk write: failed");
+  }
+  bulk.report("Serial.beginBulkWrite 4 KB", kBulkIterations);
+}
+
+void bench_request(void) {
+  Timer timer;
+  for (int i = 0; i < kIterations; i++) {
+    AccelerationReading reading = Bean.getAcceleration();
+    check(reading.zAxis == 256, "getAcceleration: wrong reading");
+  }
+  timer.report("Bean.getAcceleration", kIterations);
+}
+
+}  // namespace
+
+int main() {
+  sim_cc_set_handler(cc_handler, NULL);
+  Serial.begin();
+
+  printf("%-28s %10s %12s\n", "", "host ns/op", "sim us/op");
+  for (size_t i = 0; i < sizeof(kSizes); i++) {
+    bench_write(kSizes[i]);
+  }
+  for (size_t i = 0; i < sizeof(kSizes); i++) {
+    bench_read(kSizes[i]);
+  }
+  bench_request();
+  bench_bulk();
+
+  const SimLinkStats &stats = sim_link_stats();
+  printf("link at %lu baud: %lu bytes to the CC, %lu from it\n",
+         (unsigned long)sim_link_rate(), (unsigned long)stats.bytesToCc,
+         (unsigned long)stats.bytesFromCc);
+  return 0;
+}
@@ -0,0 +1,765 @@
+// Pass/fail tests of the core's transport, run on the host with BeanSim:
+// routing, dropping bad frames, request retries, reliable mode, containers,
+// packet mode, the sensor cache, bulk writes and telemetry records. The core
+// keeps its state in statics that sim_reset() leaves alone, so each test runs
+// in a child process of its own.
+//
+//   make -C host test
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "BeanSim.h"
+#include "BeanFrameCodec.h"
+#include "Arduino.h"
+#include "Bean.h"
+#include "BeanTelemetry.h"
+
+namespace {
+
+const uint16_t kSlotId = 0x0B05;
+const uint16_t kCallbackId = 0x0B10;
+const uint16_t kRingId = 0x0B20;
+const uint16_t kUnroutedId = 0x0BEE;
+
+int failures;
+
+#define EXPECT(condition)                                             \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      printf("  %s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+// Temperature replies count up from 20, so a test can tell them apart
+int8_t temperature;
+int temperature_reads;
+// Whether to ack reliable frames from the Bean
+bool reliable_acks;
+// Whether to leave requests unanswered
+bool requests_lost;
+// What bulk writes delivered, in order, and the seqs lost once on the way
+std::string bulk_received;
+uint8_t bulk_expected;
+bool bulk_lost[256];
+
+void bulk_frame(const SimFrame &frame) {
+  uint8_t seq = frame.body[0];
+  if (frame.messageId == MSG_ID_BULK_START) {
+    bulk_expected = seq;
+  } else if (seq % 5 == 2 && !bulk_lost[seq]) {
+    bulk_lost[seq] = true;
+    return;
+  }
+  if (seq == bulk_expected) {
+    bulk_expected++;
+    if (frame.messageId == MSG_ID_BULK_DATA) {
+      bulk_received.append(frame.body.begin() + 1, frame.body.end());
+    }
+  }
+  sim_cc_send(MSG_ID_BULK_ACK, &bulk_expected, 1);
+}
+
+void cc_handler(const SimFrame &frame, void *context) {
+  if (requests_lost && (frame.messageId == MSG_ID_DB_COUNTER ||
+                        frame.messageId == MSG_ID_CC_ACCEL_READ)) {
+    return;
+  } else if ((frame.messageId == MSG_ID_BULK_START ||
+       frame.messageId == MSG_ID_BULK_DATA) &&
+      !frame.body.empty()) {
+    bulk_frame(frame);
+  } else if (frame.messageId == MSG_ID_CC_TEMP_READ) {
+    temperature_reads++;
+    int8_t reply = temperature++;
+    sim_cc_send(frame.messageId, (const uint8_t *)&reply, 1);
+  } else if (frame.messageId == MSG_ID_RELIABLE_DATA && reliable_acks &&
+             frame.body.size() >= RELIABLE_HEADER_LENGTH) {
+    uint8_t ack[2] = {(uint8_t)(frame.body[0] + 1), 0};
+    sim_cc_send(MSG_ID_RELIABLE_ACK, ack, sizeof(ack));
+  } else {
+    sim_cc_answer(frame, context);
+  }
+}
+
+// Sends what the core has queued, and lets the link go quiet
+void settle(void) {
+  Serial.poll();
+  sim_advance(20000);
+  Serial.poll();
+}
+
+// Resets the simulation and has the core begin Serial, which it does with
+// the first message it sends.
+void start(void) {
+  sim_reset();
+  temperature = 20;
+  temperature_reads = 0;
+  reliable_acks = false;
+  requests_lost = false;
+  sim_cc_set_handler(cc_handler, NULL);
+  Bean.getTemperature();
+  settle();
+}
+
+void send(uint16_t messageId, const char *body) {
+  sim_cc_send(messageId, (const uint8_t *)body, strlen(body));
+  settle();
+}
+
+std::vector<uint8_t> encode(uint16_t messageId, const uint8_t *body,
+                            size_t length) {
+  uint8_t out[FRAME_MAX_ENCODED_LENGTH(FRAME_MAX_BODY_LENGTH)];
+  size_t encoded = frameEncode(messageId, body, length, out, sizeof(out));
+  return std::vector<uint8_t>(out, out + encoded);
+}
+
+std::vector<uint8_t> encode(uint16_t messageId, const char *body) {
+  return encode(messageId, (const uint8_t *)body, strlen(body));
+}
+
+void send_raw(const std::vector<uint8_t> &bytes) {
+  sim_cc_send_raw(&bytes[0], bytes.size());
+  settle();
+}
+
+// The frames the core has sent with messageId since the first of them
+std::vector<SimFrame> frames_sent(uint16_t messageId, size_t from = 0) {
+  std::vector<SimFrame> found;
+  const std::vector<SimFrame> &frames = sim_cc_frames();
+  for (size_t i = from; i < frames.size(); i++) {
+    if (frames[i].messageId == messageId) {
+      found.push_back(frames[i]);
+    }
+  }
+  return found;
+}
+
+// Virtual serial data the core has sent since frame from, whether on its own
+// or in containers
+std::string serial_sent(size_t from) {
+  std::string text;
+  const std::vector<SimFrame> &frames = sim_cc_frames();
+  for (size_t i = from; i < frames.size(); i++) {
+    const std::vector<uint8_t> &body = frames[i].body;
+    if (frames[i].messageId == MSG_ID_SERIAL_DATA) {
+      text.append(body.begin(), body.end());
+    } else if (frames[i].messageId == MSG_ID_CONTAINER) {
+      size_t at = 0;
+      while (at + CONTAINER_HEADER_LENGTH <= body.size()) {
+        uint16_t messageId = (body[at] << 8) | body[at + 1];
+        size_t length = body[at + 2];
+        at += CONTAINER_HEADER_LENGTH;
+        if (messageId == MSG_ID_SERIAL_DATA && at + length <= body.size()) {
+          text.append(body.begin() + at, body.begin() + at + length);
+        }
+        at += length;
+      }
+    }
+  }
+  return text;
+}
+
+std::string serial_read(void) {
+  std::string text;
+  while (Serial.available() > 0) {
+    text += (char)Serial.read();
+  }
+  return text;
+}
+
+TransportStats transport_stats(void) {
+  TransportStats stats;
+  Serial.getTransportStats(&stats);
+  return stats;
+}
+
+ReliableStats reliable_stats(void) {
+  ReliableStats stats;
+  Serial.getReliableStats(&stats);
+  return stats;
+}
+
+uint8_t callback_body[FRAME_SLOT_SIZE];
+uint8_t callback_length;
+int callback_calls;
+
+void on_frame(uint16_t messageId, const uint8_t *body, uint8_t length) {
+  EXPECT(messageId == kCallbackId);
+  memcpy(callback_body, body, length);
+  callback_length = length;
+  callback_calls++;
+}
+
+void test_builtin_routes(void) {
+  start();
+  send(MSG_ID_SERIAL_DATA, "abc");
+  EXPECT(Serial.available() == 3);
+  EXPECT(Serial.read() == 'a');
+
+  // Nothing is waiting for a reply, so a frame with no route goes nowhere
+  uint16_t dropped = transport_stats().dropped_frames;
+  send(kUnroutedId, "xy");
+  EXPECT(transport_stats().dropped_frames == dropped + 1);
+  EXPECT(Serial.available() == 2);
+}
+
+void test_added_routes(void) {
+  uint8_t data[FRAME_SLOT_SIZE];
+  FrameSlot slot = {data, sizeof(data), 0, false, 0, NULL};
+  FrameSlot callback_slot = {callback_body, sizeof(callback_body), 0, false,
+                             0, on_frame};
+  ring_buffer ring = {{0}, 0, 0};
+
+  start();
+  EXPECT(Serial.addRoute(0x0B00, 0x0B0F, SINK_SLOT, &slot));
+  EXPECT(Serial.addRoute(kCallbackId, kCallbackId, SINK_CALLBACK,
+                         &callback_slot));
+  EXPECT(Serial.addRoute(kRingId, kRingId, SINK_RING, &ring));
+  EXPECT(!Serial.addRoute(0x0B0F, kCallbackId, SINK_DROP, NULL));
+  EXPECT(!Serial.addRoute(0x0B30, 0x0B30, SINK_SLOT, NULL));
+
+  send(kSlotId, "hello");
+  EXPECT(slot.updated);
+  EXPECT(slot.messageId == kSlotId);
+  EXPECT(slot.length == 5 && memcmp(data, "hello", 5) == 0);
+
+  // Cut short to the slot's size
+  slot.updated = false;
+  send(0x0B00, "0123456789");
+  EXPECT(slot.updated && slot.length == FRAME_SLOT_SIZE);
+
+  sim_cc_send(kCallbackId, (const uint8_t *)"cb", 2);
+  sim_advance(20000);
+  EXPECT(callback_calls == 0);
+  // Getters fold in their own replies, but leave callbacks to poll()
+  Bean.getTemperature();
+  Bean.getConnectionState();
+  EXPECT(callback_calls == 0);
+  Serial.poll();
+  EXPECT(callback_calls == 1);
+  EXPECT(callback_length == 2 && memcmp(callback_body, "cb", 2) == 0);
+  Serial.poll();
+  EXPECT(callback_calls == 1);
+
+  send(kRingId, "ring");
+  EXPECT(ring.head == 4 && memcmp(ring.buffer, "ring", 4) == 0);
+  EXPECT(Serial.available() == 0);
+
+  // Runtime routes take precedence over the built-in ones
+  uint16_t dropped = transport_stats().dropped_frames;
+  EXPECT(Serial.addRoute(MSG_ID_SERIAL_DATA, MSG_ID_SERIAL_DATA, SINK_DROP,
+                         NULL));
+  send(MSG_ID_SERIAL_DATA, "gone");
+  EXPECT(Serial.available() == 0);
+  EXPECT(transport_stats().dropped_frames == dropped + 1);
+  Serial.removeRoute(MSG_ID_SERIAL_DATA);
+  send(MSG_ID_SERIAL_DATA, "back");
+  EXPECT(Serial.available() == 4);
+}
+
+void test_crc_failure(void) {
+  uint8_t data[FRAME_SLOT_SIZE];
+  FrameSlot slot = {data, sizeof(data), 0, false, 0, NULL};
+
+  start();
+  EXPECT(Serial.addRoute(kSlotId, kSlotId, SINK_SLOT, &slot));
+  Serial.enablePackets(true);
+
+  // SOF, length and ID come first, then the body
+  std::vector<uint8_t> bad = encode(kSlotId, "AAAA");
+  bad[4] ^= 0x03;
+  uint16_t failed = transport_stats().crc_failures;
+  send_raw(bad);
+  EXPECT(!slot.updated);
+
+  bad = encode(MSG_ID_SERIAL_DATA, "AAAA");
+  bad[4] ^= 0x03;
+  send_raw(bad);
+  EXPECT(Serial.available() == 0);
+  EXPECT(Serial.packetAvailable() == -1);
+  EXPECT(transport_stats().crc_failures == failed + 2);
+
+  send(kSlotId, "good");
+  EXPECT(slot.updated && slot.length == 4);
+}
+
+void test_truncated_frame(void) {
+  uint8_t data[FRAME_SLOT_SIZE];
+  FrameSlot slot = {data, sizeof(data), 0, false, 0, NULL};
+
+  start();
+  EXPECT(Serial.addRoute(kSlotId, kSlotId, SINK_SLOT, &slot));
+  Serial.enablePackets(true);
+
+  // Each cut off before its CRC, and followed by a frame that makes it
+  std::vector<uint8_t> bytes = encode(kSlotId, "lost");
+  bytes.resize(bytes.size() - 3);
+  std::vector<uint8_t> packet = encode(MSG_ID_SERIAL_DATA, "part");
+  bytes.insert(bytes.end(), packet.begin(), packet.end() - 3);
+  std::vector<uint8_t> good = encode(MSG_ID_SERIAL_DATA, "whole");
+  bytes.insert(bytes.end(), good.begin(), good.end());
+
+  uint16_t resets = transport_stats().framing_resets;
+  send_raw(bytes);
+  EXPECT(!slot.updated);
+  EXPECT(transport_stats().framing_resets == resets + 2);
+  EXPECT(Serial.packetAvailable() == 5);
+  EXPECT(Serial.available() == 5);
+}
+
+// A reliable frame from the CC carrying a virtual serial body
+std::vector<uint8_t> reliable_frame(uint8_t seq, uint8_t base,
+                                    const char *body) {
+  std::vector<uint8_t> frame;
+  frame.push_back(seq);
+  frame.push_back(base);
+  frame.push_back(MSG_ID_SERIAL_DATA >> 8);
+  frame.push_back(MSG_ID_SERIAL_DATA & 0xFF);
+  frame.insert(frame.end(), body, body + strlen(body));
+  return encode(MSG_ID_RELIABLE_DATA, &frame[0], frame.size());
+}
+
+void send_reliable(uint8_t seq, uint8_t base, const char *body) {
+  send_raw(reliable_frame(seq, base, body));
+}
+
+// Reads are sent again when their reply is lost, the debug counter isn't
+void test_request_retries(void) {
+  start();
+  Bean.setRequestRetries(2);
+  requests_lost = true;
+  size_t from = sim_cc_frames().size();
+
+  int counter;
+  EXPECT(Serial.debugGetDebugCounter(&counter) != 0);
+  EXPECT(frames_sent(MSG_ID_DB_COUNTER, from).size() == 1);
+
+  Bean.getAcceleration();
+  EXPECT(Bean.lastReadFailed());
+  EXPECT(frames_sent(MSG_ID_CC_ACCEL_READ, from).size() == 3);
+}
+
+void test_reliable_receive(void) {
+  start();
+  Serial.enableReliable(true);
+  settle();
+
+  size_t from = sim_cc_frames().size();
+  send_reliable(0, 0, "ab");
+  EXPECT(Serial.available() == 2);
+  std::vector<SimFrame> acks = frames_sent(MSG_ID_RELIABLE_ACK, from);
+  EXPECT(acks.size() == 1 && acks[0].body.size() == 2);
+  EXPECT(acks.size() == 1 && acks[0].body[0] == 1 && acks[0].body[1] == 0);
+
+  // The ack was lost, and the CC sends it again
+  from = sim_cc_frames().size();
+  send_reliable(0, 0, "ab");
+  EXPECT(Serial.available() == 2);
+  EXPECT(reliable_stats().duplicates == 1);
+  acks = frames_sent(MSG_ID_RELIABLE_ACK, from);
+  EXPECT(acks.size() == 1 && acks[0].body[0] == 1);
+
+  send_reliable(1, 0, "cd");
+  EXPECT(Serial.available() == 4);
+
+  // Early: seq 2 is still missing
+  send_reliable(3, 2, "gh");
+  EXPECT(Serial.available() == 4);
+  EXPECT(reliable_stats().duplicates == 2);
+
+  // The CC gave up on seq 2
+  send_reliable(3, 3, "gh");
+  EXPECT(Serial.available() == 6);
+  EXPECT(reliable_stats().skipped == 1);
+}
+
+// Every frame delivered once and in order, however the CC's copies of them
+// arrive: corrupted, repeated, or ahead of the one before.
+void test_reliable_receive_lossy(void) {
+  start();
+  Serial.enableReliable(true);
+  settle();
+
+  std::string expected;
+  std::string received;
+  for (uint8_t seq = 0; seq < 40; seq++) {
+    char body[4];
+    snprintf(body, sizeof(body), "%02d,", seq);
+    expected += body;
+    if (seq % 5 == 0) {
+      // The first byte of the serial body
+      std::vector<uint8_t> bad = reliable_frame(seq, seq, body);
+      bad[8] ^= 0x01;
+      send_raw(bad);
+    }
+    if (seq % 7 == 3) {
+      char next[4];
+      snprintf(next, sizeof(next), "%02d,", seq + 1);
+      send_reliable(seq + 1, seq, next);
+    }
+    send_reliable(seq, seq, body);
+    if (seq % 4 == 1) {
+      send_reliable(seq, seq, body);
+    }
+    received += serial_read();
+  }
+  EXPECT(received == expected);
+  EXPECT(reliable_stats().skipped == 0);
+  EXPECT(reliable_stats().duplicates > 0);
+}
+
+void test_reliable_retransmit(void) {
+  start();
+  Serial.enableReliable(true);
+  settle();
+
+  size_t from = sim_cc_frames().size();
+  Serial.print("xyz");
+  Serial.flush();
+  for (int i = 0; i < 2000 && reliable_stats().retransmits == 0; i++) {
+    sim_advance(1000);
+    Serial.poll();
+  }
+  EXPECT(reliable_stats().retransmits == 1);
+  std::vector<SimFrame> sent = frames_sent(MSG_ID_RELIABLE_DATA, from);
+  EXPECT(sent.size() == 2);
+  EXPECT(sent.size() == 2 && sent[0].body == sent[1].body);
+  EXPECT(sent.size() == 2 && sent[1].body[0] == 0);
+
+  // Acked, twice: the second is stale and changes nothing
+  uint8_t ack[2] = {1, 0};
+  sim_cc_send(MSG_ID_RELIABLE_ACK, ack, sizeof(ack));
+  settle();
+  sim_cc_send(MSG_ID_RELIABLE_ACK, ack, sizeof(ack));
+  settle();
+  from = sim_cc_frames().size();
+  for (int i = 0; i < 50; i++) {
+    sim_advance(100000);
+    Serial.poll();
+  }
+  EXPECT(frames_sent(MSG_ID_RELIABLE_DATA, from).empty());
+
+  // The next frame goes out as seq 1, with base 1
+  reliable_acks = true;
+  Serial.print("next");
+  Serial.flush();
+  settle();
+  sent = frames_sent(MSG_ID_RELIABLE_DATA, from);
+  EXPECT(sent.size() == 1 && sent[0].body[0] == 1 && sent[0].body[1] == 1);
+  EXPECT(reliable_stats().retransmits == 1);
+  EXPECT(reliable_stats().given_up == 0);
+}
+
+void test_container_unpacking(void) {
+  uint8_t data[FRAME_SLOT_SIZE];
+  FrameSlot slot = {data, sizeof(data), 0, false, 0, NULL};
+
+  start();
+  EXPECT(Serial.addRoute(kSlotId, kSlotId, SINK_SLOT, &slot));
+  Serial.enableContainers(true);
+
+  // Two messages, then one whose length runs past the end
+  const uint8_t container[] = {MSG_ID_SERIAL_DATA >> 8,
+                               MSG_ID_SERIAL_DATA & 0xFF,
+                               2,
+                               'h',
+                               'i',
+                               kSlotId >> 8,
+                               kSlotId & 0xFF,
+                               1,
+                               'z',
+                               MSG_ID_SERIAL_DATA >> 8,
+                               MSG_ID_SERIAL_DATA & 0xFF,
+                               9,
+                               't'};
+  sim_cc_send(MSG_ID_CONTAINER, container, sizeof(container));
+  sim_advance(20000);
+  EXPECT(Serial.available() == 0);
+  Serial.poll();
+  EXPECT(Serial.available() == 2);
+  EXPECT(Serial.read() == 'h' && Serial.read() == 'i');
+  EXPECT(slot.updated && slot.length == 1 && data[0] == 'z');
+}
+
+// Printed a field at a time, 20 lines go out in a few containers, and
+// arrive as printed.
+void test_container_batching(void) {
+  start();
+  std::string expected;
+  for (int i = 0; i < 20; i++) {
+    char line[32];
+    snprintf(line, sizeof(line), "%d,%d,%d\r\n", i, i * 3, i * 7);
+    expected += line;
+  }
+
+  size_t from[3];
+  for (int pass = 0; pass < 2; pass++) {
+    Serial.enableContainers(pass == 1);
+    settle();
+    from[pass] = sim_cc_frames().size();
+    for (int i = 0; i < 20; i++) {
+      Serial.print(i);
+      Serial.print(',');
+      Serial.print(i * 3);
+      Serial.print(',');
+      Serial.println(i * 7);
+      Serial.poll();
+    }
+    Serial.flush();
+    settle();
+    EXPECT(serial_sent(from[pass]) == expected);
+    from[pass + 1] = sim_cc_frames().size();
+  }
+  size_t alone = from[1] - from[0];
+  size_t batched = from[2] - from[1];
+  EXPECT(batched > 0 && batched * 4 < alone);
+}
+
+// A short Bean.sleep() only delays, but what's queued goes out first
+void test_container_sleep(void) {
+  start();
+  Serial.enableContainers(true);
+  settle();
+  size_t from = sim_cc_frames().size();
+  Serial.print("led");
+  Bean.sleep(5);
+  EXPECT(serial_sent(from) == "led");
+}
+
+void test_packet_overflow(void) {
+  start();
+  Serial.enablePackets(true);
+
+  uint16_t dropped = transport_stats().dropped_frames;
+  const char *packets[] = {"one", "two", "three", "four", "five"};
+  for (int i = 0; i < 5; i++) {
+    send(MSG_ID_SERIAL_DATA, packets[i]);
+  }
+  EXPECT(transport_stats().dropped_frames == dropped + 1);
+
+  uint8_t buffer[8];
+  for (int i = 0; i < PACKET_QUEUE_SIZE; i++) {
+    int length = Serial.readPacket(buffer, sizeof(buffer));
+    EXPECT(length == (int)strlen(packets[i]));
+    EXPECT(length > 0 && memcmp(buffer, packets[i], length) == 0);
+  }
+  EXPECT(Serial.readPacket(buffer, sizeof(buffer)) == -1);
+  EXPECT(Serial.available() == 0);
+}
+
+void test_packet_partial_read(void) {
+  start();
+  Serial.enablePackets(true);
+  send(MSG_ID_SERIAL_DATA, "hello");
+  send(MSG_ID_SERIAL_DATA, "ab");
+  send(MSG_ID_SERIAL_DATA, "truncated");
+
+  // read() eats into the first packet, and readPacket() gets the rest
+  EXPECT(Serial.read() == 'h');
+  EXPECT(Serial.read() == 'e');
+  EXPECT(Serial.packetAvailable() == 3);
+  uint8_t buffer[4];
+  EXPECT(Serial.readPacket(buffer, sizeof(buffer)) == 3);
+  EXPECT(memcmp(buffer, "llo", 3) == 0);
+
+  // Reading all of one packet with read() leaves the next one whole
+  EXPECT(Serial.read() == 'a' && Serial.read() == 'b');
+  EXPECT(Serial.packetAvailable() == 9);
+
+  // Too long for buffer: cut short, and its full length returned
+  EXPECT(Serial.readPacket(buffer, sizeof(buffer)) == 9);
+  EXPECT(memcmp(buffer, "trun", 4) == 0);
+  EXPECT(Serial.available() == 0);
+  EXPECT(Serial.packetAvailable() == -1);
+}
+
+void test_cache_expiry(void) {
+  start();
+  EXPECT(temperature_reads == 1);
+  EXPECT(Bean.getTemperature() == 20);
+  EXPECT(temperature_reads == 1);
+
+  // Expired: the old reading is served while a new one is fetched. The CC
+  // is asleep by now, so the request waits for a poll after it wakes.
+  sim_advance(TEMPERATURE_CACHE_TTL_MS * 1000UL);
+  EXPECT(Bean.getTemperature() == 20);
+  settle();
+  EXPECT(temperature_reads == 1);
+  settle();
+  EXPECT(temperature_reads == 2);
+  EXPECT(Bean.getTemperature() == 21);
+  EXPECT(temperature_reads == 2);
+
+  Bean.setSensorCacheTtl(CACHED_TEMPERATURE, 0);
+  EXPECT(Bean.getTemperature() == 22);
+  EXPECT(Bean.getTemperature() == 23);
+  EXPECT(temperature_reads == 4);
+}
+
+const uint32_t kBulkLength = 4096;
+BULK_STATUS_T bulk_status;
+
+size_t bulk_reader(uint32_t offset, uint8_t *buffer, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] = (uint8_t)((offset + i) * 7 + (offset + i) / 251);
+  }
+  return length;
+}
+
+void on_bulk(BULK_STATUS_T status, uint32_t, uint32_t) {
+  bulk_status = status;
+}
+
+// Every fifth frame is lost the first time; go-back-N still gets all of it
+// there, in order.
+void test_bulk_write(void) {
+  start();
+  bulk_status = BULK_IDLE;
+  EXPECT(Serial.beginBulkWrite(kBulkLength, bulk_reader, on_bulk));
+  EXPECT(!Serial.beginBulkWrite(kBulkLength, bulk_reader, on_bulk));
+  for (int i = 0; i < 20000 && bulk_status != BULK_DONE &&
+                  bulk_status != BULK_FAILED;
+       i++) {
+    sim_advance(1000);
+    Serial.poll();
+  }
+  EXPECT(bulk_status == BULK_DONE);
+  EXPECT(Serial.bulkWriteStatus() == BULK_DONE);
+
+  uint8_t expected[kBulkLength];
+  bulk_reader(0, expected, kBulkLength);
+  EXPECT(bulk_received.size() == kBulkLength);
+  EXPECT(bulk_received.size() == kBulkLength &&
+         memcmp(bulk_received.data(), expected, kBulkLength) == 0);
+}
+
+struct Sample {
+  uint32_t time;
+  int16_t temperature;
+  bool moving;
+
+  template <typename Fields>
+  void telemetry(Fields &f, const Sample &prev) const {
+    f.delta(time, prev.time);
+    f.value(temperature);
+    f.flag(moving);
+  }
+};
+
+uint32_t varint(const std::vector<uint8_t> &body, size_t *at) {
+  uint32_t v = 0;
+  for (uint8_t shift = 0; *at < body.size(); shift += 7) {
+    uint8_t c = body[(*at)++];
+    v |= (uint32_t)(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      break;
+    }
+  }
+  return v;
+}
+
+int32_t zigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+// Records decode to what was written, key records included, and go out
+// through write_message(), so reliable mode wraps them too.
+void test_telemetry_records(void) {
+  TelemetryEncoder<Sample> encoder(3, 4);
+
+  start();
+  size_t from = sim_cc_frames().size();
+  for (int n = 0; n < 10; n++) {
+    Sample sample = {(uint32_t)n * 250, (int16_t)(23 - n * 3), n % 3 == 0};
+    EXPECT(encoder.write(sample));
+  }
+  settle();
+
+  std::vector<SimFrame> frames = frames_sent(MSG_ID_TELEMETRY, from);
+  EXPECT(frames.size() == 10);
+  Sample prev = {0, 0, false};
+  for (size_t n = 0; n < frames.size(); n++) {
+    const std::vector<uint8_t> &body = frames[n].body;
+    bool key = n % 4 == 0;
+    EXPECT(body.size() >= 3 && body[0] == 3);
+    EXPECT(body.size() >= 3 && body[1] == ((key ? TELEMETRY_KEY : 0) | n));
+    if (key) {
+      prev.time = 0;
+    }
+    size_t at = 2;
+    uint32_t time = prev.time + zigzag(varint(body, &at));
+    int32_t temperature = zigzag(varint(body, &at));
+    bool moving = at < body.size() && (body[at++] & 1);
+    EXPECT(at == body.size());
+    EXPECT(time == n * 250UL);
+    EXPECT(temperature == 23 - (int32_t)n * 3);
+    EXPECT(moving == (n % 3 == 0));
+    prev.time = time;
+  }
+
+  reliable_acks = true;
+  Serial.enableReliable(true);
+  settle();
+  from = sim_cc_frames().size();
+  Sample sample = {5000, 1, true};
+  EXPECT(encoder.write(sample));
+  settle();
+  EXPECT(frames_sent(MSG_ID_TELEMETRY, from).empty());
+  frames = frames_sent(MSG_ID_RELIABLE_DATA, from);
+  EXPECT(frames.size() == 1 && frames[0].body.size() > RELIABLE_HEADER_LENGTH);
+  EXPECT(frames.size() == 1 &&
+         ((frames[0].body[2] << 8) | frames[0].body[3]) == MSG_ID_TELEMETRY);
+}
+
+struct Test {
+  const char *name;
+  void (*run)(void);
+};
+
+const Test kTests[] = {
+    {"builtin_routes", test_builtin_routes},
+    {"added_routes", test_added_routes},
+    {"crc_failure", test_crc_failure},
+    {"truncated_frame", test_truncated_frame},
+    {"request_retries", test_request_retries},
+    {"reliable_receive", test_reliable_receive},
+    {"reliable_receive_lossy", test_reliable_receive_lossy},
+    {"reliable_retransmit", test_reliable_retransmit},
+    {"container_unpacking", test_container_unpacking},
+    {"container_batching", test_container_batching},
+    {"container_sleep", test_container_sleep},
+    {"packet_overflow", test_packet_overflow},
+    {"packet_partial_read", test_packet_partial_read},
+    {"cache_expiry", test_cache_expiry},
+    {"bulk_write", test_bulk_write},
+    {"telemetry_records", test_telemetry_records},
+};
+
+}  // namespace
+
+int main() {
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(kTests) / sizeof(kTests[0]); i++) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+      kTests[i].run();
+      fflush(stdout);
+      _exit(failures ? 1 : 0);
+    }
+    int status = -1;
+    if (child > 0) {
+      waitpid(child, &status, 0);
+    }
+    bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    printf("%s %s\n", passed ? "PASS" : "FAIL", kTests[i].name);
+    failed += !passed;
+  }
+  printf("%d of %d failed\n", failed,
+         (int)(sizeof(kTests) / sizeof(kTests[0])));
+  return failed ? 1 : 0;
+}
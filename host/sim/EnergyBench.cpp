@@ -0,0 +1,187 @@
+// Estimates what a sketch costs in charge, in mAh a day. The sketch runs on
+// the host against sim_cc_answer() for a stretch of simulated time, and the
+// core's PowerStats (Serial.getPowerStats()) are then priced with the
+// current model below:
+//
+//   make -C host energy SKETCH=../examples/sleep/sleep.ino MINUTES=60
+//
+// PowerStats from a real Bean can be priced the same way: pass the body of
+// its MSG_ID_DB_POWER_STATS message (Serial.debugWritePowerStats()) in hex.
+//
+//   build/sim-bean/EnergyBench-sleep --stats 60ea0000...
+//
+// The model charges the AVR for the time it is awake or powered down, and
+// the CC for a floor (advertising, or keeping a connection), for each time
+// it is woken to take a frame, for the time bytes spend on the link, and for
+// each frame sent to it. The defaults are datasheet figures for the
+// ATmega328P and CC2540, and estimates where a datasheet can't say; any of
+// them can be overridden.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BeanSim.h"
+#include "Arduino.h"
+
+#include BEAN_SKETCH
+
+namespace {
+
+struct Model {
+  double avr_active_ma;  // running, busy waits included
+  double avr_down_ua;    // powered down, BOD off
+  double cc_floor_ua;    // asleep between radio events
+  double cc_active_ma;   // awake with the radio off
+  double cc_wake_ms;     // awake per wake, besides bytes on the link
+  double frame_uc;       // radio time per frame the CC passes on
+  double capacity_mah;
+  uint32_t link_rate;
+};
+
+#if F_CPU == 16000000L
+// Bean+: 16 MHz at 3.3 V, on its 600 mAh LiPo
+const Model kDefaults = {6.5, 0.2, 20.0, 6.7, 10.0, 10.0, 600.0,
+                         LINK_RATE_DEFAULT};
+#else
+// Bean: 8 MHz at 3 V, on a CR2032
+const Model kDefaults = {3.0, 0.2, 20.0, 6.7, 10.0, 10.0, 220.0,
+                         LINK_RATE_DEFAULT};
+#endif
+
+struct Option {
+  const char *name;
+  double *value;
+};
+
+bool parse_stats(const char *hex, PowerStats *stats) {
+  uint8_t *bytes = (uint8_t *)stats;
+  if (strlen(hex) != 2 * sizeof(*stats)) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(*stats); i++) {
+    char pair[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+    char *end;
+    bytes[i] = (uint8_t)strtoul(pair, &end, 16);
+    if (*end != '\0') {
+      return false;
+    }
+  }
+  return true;
+}
+
+void print_row(const char *name, double uc, double per_day) {
+  printf("  %-14s %10.3f mAh/day\n", name, uc * per_day / 3600000.0);
+}
+
+void report(const PowerStats &stats, double seconds, const Model &model) {
+  double awake_s = stats.awake_ms / 1000.0;
+  double asleep_s = stats.asleep_ms / 1000.0;
+  double link_s =
+      (stats.tx_bytes + stats.rx_bytes) * 10.0 / (double)model.link_rate;
+
+  // Charge in microcoulombs (uA s)
+  double avr_awake = model.avr_active_ma * 1000.0 * awake_s;
+  double avr_asleep = model.avr_down_ua * asleep_s;
+  double cc_floor = model.cc_floor_ua * seconds;
+  double cc_wakes = model.cc_active_ma * stats.cc_wakes * model.cc_wake_ms;
+  double link = model.cc_active_ma * 1000.0 * link_s;
+  double frames = model.frame_uc * stats.tx_frames;
+  double total = avr_awake + avr_asleep + cc_floor + cc_wakes + link + frames;
+  double per_day = 86400.0 / seconds;
+
+  printf("over %.1f s: awake %.1f s (core delays %.1f s, waiting on the CC "
+         "%.1f s), asleep %.1f s in %lu sleeps\n",
+         seconds, awake_s, stats.delay_ms / 1000.0, stats.wait_ms / 1000.0,
+         asleep_s, (unsigned long)stats.sleeps);
+  printf("frames %lu out, %lu in, %lu + %lu bytes, %lu CC wakes\n",
+         (unsigned long)stats.tx_frames, (unsigned long)stats.rx_frames,
+         (unsigned long)stats.tx_bytes, (unsigned long)stats.rx_bytes,
+         (unsigned long)stats.cc_wakes);
+  print_row("AVR awake", avr_awake, per_day);
+  print_row("AVR asleep", avr_asleep, per_day);
+  print_row("CC floor", cc_floor, per_day);
+  print_row("CC wakes", cc_wakes, per_day);
+  print_row("link bytes", link, per_day);
+  print_row("frames", frames, per_day);
+  print_row("total", total, per_day);
+  printf("  %.1f days on %.0f mAh\n",
+         model.capacity_mah / (total * per_day / 3600000.0),
+         model.capacity_mah);
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "usage: EnergyBench [--minutes N] [--stats HEX] [--link-rate BAUD]\n"
+          "         [--avr-active-ma X] [--avr-down-ua X] [--cc-floor-ua X]\n"
+          "         [--cc-active-ma X] [--cc-wake-ms X] [--frame-uc X]\n"
+          "         [--capacity-mah X]\n");
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Model model = kDefaults;
+  double minutes = 60;
+  const char *hex = NULL;
+  double link_rate = 0;
+  const Option options[] = {
+      {"--minutes", &minutes},
+      {"--link-rate", &link_rate},
+      {"--avr-active-ma", &model.avr_active_ma},
+      {"--avr-down-ua", &model.avr_down_ua},
+      {"--cc-floor-ua", &model.cc_floor_ua},
+      {"--cc-active-ma", &model.cc_active_ma},
+      {"--cc-wake-ms", &model.cc_wake_ms},
+      {"--frame-uc", &model.frame_uc},
+      {"--capacity-mah", &model.capacity_mah},
+  };
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage();
+    }
+    if (strcmp(argv[i], "--stats") == 0) {
+      hex = argv[++i];
+      continue;
+    }
+    size_t j = 0;
+    while (j < sizeof(options) / sizeof(options[0]) &&
+           strcmp(argv[i], options[j].name) != 0) {
+      j++;
+    }
+    if (j == sizeof(options) / sizeof(options[0])) {
+      usage();
+    }
+    *options[j].value = atof(argv[++i]);
+  }
+
+  PowerStats stats;
+  if (hex) {
+    if (!parse_stats(hex, &stats)) {
+      fprintf(stderr, "EnergyBench: --stats wants %u bytes of hex\n",
+              (unsigned)sizeof(stats));
+      return 2;
+    }
+    model.link_rate = link_rate ? (uint32_t)link_rate : model.link_rate;
+    report(stats, (stats.awake_ms + stats.asleep_ms) / 1000.0, model);
+    return 0;
+  }
+
+  sim_cc_set_handler(sim_cc_answer, NULL);
+  Serial.resetPowerStats();
+  uint64_t end = (uint64_t)(minutes * 60e6);
+
+  setup();
+  while (sim_micros() < end) {
+    loop();
+    Serial.poll();
+  }
+
+  Serial.getPowerStats(&stats);
+  model.link_rate = link_rate ? (uint32_t)link_rate : Serial.getLinkRate();
+  printf("%s on %s\n", BEAN_SKETCH, F_CPU == 16000000L ? "bean+" : "bean");
+  report(stats, sim_micros() / 1e6, model);
+  return 0;
+}
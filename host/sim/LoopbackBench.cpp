@@ -0,0 +1,72 @@
+// Runs the core's loopback benchmark (Serial.debugLoopbackSweep()) on the
+// host and prints its table. The CC is simulated here, answering at once,
+// unless BEAN_SIM_CC names a stand-in to run it against instead:
+//
+//   make -C host loopback
+//   ../beanModuleEmulator/BeanCCStandIn.py --pty /tmp/bean-cc --no-pace &
+//   BEAN_SIM_CC=/tmp/bean-cc make -C host loopback
+//
+// Options: the number of round trips per size (100), and --delays to leave
+// the wake and send delays on, as a sketch that doesn't keep the CC awake
+// has them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BeanSim.h"
+#include "Arduino.h"
+
+namespace {
+
+class StdoutPrint : public Print {
+ public:
+  virtual size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+};
+
+// The CC's side of the link rate negotiation and the loopback
+void cc_handler(const SimFrame &frame, void *) {
+  if (frame.messageId == MSG_ID_LINK_RATE && frame.body.size() >= 4) {
+    sim_cc_send(frame.messageId, &frame.body[0], 4);
+    sim_cc_set_link_rate(((uint32_t)frame.body[0] << 24) |
+                         ((uint32_t)frame.body[1] << 16) |
+                         ((uint32_t)frame.body[2] << 8) | frame.body[3]);
+  } else if (frame.messageId == MSG_ID_LINK_RATE_CONFIRM ||
+             frame.messageId == MSG_ID_DB_LOOPBACK) {
+    sim_cc_send(frame.messageId, &frame.body[0], frame.body.size());
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint16_t iterations = 100;
+  bool delays = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--delays") == 0) {
+      delays = true;
+    } else {
+      iterations = atoi(argv[i]);
+    }
+  }
+
+  const char *peer = getenv("BEAN_SIM_CC");
+  if (peer && *peer) {
+    if (!sim_cc_connect(peer)) {
+      fprintf(stderr, "LoopbackBench: can't open %s\n", peer);
+      return 1;
+    }
+  } else {
+    sim_cc_set_handler(cc_handler, NULL);
+  }
+
+  Bean.keepAwake(!delays);
+  Serial.begin();
+
+  StdoutPrint out;
+  printf("link at %lu baud, CC %s, delays %s\n",
+         (unsigned long)Serial.getLinkRate(),
+         peer && *peer ? peer : "simulated", delays ? "on" : "off");
+  Serial.debugLoopbackSweep(iterations, &out);
+  return 0;
+}
@@ -0,0 +1,136 @@
+// The CC's side of the core's requests, for sketches run on the host. See
+// sim_cc_answer() in BeanSim.h.
+
+#include <string.h>
+
+#include "BeanSim.h"
+#include "Arduino.h"
+
+namespace {
+
+BT_SCRATCH_T scratch[5];
+
+void reply(const SimFrame &frame, const void *body, size_t length) {
+  sim_cc_send(frame.messageId, (const uint8_t *)body, length);
+}
+
+void wake(void *) {
+  PIND &= ~_BV(3);
+  sim_external_interrupt(1);
+}
+
+}  // namespace
+
+void sim_cc_answer(const SimFrame &frame, void *) {
+  const uint8_t *body = frame.body.empty() ? NULL : &frame.body[0];
+  size_t length = frame.body.size();
+  uint8_t byte = 0;
+
+  switch (frame.messageId) {
+    case MSG_ID_LINK_RATE:
+      if (length >= 4) {
+        reply(frame, body, 4);
+        sim_cc_set_link_rate(((uint32_t)body[0] << 24) |
+                             ((uint32_t)body[1] << 16) |
+                             ((uint32_t)body[2] << 8) | body[3]);
+      }
+      break;
+    case MSG_ID_LINK_RATE_CONFIRM:
+    case MSG_ID_DB_LOOPBACK:
+      reply(frame, body, length);
+      break;
+
+    case MSG_ID_BT_GET_CONFIG: {
+      BT_RADIOCONFIG_T config;
+      memset(&config, 0, sizeof(config));
+      config.adv_int = 500;
+      config.conn_int = 20;
+      memcpy(config.local_name, "Bean", 4);
+      config.local_name_size = 4;
+      reply(frame, &config, sizeof(config));
+      break;
+    }
+    case MSG_ID_BT_GET_STATES: {
+      BT_STATES_T states = {1, 1};
+      reply(frame, &states, sizeof(states));
+      break;
+    }
+    case MSG_ID_BT_SET_SCRATCH:
+      if (length >= 1 && body[0] >= 1 && body[0] <= 5) {
+        memset(&scratch[body[0] - 1], 0, sizeof(BT_SCRATCH_T));
+        memcpy(&scratch[body[0] - 1], body, min(length, sizeof(BT_SCRATCH_T)));
+      }
+      break;
+    case MSG_ID_BT_GET_SCRATCH:
+      if (length >= 1 && body[0] >= 1 && body[0] <= 5) {
+        reply(frame, &scratch[body[0] - 1], sizeof(BT_SCRATCH_T));
+      }
+      break;
+    case MSG_ID_GATT_GET_GATT: {
+      ADV_SWITCH_ENABLED_T services;
+      memset(&services, 0, sizeof(services));
+      services.standard = 1;
+      reply(frame, &services, sizeof(services));
+      break;
+    }
+
+    case MSG_ID_CC_LED_READ_ALL: {
+      LED_SETTING_T led = {16, 0, 32};
+      reply(frame, &led, sizeof(led));
+      break;
+    }
+    case MSG_ID_CC_ACCEL_READ: {
+      ACC_READING_T reading = {1, -2, 256, 2};
+      reply(frame, &reading, sizeof(reading));
+      break;
+    }
+    case MSG_ID_CC_TEMP_READ:
+      byte = 21;
+      reply(frame, &byte, 1);
+      break;
+    case MSG_ID_CC_BATT_READ:
+      byte = 87;
+      reply(frame, &byte, 1);
+      break;
+    case MSG_ID_CC_ACCEL_GET_RANGE:
+      byte = 2;
+      reply(frame, &byte, 1);
+      break;
+    case MSG_ID_CC_ACCEL_READ_REG:
+      reply(frame, &byte, 1);
+      break;
+
+    case MSG_ID_OBSERVER_START: {
+      OBSERVER_INFO_MESSAGE_T advert;
+      memset(&advert, 0, sizeof(advert));
+      advert.rssi = -60;
+      advert.dataLen = 3;
+      memcpy(advert.advData, "\x02\x01\x06", 3);
+      sim_cc_send(MSG_ID_OBSERVER_READ, (const uint8_t *)&advert,
+                  sizeof(advert) - sizeof(advert.advData) + advert.dataLen);
+      break;
+    }
+    case MSG_ID_ANCS_GET_NOTI:
+      // [command 0][uid][attribute][max length] gets [command][uid]
+      // [attribute][length][data]
+      if (length >= 8 && body[0] == 0) {
+        uint8_t attribute[8 + 5];
+        memcpy(attribute, body, 6);
+        attribute[6] = 5;
+        attribute[7] = 0;
+        memcpy(&attribute[8], "Hello", 5);
+        reply(frame, attribute, sizeof(attribute));
+      }
+      break;
+
+    case MSG_ID_AR_SLEEP:
+      // Lower the line when the sleep is up, as the CC does
+      if (length >= 4) {
+        uint32_t ms;
+        memcpy(&ms, body, 4);
+        PIND |= _BV(3);
+        sim_schedule((uint64_t)ms * 1000, wake, NULL);
+      }
+      break;
+  }
+}
@@ -0,0 +1,27 @@
+#ifndef BEAN_SIM_AVR_INTERRUPT_H
+#define BEAN_SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+// sei() and cli() set and clear SREG's I bit; the simulator only calls a
+// handler while it is set.
+#define sei() (SREG |= _BV(SREG_I))
+#define cli() (SREG &= (uint8_t)~_BV(SREG_I))
+#define reti()
+
+#ifdef __cplusplus
+#define ISR(vector, ...) extern "C" void vector(void)
+#else
+#define ISR(vector, ...) void vector(void)
+#endif
+#define SIGNAL(vector) ISR(vector)
+#define EMPTY_INTERRUPT(vector) \
+  ISR(vector) {}
+#define ISR_ALIAS(vector, target) \
+  ISR(vector) { target(); }
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define ISR_ALIASOF(target)
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef BEAN_SIM_AVR_IO_H
+#define BEAN_SIM_AVR_IO_H
+
+#include <stdint.h>
+
+// The ATmega328P's registers as plain variables, for the host build of the
+// core. Nothing happens when they are written; BeanSim.cpp reads the UART
+// and SREG ones to decide what the simulated hardware does next.
+
+#ifndef __AVR_ATmega328P__
+#define __AVR_ATmega328P__
+#endif
+
+#define BEAN_SIM_REGISTERS_8(R)                                              \
+  R(PINB) R(DDRB) R(PORTB) R(PINC) R(DDRC) R(PORTC) R(PIND) R(DDRD) R(PORTD) \
+  R(TIFR0) R(TIFR1) R(TIFR2) R(PCIFR) R(EIFR) R(EIMSK) R(GPIOR0) R(EECR)     \
+  R(EEDR) R(GTCCR) R(TCCR0A) R(TCCR0B) R(TCNT0) R(OCR0A) R(OCR0B) R(GPIOR1)  \
+  R(GPIOR2) R(SPCR) R(SPSR) R(SPDR) R(ACSR) R(SMCR) R(MCUSR) R(MCUCR)        \
+  R(SPMCSR) R(SPH) R(SPL) R(SREG) R(WDTCSR) R(CLKPR) R(PRR) R(OSCCAL)        \
+  R(PCICR) R(EICRA) R(PCMSK0) R(PCMSK1) R(PCMSK2) R(TIMSK0) R(TIMSK1)        \
+  R(TIMSK2) R(ADCL) R(ADCH) R(ADCSRA) R(ADCSRB) R(ADMUX) R(DIDR0) R(DIDR1)   \
+  R(TCCR1A) R(TCCR1B) R(TCCR1C) R(TCCR2A) R(TCCR2B) R(TCNT2) R(OCR2A)        \
+  R(OCR2B) R(ASSR) R(TWBR) R(TWSR) R(TWAR) R(TWDR) R(TWCR) R(TWAMR)          \
+  R(UCSR0A) R(UCSR0B) R(UCSR0C) R(UBRR0L) R(UBRR0H) R(UDR0)
+
+#define BEAN_SIM_REGISTERS_16(R) \
+  R(ADC) R(TCNT1) R(ICR1) R(OCR1A) R(OCR1B) R(EEAR)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#define BEAN_SIM_DECLARE_8(name) extern volatile uint8_t name;
+#define BEAN_SIM_DECLARE_16(name) extern volatile uint16_t name;
+BEAN_SIM_REGISTERS_8(BEAN_SIM_DECLARE_8)
+BEAN_SIM_REGISTERS_16(BEAN_SIM_DECLARE_16)
+#undef BEAN_SIM_DECLARE_8
+#undef BEAN_SIM_DECLARE_16
+#ifdef __cplusplus
+}
+#endif
+
+// The core tests for these with #if defined()
+#define UDR0 UDR0
+#define UBRR0H UBRR0H
+#define UBRR0L UBRR0L
+#define UCSR0A UCSR0A
+#define TCCR0A TCCR0A
+#define TCCR1A TCCR1A
+#define TCCR2A TCCR2A
+#define TIMSK0 TIMSK0
+#define TIMSK1 TIMSK1
+#define TIMSK2 TIMSK2
+#define EICRA EICRA
+#define EIMSK EIMSK
+#define PCICR PCICR
+#define ADCSRA ADCSRA
+#define ADCSRB ADCSRB
+#define ADCL ADCL
+#define OCR0A OCR0A
+#define OCR2A OCR2A
+#define TCNT0 TCNT0
+#define TCNT1 TCNT1
+#define OCR1B OCR1B
+#define TIFR0 TIFR0
+#define TIFR1 TIFR1
+
+#define RAMSTART 0x100
+#define RAMEND 0x8FF
+#define E2END 0x3FF
+#define FLASHEND 0x7FFF
+#define SPM_PAGESIZE 128
+
+// SREG
+#define SREG_I 7
+
+// TIMSK1, TIFR1
+#define OCIE1B 2
+#define OCF1B 2
+
+// UCSR0A, UCSR0B, UCSR0C
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define MPCM0 0
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ02 2
+#define RXB80 1
+#define TXB80 0
+#define UMSEL01 7
+#define UMSEL00 6
+#define UPM01 5
+#define UPM00 4
+#define USBS0 3
+#define UCSZ01 2
+#define UCSZ00 1
+#define UCPOL0 0
+
+// Timer/counter 0
+#define COM0A1 7
+#define COM0A0 6
+#define COM0B1 5
+#define COM0B0 4
+#define WGM01 1
+#define WGM00 0
+#define FOC0A 7
+#define FOC0B 6
+#define WGM02 3
+#define CS02 2
+#define CS01 1
+#define CS00 0
+#define OCIE0B 2
+#define OCIE0A 1
+#define TOIE0 0
+#define OCF0B 2
+#define OCF0A 1
+#define TOV0 0
+
+// Timer/counter 1
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+#define ICNC1 7
+#define ICES1 6
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define FOC1A 7
+#define FOC1B 6
+#define ICIE1 5
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1 0
+#define ICF1 5
+#define OCF1B 2
+#define OCF1A 1
+#define TOV1 0
+
+// Timer/counter 2
+#define COM2A1 7
+#define COM2A0 6
+#define COM2B1 5
+#define COM2B0 4
+#define WGM21 1
+#define WGM20 0
+#define FOC2A 7
+#define FOC2B 6
+#define WGM22 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+#define OCIE2B 2
+#define OCIE2A 1
+#define TOIE2 0
+#define OCF2B 2
+#define OCF2A 1
+#define TOV2 0
+
+// External and pin change interrupts
+#define ISC11 3
+#define ISC10 2
+#define ISC01 1
+#define ISC00 0
+#define INT1 1
+#define INT0 0
+#define INTF1 1
+#define INTF0 0
+#define PCIE2 2
+#define PCIE1 1
+#define PCIE0 0
+
+// ADC and analog comparator
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define MUX3 3
+#define MUX2 2
+#define MUX1 1
+#define MUX0 0
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define ACME 6
+#define ACD 7
+#define ACBG 6
+#define ACO 5
+#define ACI 4
+#define ACIE 3
+
+// MCUCR, SMCR, MCUSR, WDTCSR, PRR
+#define BODS 6
+#define BODSE 5
+#define PUD 4
+#define IVSEL 1
+#define IVCE 0
+#define SM2 3
+#define SM1 2
+#define SM0 1
+#define SE 0
+#define WDRF 3
+#define BORF 2
+#define EXTRF 1
+#define PORF 0
+#define WDIF 7
+#define WDIE 6
+#define WDP3 5
+#define WDCE 4
+#define WDE 3
+#define WDP2 2
+#define WDP1 1
+#define WDP0 0
+#define PRTWI 7
+#define PRTIM2 6
+#define PRTIM0 5
+#define PRTIM1 3
+#define PRSPI 2
+#define PRUSART0 1
+#define PRADC 0
+
+// SPI and TWI
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define WCOL 6
+#define SPI2X 0
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+
+// Port pins
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+// Interrupt vectors. ISR() makes each an extern "C" function BeanSim.cpp
+// can call.
+#define INT0_vect INT0_vect
+#define INT1_vect INT1_vect
+#define PCINT0_vect PCINT0_vect
+#define PCINT1_vect PCINT1_vect
+#define PCINT2_vect PCINT2_vect
+#define WDT_vect WDT_vect
+#define TIMER2_COMPA_vect TIMER2_COMPA_vect
+#define TIMER2_COMPB_vect TIMER2_COMPB_vect
+#define TIMER2_OVF_vect TIMER2_OVF_vect
+#define TIMER1_CAPT_vect TIMER1_CAPT_vect
+#define TIMER1_COMPA_vect TIMER1_COMPA_vect
+#define TIMER1_COMPB_vect TIMER1_COMPB_vect
+#define TIMER1_OVF_vect TIMER1_OVF_vect
+#define TIMER0_COMPA_vect TIMER0_COMPA_vect
+#define TIMER0_COMPB_vect TIMER0_COMPB_vect
+#define TIMER0_OVF_vect TIMER0_OVF_vect
+#define SPI_STC_vect SPI_STC_vect
+#define USART_RX_vect USART_RX_vect
+#define USART_UDRE_vect USART_UDRE_vect
+#define USART_TX_vect USART_TX_vect
+#define ADC_vect ADC_vect
+#define EE_READY_vect EE_READY_vect
+#define ANALOG_COMP_vect ANALOG_COMP_vect
+#define TWI_vect TWI_vect
+
+#define _BV(bit) (1 << (bit))
+#define _SFR_BYTE(sfr) (sfr)
+#define _SFR_WORD(sfr) (sfr)
+#define _SFR_IO_ADDR(sfr) 0
+#define _SFR_MEM_ADDR(sfr) 0
+#define bit_is_set(sfr, bit) (_SFR_BYTE(sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!(_SFR_BYTE(sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) \
+  do {                                  \
+  } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) \
+  do {                                    \
+  } while (bit_is_set(sfr, bit))
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef BEAN_SIM_AVR_PGMSPACE_H
+#define BEAN_SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Flash and RAM are one address space on the host.
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+typedef char prog_char;
+typedef uint8_t prog_uint8_t;
+typedef uint16_t prog_uint16_t;
+typedef uint32_t prog_uint32_t;
+
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_float(address) (*(const float *)(address))
+#define pgm_read_ptr(address) (*(void *const *)(address))
+#define pgm_read_byte_near(address) pgm_read_byte(address)
+#define pgm_read_word_near(address) pgm_read_word(address)
+#define pgm_read_dword_near(address) pgm_read_dword(address)
+#define pgm_read_byte_far(address) pgm_read_byte(address)
+#define pgm_read_word_far(address) pgm_read_word(address)
+
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+#define strnlen_P strnlen
+#define strcat_P strcat
+#define strstr_P strstr
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define printf_P printf
+
+#endif
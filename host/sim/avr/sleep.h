@@ -0,0 +1,35 @@
+#ifndef BEAN_SIM_AVR_SLEEP_H
+#define BEAN_SIM_AVR_SLEEP_H
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE (_BV(SM0) | _BV(SM1))
+#define SLEEP_MODE_STANDBY (_BV(SM1) | _BV(SM2))
+#define SLEEP_MODE_EXT_STANDBY (_BV(SM0) | _BV(SM1) | _BV(SM2))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// Runs simulated time until an interrupt handler has run
+void sim_sleep_cpu(void);
+#ifdef __cplusplus
+}
+#endif
+
+#define set_sleep_mode(mode) \
+  (SMCR = (SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode))
+#define sleep_enable() (SMCR |= _BV(SE))
+#define sleep_disable() (SMCR &= (uint8_t)~_BV(SE))
+#define sleep_cpu() sim_sleep_cpu()
+#define sleep_mode()  \
+  do {                \
+    sleep_enable();   \
+    sleep_cpu();      \
+    sleep_disable();  \
+  } while (0)
+#define sleep_bod_disable()
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BEAN_SIM_STDLIB_H
+#define BEAN_SIM_STDLIB_H
+
+// avr-libc's stdlib.h has conversions glibc doesn't; BeanSim.cpp has them.
+
+#include_next <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+char *itoa(int value, char *s, int radix);
+char *utoa(unsigned int value, char *s, int radix);
+char *ltoa(long value, char *s, int radix);
+char *ultoa(unsigned long value, char *s, int radix);
+char *dtostrf(double value, signed char width, unsigned char precision,
+              char *s);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BEAN_SIM_UTIL_ATOMIC_H
+#define BEAN_SIM_UTIL_ATOMIC_H
+
+#include <avr/interrupt.h>
+
+// Runs the block with SREG's I bit clear, then puts SREG back
+// (ATOMIC_RESTORESTATE) or sets I (ATOMIC_FORCEON).
+
+#define ATOMIC_BLOCK(type)                                            \
+  for (uint8_t sreg_save __attribute__((unused)) = SREG, done = 0; \
+       done == 0 ? (cli(), 1) : 0; done = 1, (type))
+#define ATOMIC_RESTORESTATE (SREG = sreg_save)
+#define ATOMIC_FORCEON (sei())
+
+#define NONATOMIC_BLOCK(type)                                         \
+  for (uint8_t sreg_save __attribute__((unused)) = SREG, done = 0; \
+       done == 0 ? (sei(), 1) : 0; done = 1, (type))
+#define NONATOMIC_RESTORESTATE (SREG = sreg_save)
+#define NONATOMIC_FORCEOFF (cli())
+
+#endif
@@ -0,0 +1,209 @@
+// Times the calls of the Bean, BeanMidi, BeanHid and BeanAncs APIs one at a
+// time, and prints a tab separated row for each to virtual serial: the
+// microseconds until it returned, the frames it sent to and got from the CC,
+// and the bytes of those frames on the wire. Send any byte over virtual
+// serial to start a run. make -C host apibench runs this same sketch
+// against a simulated CC.
+//
+// Calls that would drop the connection the rows go out on (disconnect(),
+// restartBluetooth()) aren't timed. Settings are changed with config saving
+// off and put back, so a run leaves nothing behind in the CC's NVRAM.
+// micros() stands still while the AVR is powered down, so on a Bean the
+// Bean.sleep() row is only its time awake.
+
+static TransportStats before;
+static unsigned long started;
+
+static uint16_t frameCount(const uint16_t *frames) {
+  uint16_t count = 0;
+  for (uint8_t i = 0; i < NUM_TRANSPORT_CHANNELS; i++) {
+    count += frames[i];
+  }
+  return count;
+}
+
+static void benchBegin(void) {
+  // The last row is still going out, and isn't part of this one
+  Serial.flush();
+  Serial.getTransportStats(&before);
+  started = micros();
+}
+
+static void benchEnd(const __FlashStringHelper *name) {
+  unsigned long elapsed = micros() - started;
+  TransportStats after;
+  Serial.getTransportStats(&after);
+
+  Serial.print(name);
+  Serial.print('\t');
+  Serial.print(elapsed);
+  Serial.print('\t');
+  Serial.print((uint16_t)(frameCount(after.tx_frames) -
+                          frameCount(before.tx_frames)));
+  Serial.print('\t');
+  Serial.print((uint16_t)(frameCount(after.rx_frames) -
+                          frameCount(before.rx_frames)));
+  Serial.print('\t');
+  Serial.print(after.tx_bytes + after.bytes_escaped - before.tx_bytes -
+               before.bytes_escaped);
+  Serial.print('\t');
+  Serial.println(after.rx_bytes - before.rx_bytes);
+}
+
+#define BENCH(name, call) \
+  do {                    \
+    benchBegin();         \
+    call;                 \
+    benchEnd(F(name));    \
+  } while (0)
+
+static void benchBean(void) {
+  uint8_t scratch[20];
+  memset(scratch, 0xA5, sizeof(scratch));
+  BT_RADIOCONFIG_T config;
+  BluetoothServices services;
+  RttStats rtt;
+  ObseverAdvertisementInfo observed;
+
+  BENCH("Bean.enableConfigSave", Bean.enableConfigSave(false));
+
+  BENCH("Bean.setLed", Bean.setLed(16, 0, 32));
+  BENCH("Bean.getLed", Bean.getLed());
+  BENCH("Bean.setLedRed", Bean.setLedRed(0));
+  BENCH("Bean.getLedRed", Bean.getLedRed());
+
+  BENCH("Bean.getAcceleration", Bean.getAcceleration());
+  BENCH("Bean.getAccelerationX", Bean.getAccelerationX());
+  BENCH("Bean.getAccelerationRange", Bean.getAccelerationRange());
+  BENCH("Bean.setAccelerationRange", Bean.setAccelerationRange(2));
+  BENCH("Bean.accelRegisterRead",
+        Bean.accelRegisterRead(0x0F, 1, scratch));
+  BENCH("Bean.accelRegisterWrite", Bean.accelRegisterWrite(0x0F, 0x03));
+  BENCH("Bean.getAccelerometerPowerMode", Bean.getAccelerometerPowerMode());
+  BENCH("Bean.setAccelerometerPowerMode",
+        Bean.setAccelerometerPowerMode(0x00));
+  BENCH("Bean.enableMotionEvent", Bean.enableMotionEvent(ANY_MOTION_EVENT));
+  BENCH("Bean.checkMotionEvent", Bean.checkMotionEvent(ANY_MOTION_EVENT));
+  BENCH("Bean.disableMotionEvents", Bean.disableMotionEvents());
+
+  // The first read of a cached value blocks, the next doesn't
+  BENCH("Bean.getTemperature", Bean.getTemperature());
+  BENCH("Bean.getTemperature cached", Bean.getTemperature());
+  BENCH("Bean.getBatteryLevel", Bean.getBatteryLevel());
+  BENCH("Bean.getBatteryLevel cached", Bean.getBatteryLevel());
+  BENCH("Bean.getBatteryVoltage", Bean.getBatteryVoltage());
+  BENCH("Bean.getConnectionState", Bean.getConnectionState());
+  BENCH("Bean.getConnectionState cached", Bean.getConnectionState());
+  BENCH("Bean.getAdvertisingState", Bean.getAdvertisingState());
+  BENCH("Bean.setSensorCacheTtl",
+        Bean.setSensorCacheTtl(CACHED_TEMPERATURE, 1000));
+  BENCH("Bean.getRttStats", rtt = Bean.getRttStats(RTT_CLASS_PERIPHERAL));
+
+  BENCH("Bean.getBeanName", Bean.getBeanName());
+  String name = Bean.getBeanName();
+  BENCH("Bean.setBeanName", Bean.setBeanName(name));
+  BENCH("Bean.getRadioConfig", Bean.getRadioConfig(&config));
+  BENCH("Bean.setRadioConfig", Bean.setRadioConfig(config, false));
+  BENCH("Bean.setAdvertisingInterval",
+        Bean.setAdvertisingInterval(config.adv_int));
+  BENCH("Bean.enableAdvertising", Bean.enableAdvertising(true));
+  BENCH("Bean.setBeaconParameters",
+        Bean.setBeaconParameters(config.ibeacon_uuid, config.ibeacon_major,
+                                 config.ibeacon_minor));
+  BENCH("Bean.setBeaconEnable", Bean.setBeaconEnable(false));
+  BENCH("Bean.enableiBeacon", Bean.enableiBeacon());
+  BENCH("Bean.enableCustom", Bean.enableCustom());
+  uint8_t advertisement[] = {0x02, 0x01, 0x06, 0x03, 0xFF, 0xAC, 0x00};
+  BENCH("Bean.setCustomAdvertisement",
+        Bean.setCustomAdvertisement(advertisement, sizeof(advertisement)));
+  BENCH("Bean.disableCustom", Bean.disableCustom());
+  BENCH("Bean.getServices", services = Bean.getServices());
+  BENCH("Bean.setServices", Bean.setServices(services));
+  BENCH("Bean.resetServices", Bean.resetServices());
+  BENCH("Bean.setPairingPin", Bean.setPairingPin(123456));
+  BENCH("Bean.enablePairingPin", Bean.enablePairingPin(false));
+  BENCH("Bean.enableWakeOnConnect", Bean.enableWakeOnConnect(false));
+  BENCH("Bean.getObserverMessage", Bean.getObserverMessage(&observed, 500));
+
+  BENCH("Bean.setScratchData",
+        Bean.setScratchData(1, scratch, sizeof(scratch)));
+  BENCH("Bean.readScratchData", Bean.readScratchData(1));
+  BENCH("Bean.setScratchNumber", Bean.setScratchNumber(2, 0xC0FFEE));
+  BENCH("Bean.readScratchNumber", Bean.readScratchNumber(2));
+
+  BENCH("Bean.keepAwake", Bean.keepAwake(true));
+  BENCH("Bean.sleep", Bean.sleep(100));
+  BENCH("Bean.keepAwake off", Bean.keepAwake(false));
+
+  BENCH("Bean.enableConfigSave on", Bean.enableConfigSave(true));
+}
+
+static void benchMidi(void) {
+  BENCH("BeanMidi.enable", BeanMidi.enable());
+  BENCH("BeanMidi.isEnabled", BeanMidi.isEnabled());
+  BENCH("BeanMidi.noteOn", BeanMidi.noteOn(CHANNEL0, 60, 100));
+  BENCH("BeanMidi.noteOff", BeanMidi.noteOff(CHANNEL0, 60, 0));
+  BENCH("BeanMidi.pitchBend", BeanMidi.pitchBend(CHANNEL0, 0x2000));
+  BENCH("BeanMidi.sustain", BeanMidi.sustain(CHANNEL0, false));
+  BENCH("BeanMidi.sendMessage", BeanMidi.sendMessage(0x90, 64, 100));
+  BENCH("BeanMidi.loadMessage", BeanMidi.loadMessage(0x80, 64, 0));
+  BENCH("BeanMidi.sendMessages", BeanMidi.sendMessages());
+  BENCH("BeanMidi.disable", BeanMidi.disable());
+}
+
+static void benchHid(void) {
+  BENCH("BeanHid.enable", BeanHid.enable());
+  BENCH("BeanHid.isEnabled", BeanHid.isEnabled());
+  BENCH("BeanHid.sendKey", BeanHid.sendKey('a'));
+  BENCH("BeanHid.holdKey", BeanHid.holdKey(KEY_LEFT_SHIFT));
+  BENCH("BeanHid.releaseKey", BeanHid.releaseKey(KEY_LEFT_SHIFT));
+  BENCH("BeanHid.releaseAllKeys", BeanHid.releaseAllKeys());
+  BENCH("BeanHid.sendKeys", BeanHid.sendKeys("bean"));
+  BENCH("BeanHid.moveMouse", BeanHid.moveMouse(4, -4));
+  BENCH("BeanHid.sendMouseClick", BeanHid.sendMouseClick());
+  BENCH("BeanHid.sendMediaControl", BeanHid.sendMediaControl(VOLUME_UP));
+  BENCH("BeanHid.releaseAllMediaControls",
+        BeanHid.releaseAllMediaControls());
+  BENCH("BeanHid.disable", BeanHid.disable());
+}
+
+static void benchAncs(void) {
+  uint8_t title[32];
+  ANCS_SOURCE_MSG_T header;
+  memset(&header, 0, sizeof(header));
+
+  BENCH("BeanAncs.enable", BeanAncs.enable());
+  BENCH("BeanAncs.isEnabled", BeanAncs.isEnabled());
+  BENCH("BeanAncs.notificationsAvailable", BeanAncs.notificationsAvailable());
+  if (BeanAncs.notificationsAvailable()) {
+    BENCH("BeanAncs.getNotificationHeader",
+          header = BeanAncs.getNotificationHeader());
+  }
+  BENCH("BeanAncs.getNotificationAttributes",
+        BeanAncs.getNotificationAttributes(NOTI_ATTR_ID_TITLE,
+                                           header.notiUID, sizeof(title),
+                                           title, 500));
+  BENCH("BeanAncs.notificationAction",
+        BeanAncs.notificationAction(header.notiUID, 0));
+  BENCH("BeanAncs.disable", BeanAncs.disable());
+}
+
+void setup() {
+  Serial.begin();
+}
+
+void loop() {
+  if (Serial.available() == 0) {
+    return;
+  }
+  while (Serial.available()) {
+    Serial.read();
+  }
+
+  Serial.println(F("call\tus\ttx_frames\trx_frames\ttx_bytes\trx_bytes"));
+  benchBean();
+  benchMidi();
+  benchHid();
+  benchAncs();
+  Serial.println(F("done"));
+}
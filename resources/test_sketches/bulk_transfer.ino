@@ -0,0 +1,69 @@
+// Compares sending 4 KB as virtual serial writes with a windowed bulk write.
+// Run beanModuleEmulator/BeanCCStandIn.py on the other end of the UART; it
+// acks the bulk frames and reports the throughput it sees for both.
+
+#define PAYLOAD_LENGTH 4096
+#define RECORD_LENGTH 16
+
+static size_t readPayload(uint32_t offset, uint8_t *buffer, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] = (uint8_t)((offset + i) * 7);
+  }
+  return length;
+}
+
+static volatile bool bulkDone = false;
+
+static void bulkProgress(BULK_STATUS_T status, uint32_t acked,
+                         uint32_t length) {
+  if (status != BULK_SENDING) {
+    bulkDone = true;
+  }
+}
+
+static void report(const char *name, uint32_t ms) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print((uint32_t)PAYLOAD_LENGTH * 1000 / ms);
+  Serial.println(" bytes/s");
+}
+
+void setup() {}
+
+void loop() {
+  uint8_t record[MAX_BODY_LENGTH];
+  uint32_t start;
+
+  // Logged records written as they come
+  start = millis();
+  for (uint32_t offset = 0; offset < PAYLOAD_LENGTH; offset += RECORD_LENGTH) {
+    readPayload(offset, record, RECORD_LENGTH);
+    Serial.write(record, RECORD_LENGTH);
+  }
+  Serial.flush();
+  report("records", millis() - start);
+
+  // The same data in full frames
+  start = millis();
+  for (uint32_t offset = 0; offset < PAYLOAD_LENGTH;
+       offset += MAX_BODY_LENGTH) {
+    size_t length = min(PAYLOAD_LENGTH - offset, MAX_BODY_LENGTH);
+    readPayload(offset, record, length);
+    Serial.write(record, length);
+  }
+  Serial.flush();
+  report("chunked", millis() - start);
+
+  // Bulk write; poll() does the work and the callback says when it's over
+  bulkDone = false;
+  start = millis();
+  Serial.beginBulkWrite(PAYLOAD_LENGTH, readPayload, bulkProgress);
+  while (!bulkDone) {
+    Serial.poll();
+  }
+  Serial.flush();
+  report(Serial.bulkWriteStatus() == BULK_DONE ? "bulk" : "bulk (failed)",
+         millis() - start);
+
+  Bean.sleep(5000);
+}
@@ -0,0 +1,61 @@
+// Dumps a logged sensor CSV raw and then compressed, and reports how long
+// each took. Run beanModuleEmulator/BeanCCStandIn.py on the other end of the
+// UART; it decompresses the second dump and reports the compression ratio.
+
+#define LOG_LINES 200
+#define DUMP_LENGTH 256
+
+static char dump[DUMP_LENGTH];
+static size_t dumpLength;
+
+// Stands in for records read back from storage: a slow random walk, the way
+// temperature and a resting accelerometer look.
+static void dumpLog(void) {
+  int8_t temperature = 23;
+  int16_t x = 0, y = 0, z = 256;
+
+  randomSeed(1);
+  dumpLength = 0;
+  for (uint16_t line = 0; line < LOG_LINES; line++) {
+    temperature += random(6) == 0 ? (random(2) ? 1 : -1) : 0;
+    x += random(-3, 4);
+    y += random(-3, 4);
+    z += random(-3, 4);
+
+    char record[40];
+    size_t length = snprintf(record, sizeof(record), "%lu,%d,%d,%d,%d\r\n",
+                             line * 250UL, temperature, x, y, z);
+    if (dumpLength + length > DUMP_LENGTH) {
+      Serial.write((const uint8_t *)dump, dumpLength);
+      dumpLength = 0;
+    }
+    memcpy(dump + dumpLength, record, length);
+    dumpLength += length;
+  }
+  Serial.write((const uint8_t *)dump, dumpLength);
+  Serial.flush();
+}
+
+static uint32_t timeDump(bool compressed) {
+  Serial.enableCompression(compressed);
+  uint32_t start = millis();
+  dumpLog();
+  uint32_t ms = millis() - start;
+  Serial.enableCompression(false);
+  return ms;
+}
+
+void setup() {}
+
+void loop() {
+  uint32_t raw = timeDump(false);
+  uint32_t compressed = timeDump(true);
+
+  Serial.print("raw: ");
+  Serial.print(raw);
+  Serial.print(" ms, compressed: ");
+  Serial.print(compressed);
+  Serial.println(" ms");
+
+  Bean.sleep(5000);
+}
@@ -0,0 +1,35 @@
+// Prints the same lines with and without container frames and reports how
+// long each took. Run beanModuleEmulator/BeanCCStandIn.py on the other end of
+// the UART to unpack the containers.
+
+#define LINES 50
+
+static uint32_t printLines(void) {
+  uint32_t start = millis();
+  for (uint16_t n = 0; n < LINES; n++) {
+    Serial.print(n * 250UL);
+    Serial.print(',');
+    Serial.print(Bean.getTemperature());
+    Serial.print(',');
+    Serial.println(Bean.getBatteryVoltage());
+  }
+  Serial.flush();
+  return millis() - start;
+}
+
+void setup() {}
+
+void loop() {
+  Serial.enableContainers(false);
+  uint32_t separate = printLines();
+  Serial.enableContainers(true);
+  uint32_t batched = printLines();
+
+  Serial.print("separate: ");
+  Serial.print(separate);
+  Serial.print(" ms, containers: ");
+  Serial.print(batched);
+  Serial.println(" ms");
+
+  Bean.sleep(5000);
+}
@@ -0,0 +1,39 @@
+// Keeps the core busy the ways that hold interrupts off: serial traffic for
+// the RX ISR, requests to the CC, millis() and a SoftwareSerial port, plus a
+// window of its own. Every ten seconds it sends the latency histograms and
+// sites as MSG_ID_DB_LATENCY messages, which BeanCCStandIn.py prints. Build
+// it with Tools > Latency probe on; without it nothing is measured.
+
+#include <SoftwareSerial.h>
+
+#define LATENCY_COPY (LATENCY_USER)
+
+static SoftwareSerial port(4, 5);
+static volatile uint8_t shared[32];
+static uint8_t copy[32];
+static unsigned long reported;
+
+void setup() {
+  Bean.keepAwake(true);
+  port.begin(9600);
+}
+
+void loop() {
+  Serial.println(Bean.getTemperature());
+  port.print(millis());
+
+  noInterrupts();
+  LATENCY_OFF_BEGIN(LATENCY_COPY);
+  for (uint8_t i = 0; i < sizeof(copy); i++) {
+    copy[i] = shared[i];
+  }
+  LATENCY_OFF_END(LATENCY_COPY);
+  interrupts();
+
+  if (millis() - reported >= 10000) {
+    reported = millis();
+    Serial.debugWriteLatency();
+    latencyReset();
+  }
+  delay(50);
+}
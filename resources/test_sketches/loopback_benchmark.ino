@@ -0,0 +1,12 @@
+// Measures round trips to the CC at every payload size once a minute. Each
+// size's LoopbackBenchResult goes out as a MSG_ID_DB_LOOPBACK_BENCH message,
+// which BeanCCStandIn.py prints.
+
+void setup() {
+  Bean.keepAwake(true);
+}
+
+void loop() {
+  Serial.debugLoopbackSweep(100);
+  Bean.sleep(60000);
+}
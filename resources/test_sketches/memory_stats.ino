@@ -0,0 +1,27 @@
+// Builds up a String a line at a time, as sketches logging to one do, and
+// reports where SRAM went after each line as a MSG_ID_DB_MEMORY_STATS
+// message, which BeanCCStandIn.py prints. Every eighth line the String is
+// sent and emptied. Each concatenation can reallocate it, which leaves
+// chunks on the free list. A String that can't grow stays as it was, and
+// only malloc_failures shows it.
+
+static String lines;
+static uint8_t round_count;
+
+void setup() {
+  Bean.keepAwake(true);
+}
+
+void loop() {
+  lines += F("temperature ");
+  lines += Bean.getTemperature();
+  lines += '\n';
+
+  if (++round_count % 8 == 0) {
+    Serial.print(lines);
+    lines = "";
+  }
+
+  Serial.debugWriteMemoryStats();
+  delay(1000);
+}
@@ -0,0 +1,39 @@
+// Takes commands one virtual serial packet at a time, e.g. "led 255 0 64" or
+// "temp", with no terminator and no read timeouts.
+
+void setup() {
+  Serial.enablePackets(true);
+}
+
+static void runCommand(char *command) {
+  char *name = strtok(command, " ");
+  if (name == NULL) {
+    return;
+  }
+
+  if (strcmp(name, "led") == 0) {
+    uint8_t rgb[3] = {0, 0, 0};
+    for (uint8_t i = 0; i < 3; i++) {
+      char *arg = strtok(NULL, " ");
+      rgb[i] = arg ? atoi(arg) : 0;
+    }
+    Bean.setLed(rgb[0], rgb[1], rgb[2]);
+    Serial.print("ok");
+  } else if (strcmp(name, "temp") == 0) {
+    Serial.print(Bean.getTemperature());
+  } else {
+    Serial.print("unknown command");
+  }
+}
+
+void loop() {
+  uint8_t packet[MAX_BODY_LENGTH + 1];
+  int length = Serial.readPacket(packet, MAX_BODY_LENGTH);
+
+  if (length > MAX_BODY_LENGTH) {
+    Serial.print("command too long");
+  } else if (length >= 0) {
+    packet[length] = '\0';
+    runCommand((char *)packet);
+  }
+}
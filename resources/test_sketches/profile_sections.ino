@@ -0,0 +1,57 @@
+// Profiles a moving average and float formatting, next to the core's own
+// sections, and sends the table every ten seconds as MSG_ID_DB_PROFILE
+// messages, which BeanCCStandIn.py prints. Build it with Tools > Profiler
+// on; without it every section is empty.
+
+#define PROFILE_AVERAGE (PROFILE_USER)
+#define PROFILE_FORMAT (PROFILE_USER + 1)
+
+// Formats into memory, so printFloat() is timed without the link
+class BufferPrint : public Print {
+ public:
+  BufferPrint() : length(0) {}
+  virtual size_t write(uint8_t c) {
+    if (length == sizeof(text)) {
+      return 0;
+    }
+    text[length++] = c;
+    return 1;
+  }
+  char text[16];
+  uint8_t length;
+};
+
+static int16_t samples[16];
+static uint8_t next;
+static unsigned long reported;
+
+void setup() {
+  Bean.keepAwake(true);
+}
+
+void loop() {
+  samples[next++ % 16] = Bean.getAccelerationX();
+
+  PROFILE_BEGIN(PROFILE_AVERAGE);
+  int32_t sum = 0;
+  for (uint8_t i = 0; i < 16; i++) {
+    sum += samples[i];
+  }
+  float average = sum / 16.0;
+  PROFILE_END(PROFILE_AVERAGE);
+
+  BufferPrint buffer;
+  PROFILE_BEGIN(PROFILE_FORMAT);
+  buffer.print(average, 2);
+  PROFILE_END(PROFILE_FORMAT);
+
+  Serial.write((const uint8_t *)buffer.text, buffer.length);
+  Serial.println();
+
+  if (millis() - reported >= 10000) {
+    reported = millis();
+    Serial.debugWriteProfile();
+    profileReset();
+  }
+  delay(100);
+}
@@ -0,0 +1,31 @@
+// Sends numbered lines in reliable mode and reports what it took. Run
+// beanModuleEmulator/BeanCCStandIn.py --corrupt 1e-4 on the other end of the
+// UART; every line should arrive once, in order, even with the bit errors.
+
+#define LINES 200
+
+void setup() {
+  Serial.enableReliable(true);
+}
+
+void loop() {
+  uint32_t start = millis();
+  for (uint16_t line = 0; line < LINES; line++) {
+    Serial.print("line ");
+    Serial.println(line);
+  }
+  Serial.flush();
+  uint32_t ms = millis() - start;
+
+  ReliableStats stats;
+  Serial.getReliableStats(&stats);
+  Serial.print(ms);
+  Serial.print(" ms, sent ");
+  Serial.print(stats.sent);
+  Serial.print(", resent ");
+  Serial.print(stats.retransmits + stats.fast_retransmits);
+  Serial.print(", given up ");
+  Serial.println(stats.given_up);
+
+  Bean.sleep(5000);
+}
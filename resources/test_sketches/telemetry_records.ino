@@ -0,0 +1,84 @@
+// Sends the same readings as printed CSV and as telemetry records, and
+// reports how long each took. Decode the records on the other end with
+//
+//   beanModuleEmulator/BeanCCStandIn.py PORT --schema \
+//     1=time:delta:u32,temperature:delta:i16,x:delta:i16,y:delta:i16,\
+//     z:delta:i16,volts:fixed:f32,moving:flag
+
+#define READINGS 100
+
+struct Reading {
+  uint32_t time;
+  int16_t temperature;
+  int16_t x, y, z;
+  float volts;
+  bool moving;
+
+  template <typename Fields>
+  void telemetry(Fields &f, const Reading &prev) const {
+    f.delta(time, prev.time);
+    f.delta(temperature, prev.temperature);
+    f.delta(x, prev.x);
+    f.delta(y, prev.y);
+    f.delta(z, prev.z);
+    f.fixed(volts);
+    f.flag(moving);
+  }
+};
+
+static TelemetryEncoder<Reading> telemetry(1);
+
+static void readingAt(uint16_t n, Reading *reading) {
+  // Something that moves like a Bean on a desk, without the sensor time
+  reading->time = n * 250UL;
+  reading->temperature = 23 + (n / 40);
+  reading->x = (n * 7) % 11 - 5;
+  reading->y = (n * 5) % 7 - 3;
+  reading->z = 256 + (n * 3) % 5 - 2;
+  reading->volts = 3.0 - n * 0.001;
+  reading->moving = n % 8 == 0;
+}
+
+void setup() {}
+
+void loop() {
+  Reading reading;
+  uint32_t start;
+
+  start = millis();
+  for (uint16_t n = 0; n < READINGS; n++) {
+    readingAt(n, &reading);
+    Serial.print(reading.time);
+    Serial.print(',');
+    Serial.print(reading.temperature);
+    Serial.print(',');
+    Serial.print(reading.x);
+    Serial.print(',');
+    Serial.print(reading.y);
+    Serial.print(',');
+    Serial.print(reading.z);
+    Serial.print(',');
+    Serial.print(reading.volts, 3);
+    Serial.print(',');
+    Serial.println(reading.moving);
+  }
+  Serial.flush();
+  uint32_t printed = millis() - start;
+
+  start = millis();
+  telemetry.sendKey();
+  for (uint16_t n = 0; n < READINGS; n++) {
+    readingAt(n, &reading);
+    telemetry.write(reading);
+  }
+  Serial.flush();
+  uint32_t encoded = millis() - start;
+
+  Serial.print("print: ");
+  Serial.print(printed);
+  Serial.print(" ms, telemetry: ");
+  Serial.print(encoded);
+  Serial.println(" ms");
+
+  Bean.sleep(5000);
+}